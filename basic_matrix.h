@@ -0,0 +1,478 @@
+#ifndef BASIC_MATRIX_H
+#define BASIC_MATRIX_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <initializer_list>
+#include <stdexcept>
+#include <sstream>
+#include <vector>
+
+#include <stdint.h>
+
+/**
+ * Packed arithmetic modulo 2^Bits on PackedWord<Bits>::lanes elements of a 64-bit word.
+ * Lane sizes and masks are compile time constants, so every width gets its own
+ * branch-free code: carries and borrows are kept inside of the lanes
+ * by handling the highest bits of the lanes separately
+ */
+template <unsigned Bits>
+struct PackedWord {
+  static_assert((Bits == 1) || (Bits == 2) || (Bits == 4) || (Bits == 8), "Element width should be 1, 2, 4 or 8 bits");
+  //! Elements in one byte and in one word
+  static constexpr size_t lanes_per_byte = 8 / Bits;
+  static constexpr size_t lanes = 64 / Bits;
+  //! Mask of one element
+  static constexpr uint64_t mask = (1u << Bits) - 1;
+  //! Lowest and highest bits of all lanes
+  static constexpr uint64_t lo_bits = ~0ULL / mask;
+  static constexpr uint64_t hi_bits = lo_bits << (Bits - 1);
+  //! Word with all lanes equal to value
+  static inline uint64_t splat(unsigned value) {
+    return (value & mask) * lo_bits;
+  }
+  static inline uint64_t sum(uint64_t a, uint64_t b) {
+    return ((a & ~hi_bits) + (b & ~hi_bits)) ^ ((a ^ b) & hi_bits);
+  }
+  static inline uint64_t diff(uint64_t a, uint64_t b) {
+    return ((a | hi_bits) - (b & ~hi_bits)) ^ ((a ^ ~b) & hi_bits);
+  }
+  //! Element-wise product
+  static inline uint64_t multiply(uint64_t a, uint64_t b) {
+    // Shift and add: lanes of a shifted inside of the lanes are taken where the bit of b is set
+    uint64_t product = 0;
+    for (unsigned t = 0; t < Bits; ++t) {
+      uint64_t shifted = (a << t) & (((mask << t) & mask) * lo_bits);
+      uint64_t selected = ((b >> t) & lo_bits) * mask;
+      product = sum(product, shifted & selected);
+    }
+    return product;
+  }
+  /**
+   * Lanes of a multiplied by the same factor: even and odd lanes are multiplied
+   * by one integer multiplication each, their products fit into two lanes
+   */
+  static inline uint64_t scale(uint64_t a, unsigned factor) {
+    const uint64_t even = ~0ULL / ((1ULL << (2 * Bits)) - 1) * mask;
+    factor &= mask;
+    return (((a & even) * factor) & even) | (((((a >> Bits) & even) * factor) & even) << Bits);
+  }
+  /**
+   * Sum of the element-wise products of a and b, only its value modulo 2^Bits is meaningful:
+   * bit t of all lanes is counted by popcount and weighted by 2^t
+   */
+  static inline unsigned dot(uint64_t a, uint64_t b) {
+    uint64_t product = multiply(a, b);
+    unsigned sum = 0;
+    for (unsigned t = 0; t < Bits; ++t) {
+      sum += __builtin_popcountll(product & (lo_bits << t)) << t;
+    }
+    return sum;
+  }
+};
+
+template <unsigned Bits> constexpr size_t PackedWord<Bits>::lanes_per_byte;
+template <unsigned Bits> constexpr size_t PackedWord<Bits>::lanes;
+template <unsigned Bits> constexpr uint64_t PackedWord<Bits>::mask;
+template <unsigned Bits> constexpr uint64_t PackedWord<Bits>::lo_bits;
+template <unsigned Bits> constexpr uint64_t PackedWord<Bits>::hi_bits;
+
+//! GF(2): sum and difference are exclusive or, product is conjunction, dot product is parity of popcount
+template <>
+inline uint64_t PackedWord<1>::sum(uint64_t a, uint64_t b) {
+  return a ^ b;
+}
+
+template <>
+inline uint64_t PackedWord<1>::diff(uint64_t a, uint64_t b) {
+  return a ^ b;
+}
+
+template <>
+inline uint64_t PackedWord<1>::multiply(uint64_t a, uint64_t b) {
+  return a & b;
+}
+
+template <>
+inline unsigned PackedWord<1>::dot(uint64_t a, uint64_t b) {
+  return __builtin_popcountll(a & b);
+}
+
+template <>
+inline uint64_t PackedWord<1>::scale(uint64_t a, unsigned factor) {
+  return a & splat(factor);
+}
+
+template <>
+inline uint64_t PackedWord<2>::multiply(uint64_t a, uint64_t b) {
+  // (a0 + 2*a1)*(b0 + 2*b1) = a0*b0 + 2*(a0*b1 + a1*b0) mod 4
+  uint64_t lo = a & b & lo_bits;
+  uint64_t hi = (((a >> 1) & b) ^ (a & (b >> 1))) & lo_bits;
+  return lo | (hi << 1);
+}
+
+/**
+ * [row x col] matrix of Bits-bit elements modulo 2^Bits (GF(2) for 1 bit).
+ * Elements are packed into 64-bit words, rows are padded to whole words
+ * and padding lanes are always zero, so arithmetic works on whole words
+ * with the kernels of PackedWord<Bits>.
+ * BasicMatrix<2> is Matrix (see matrix_strassen.h): it is specialized
+ * with SIMD kernels, tuning and the rest of the library, but keeps the same constructors,
+ * element accessors, row_words() and the operators, so code may be written for any width
+ */
+template <unsigned Bits>
+class BasicMatrix {
+public:
+  typedef PackedWord<Bits> Word;
+  /**
+   * BasicMatrix<4> m({ {1, 2, 3}, {4, 5, -1} });
+   * Values are taken modulo 2^Bits, so negative ones are allowed.
+   * Throws std::length_error if some of rows in data have different size
+   */
+  BasicMatrix(std::initializer_list<std::initializer_list<int> > data);
+  BasicMatrix(size_t row, size_t col)
+             :row_(row), col_(col), stride_((col + Word::lanes - 1) / Word::lanes), words_(row * stride_) {}
+  friend bool operator==(const BasicMatrix& lhs, const BasicMatrix& rhs) {
+    return (lhs.row_ == rhs.row_) && (lhs.col_ == rhs.col_) && (lhs.words_ == rhs.words_);
+  }
+  //! Throw std::length_error if sizes of the operands do not match
+  BasicMatrix operator+(const BasicMatrix& rhs) const;
+  BasicMatrix operator-(const BasicMatrix& rhs) const;
+  //! The same as multiply_strassen()
+  BasicMatrix operator*(const BasicMatrix& rhs) const;
+  /**
+   * Transposition by blocks of Word::lanes x Word::lanes elements (64x64 bits for GF(2), 8x8 bytes
+   * for 8 bits): rows of a block are loaded as words and transposed with shifts and masks
+   */
+  BasicMatrix transposed() const;
+  /*
+   * Multiplication algorithms,
+   * throw std::length_error if column number of lhs is not equal to row number of rhs
+   */
+  //! Dot products of rows of lhs and rows of transposed rhs
+  static BasicMatrix multiply_trivial(const BasicMatrix& lhs, const BasicMatrix& rhs);
+  /**
+   * Method of Four Russians: every byte of lhs row packs the coefficients of the rows of rhs
+   * in one group (8 rows for GF(2), 1 row for 8 bits), so it indexes a table
+   * of all 256 linear combinations of the group and each product row sums one entry per byte
+   */
+  static BasicMatrix multiply_m4rm(const BasicMatrix& lhs, const BasicMatrix& rhs);
+  /**
+   * Strassen recursion on quadrants padded with zeroes to equal sizes,
+   * column splits are aligned to words. Blocks not larger than strassen_crossover()
+   * are multiplied by multiply_m4rm().
+   * Quadrants are copied rather than viewed as in Matrix::strassen(): that recursion is compiled
+   * for the byte rows of 2-bit elements with its SIMD kernels and thread pool, while here
+   * the padded copies keep the recursion header-only for every width and need no peeling of odd sizes
+   */
+  static BasicMatrix multiply_strassen(const BasicMatrix& lhs, const BasicMatrix& rhs);
+  /**
+   * multiply_strassen() switches to multiply_m4rm() for blocks not larger than this size
+   * (2048 by default), the setting is shared by all matrices of the same width.
+   * Throws std::invalid_argument for sizes less than Word::lanes
+   */
+  static size_t strassen_crossover();
+  static void set_strassen_crossover(size_t size);
+  void clear() {
+    std::fill(words_.begin(), words_.end(), 0);
+  }
+  inline uint8_t get(size_t i, size_t j) const {
+    return (words_[i * stride_ + j / Word::lanes] >> ((j % Word::lanes) * Bits)) & Word::mask;
+  }
+  //! value is taken modulo 2^Bits
+  inline void set(size_t i, size_t j, unsigned value) {
+    uint64_t& word = words_[i * stride_ + j / Word::lanes];
+    size_t shift = (j % Word::lanes) * Bits;
+    word = (word & ~(Word::mask << shift)) | (static_cast<uint64_t>(value & Word::mask) << shift);
+  }
+  size_t row() const {
+    return row_;
+  }
+  size_t col() const {
+    return col_;
+  }
+  //! Distance between starts of the adjacent rows in words
+  size_t stride() const {
+    return stride_;
+  }
+  //! Pointer to the first word of i-th row, padding lanes are zero
+  inline uint64_t* row_words(size_t i) {
+    return &words_[i * stride_];
+  }
+  inline const uint64_t* row_words(size_t i) const {
+    return &words_[i * stride_];
+  }
+private:
+  static void check_sizes(const char* func, const BasicMatrix& lhs, const BasicMatrix& rhs);
+  static void check_product(const char* func, const BasicMatrix& lhs, const BasicMatrix& rhs);
+  static std::atomic<size_t>& strassen_crossover_value();
+  //! Transposes [Word::lanes x Word::lanes] block packed into Word::lanes words in place
+  static void transpose_block(uint64_t* block);
+  /**
+   * Copy of the block [row, row + rows) x [col, col + cols), col is a multiple of Word::lanes.
+   * Elements outside of the matrix are zero
+   */
+  BasicMatrix block(size_t row, size_t col, size_t rows, size_t cols) const;
+  //! Copies b to [row, row + b.row()) x [col, col + b.col()), elements outside of the matrix are dropped
+  void set_block(size_t row, size_t col, const BasicMatrix& b);
+  size_t row_;
+  size_t col_;
+  size_t stride_;
+  std::vector<uint64_t> words_;
+};
+
+//! Elements of GF(2) and of Z/16, Z/256
+typedef BasicMatrix<1> BitMatrix;
+typedef BasicMatrix<4> NibbleMatrix;
+typedef BasicMatrix<8> ByteMatrix;
+
+//! Defined in matrix_strassen.h
+template <> class BasicMatrix<2>;
+typedef BasicMatrix<2> Matrix;
+
+template <unsigned Bits>
+BasicMatrix<Bits>::BasicMatrix(std::initializer_list<std::initializer_list<int> > data)
+                              :row_(data.size()), col_(row_ ? data.begin()->size() : 0),
+                               stride_((col_ + Word::lanes - 1) / Word::lanes), words_(row_ * stride_) {
+  size_t i = 0;
+  for (auto it = data.begin(); it != data.end(); ++it, ++i) {
+    if (it->size() != col_) {
+      std::stringstream msg;
+      msg << "BasicMatrix::BasicMatrix(): Different column numbers in initializer_list rows";
+      throw std::length_error(msg.str());
+    }
+    size_t j = 0;
+    for (auto it1 = it->begin(); it1 != it->end(); ++it1, ++j) {
+      set(i, j, *it1);
+    }
+  }
+}
+
+template <unsigned Bits>
+void BasicMatrix<Bits>::check_sizes(const char* func, const BasicMatrix& lhs, const BasicMatrix& rhs) {
+  if ((lhs.row_ != rhs.row_) || (lhs.col_ != rhs.col_)) {
+    std::stringstream msg;
+    msg << func << ": Sizes of matricies should be equal("
+        << lhs.row_ << "x" << lhs.col_ << " and " << rhs.row_ << "x" << rhs.col_ << " provided)";
+    throw std::length_error(msg.str());
+  }
+}
+
+template <unsigned Bits>
+BasicMatrix<Bits> BasicMatrix<Bits>::operator+(const BasicMatrix& rhs) const {
+  check_sizes("BasicMatrix::operator+", *this, rhs);
+  BasicMatrix m(row_, col_);
+  for (size_t w = 0; w < words_.size(); ++w) {
+    m.words_[w] = Word::sum(words_[w], rhs.words_[w]);
+  }
+  return m;
+}
+
+template <unsigned Bits>
+BasicMatrix<Bits> BasicMatrix<Bits>::operator-(const BasicMatrix& rhs) const {
+  check_sizes("BasicMatrix::operator-", *this, rhs);
+  BasicMatrix m(row_, col_);
+  for (size_t w = 0; w < words_.size(); ++w) {
+    m.words_[w] = Word::diff(words_[w], rhs.words_[w]);
+  }
+  return m;
+}
+
+template <unsigned Bits>
+void BasicMatrix<Bits>::check_product(const char* func, const BasicMatrix& lhs, const BasicMatrix& rhs) {
+  if (lhs.col_ != rhs.row_) {
+    std::stringstream msg;
+    msg << func << ": Column number of first matrix should be equal to row number of the second matrix ("
+        << lhs.col_ << " and " << rhs.row_ << " provided)";
+    throw std::length_error(msg.str());
+  }
+}
+
+template <unsigned Bits>
+BasicMatrix<Bits> BasicMatrix<Bits>::operator*(const BasicMatrix& rhs) const {
+  check_product("BasicMatrix::operator*", *this, rhs);
+  return multiply_strassen(*this, rhs);
+}
+
+template <unsigned Bits>
+BasicMatrix<Bits> BasicMatrix<Bits>::multiply_trivial(const BasicMatrix& lhs, const BasicMatrix& rhs) {
+  check_product("BasicMatrix::multiply_trivial", lhs, rhs);
+  BasicMatrix t(rhs.transposed());
+  BasicMatrix m(lhs.row_, rhs.col_);
+  for (size_t i = 0; i < lhs.row_; ++i) {
+    const uint64_t* a = lhs.row_words(i);
+    for (size_t j = 0; j < rhs.col_; ++j) {
+      const uint64_t* b = t.row_words(j);
+      unsigned sum = 0;
+      for (size_t w = 0; w < lhs.stride_; ++w) {
+        sum += Word::dot(a[w], b[w]);
+      }
+      m.set(i, j, sum);
+    }
+  }
+  return m;
+}
+
+template <unsigned Bits>
+BasicMatrix<Bits> BasicMatrix<Bits>::multiply_m4rm(const BasicMatrix& lhs, const BasicMatrix& rhs) {
+  check_product("BasicMatrix::multiply_m4rm", lhs, rhs);
+  BasicMatrix m(lhs.row_, rhs.col_);
+  size_t words = m.stride_;
+  std::vector<uint64_t> table(256 * words);
+  for (size_t group = 0; group * Word::lanes_per_byte < lhs.col_; ++group) {
+    size_t first = group * Word::lanes_per_byte;
+    size_t count = std::min<size_t>(Word::lanes_per_byte, lhs.col_ - first);
+    /*
+     * Entry v is the entry without the lowest nonzero lane of v
+     * plus the row of that lane scaled by its value. Lanes beyond count are zero in lhs
+     */
+    size_t entries = 1u << (count * Bits);
+    for (size_t v = 1; v < entries; ++v) {
+      size_t shift = __builtin_ctz(v) / Bits * Bits;
+      const uint64_t* prev = &table[(v & ~(Word::mask << shift)) * words];
+      const uint64_t* row = rhs.row_words(first + shift / Bits);
+      unsigned factor = (v >> shift) & Word::mask;
+      uint64_t* entry = &table[v * words];
+      for (size_t w = 0; w < words; ++w) {
+        entry[w] = Word::sum(prev[w], Word::scale(row[w], factor));
+      }
+    }
+    for (size_t i = 0; i < lhs.row_; ++i) {
+      size_t v = (lhs.row_words(i)[group / 8] >> (group % 8 * 8)) & 0xFF;
+      if (!v)
+        continue;
+      const uint64_t* entry = &table[v * words];
+      uint64_t* dst = m.row_words(i);
+      for (size_t w = 0; w < words; ++w) {
+        dst[w] = Word::sum(dst[w], entry[w]);
+      }
+    }
+  }
+  return m;
+}
+
+template <unsigned Bits>
+BasicMatrix<Bits> BasicMatrix<Bits>::multiply_strassen(const BasicMatrix& lhs, const BasicMatrix& rhs) {
+  check_product("BasicMatrix::multiply_strassen", lhs, rhs);
+  size_t m = lhs.row_;
+  size_t k = lhs.col_;
+  size_t n = rhs.col_;
+  if (std::min(std::min(m, k), n) <= strassen_crossover())
+    return multiply_m4rm(lhs, rhs);
+  size_t hm = (m + 1) / 2;
+  size_t hk = ((k + 1) / 2 + Word::lanes - 1) / Word::lanes * Word::lanes;
+  size_t hn = ((n + 1) / 2 + Word::lanes - 1) / Word::lanes * Word::lanes;
+  BasicMatrix a11(lhs.block(0, 0, hm, hk));
+  BasicMatrix a12(lhs.block(0, hk, hm, hk));
+  BasicMatrix a21(lhs.block(hm, 0, hm, hk));
+  BasicMatrix a22(lhs.block(hm, hk, hm, hk));
+  BasicMatrix b11(rhs.block(0, 0, hk, hn));
+  BasicMatrix b12(rhs.block(0, hn, hk, hn));
+  BasicMatrix b21(rhs.block(hk, 0, hk, hn));
+  BasicMatrix b22(rhs.block(hk, hn, hk, hn));
+  BasicMatrix p1(multiply_strassen(a11 + a22, b11 + b22));
+  BasicMatrix p2(multiply_strassen(a21 + a22, b11));
+  BasicMatrix p3(multiply_strassen(a11, b12 - b22));
+  BasicMatrix p4(multiply_strassen(a22, b21 - b11));
+  BasicMatrix p5(multiply_strassen(a11 + a12, b22));
+  BasicMatrix p6(multiply_strassen(a21 - a11, b11 + b12));
+  BasicMatrix p7(multiply_strassen(a12 - a22, b21 + b22));
+  BasicMatrix c(m, n);
+  c.set_block(0, 0, p1 + p4 - p5 + p7);
+  c.set_block(0, hn, p3 + p5);
+  c.set_block(hm, 0, p2 + p4);
+  c.set_block(hm, hn, p1 - p2 + p3 + p6);
+  return c;
+}
+
+template <unsigned Bits>
+std::atomic<size_t>& BasicMatrix<Bits>::strassen_crossover_value() {
+  static std::atomic<size_t> value(2048);
+  return value;
+}
+
+template <unsigned Bits>
+size_t BasicMatrix<Bits>::strassen_crossover() {
+  return strassen_crossover_value().load(std::memory_order_relaxed);
+}
+
+template <unsigned Bits>
+void BasicMatrix<Bits>::set_strassen_crossover(size_t size) {
+  // Column halves are rounded up to words, so smaller blocks would not shrink
+  if (size < Word::lanes) {
+    std::stringstream msg;
+    msg << "BasicMatrix::set_strassen_crossover: Crossover size should be at least " << Word::lanes
+        << " (" << size << " provided)";
+    throw std::invalid_argument(msg.str());
+  }
+  strassen_crossover_value().store(size, std::memory_order_relaxed);
+}
+
+template <unsigned Bits>
+BasicMatrix<Bits> BasicMatrix<Bits>::block(size_t row, size_t col, size_t rows, size_t cols) const {
+  BasicMatrix b(rows, cols);
+  size_t first = col / Word::lanes;
+  size_t words = (first < stride_) ? std::min(b.stride_, stride_ - first) : 0;
+  for (size_t i = 0; (i < rows) && (row + i < row_); ++i) {
+    std::copy(row_words(row + i) + first, row_words(row + i) + first + words, b.row_words(i));
+    if ((cols % Word::lanes) && (words == b.stride_))
+      b.row_words(i)[words - 1] &= ~0ULL >> (64 - cols % Word::lanes * Bits);
+  }
+  return b;
+}
+
+template <unsigned Bits>
+void BasicMatrix<Bits>::set_block(size_t row, size_t col, const BasicMatrix& b) {
+  size_t first = col / Word::lanes;
+  size_t words = std::min(b.stride_, stride_ - first);
+  for (size_t i = 0; (i < b.row_) && (row + i < row_); ++i) {
+    std::copy(b.row_words(i), b.row_words(i) + words, row_words(row + i) + first);
+    if (col_ % Word::lanes)
+      row_words(row + i)[stride_ - 1] &= ~0ULL >> (64 - col_ % Word::lanes * Bits);
+  }
+}
+
+template <unsigned Bits>
+void BasicMatrix<Bits>::transpose_block(uint64_t* block) {
+  // Off-diagonal quarters of the sub-blocks of 2h x 2h elements are swapped, from the whole block down to 2x2
+  for (size_t h = Word::lanes / 2; h > 0; h /= 2) {
+    uint64_t low = 0;
+    for (size_t c = 0; c < Word::lanes; ++c) {
+      if (!(c & h))
+        low |= Word::mask << (c * Bits);
+    }
+    size_t shift = h * Bits;
+    for (size_t r = 0; r < Word::lanes; ++r) {
+      if (r & h)
+        continue;
+      uint64_t t = ((block[r] >> shift) ^ block[r + h]) & low;
+      block[r + h] ^= t;
+      block[r] ^= t << shift;
+    }
+  }
+}
+
+template <unsigned Bits>
+BasicMatrix<Bits> BasicMatrix<Bits>::transposed() const {
+  const size_t lanes = Word::lanes;
+  BasicMatrix m(col_, row_);
+  uint64_t block[Word::lanes];
+  for (size_t i = 0; i < row_; i += lanes) {
+    size_t rows = std::min(lanes, row_ - i);
+    for (size_t j = 0; j < col_; j += lanes) {
+      // Rows beyond the matrix and padding lanes are zero, so are the padding lanes of the result
+      for (size_t r = 0; r < lanes; ++r) {
+        block[r] = (r < rows) ? row_words(i + r)[j / lanes] : 0;
+      }
+      transpose_block(block);
+      size_t cols = std::min(lanes, col_ - j);
+      for (size_t r = 0; r < cols; ++r) {
+        m.row_words(j + r)[i / lanes] = block[r];
+      }
+    }
+  }
+  return m;
+}
+
+#endif // BASIC_MATRIX_H
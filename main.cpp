@@ -1,14 +1,456 @@
 #include <iostream>
+#include <cstdio>
+#include <fstream>
 #include <random>
 #include <cstdlib>
+#include <cstring>
 #include <thread>
 #include <chrono>
 #include <vector>
+#include <string>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
 
 #include <stdlib.h>
 #include <time.h>
 
+#include "matrix_file.h"
 #include "matrix_strassen.h"
+#include "sparse_matrix.h"
+#include "strassen_profile.h"
+
+/*
+ * Allocation counters: operator new is replaced here, posix_memalign (used by Matrix)
+ * is wrapped by the linker with -Wl,--wrap=posix_memalign
+ */
+static std::atomic<size_t> allocated_bytes(0);
+static std::atomic<size_t> allocation_count(0);
+
+void* operator new(size_t size) {
+  allocated_bytes += size;
+  allocation_count++;
+  void* ptr = malloc(size ? size : 1);
+  if (!ptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+#pragma GCC diagnostic pop
+
+extern "C" int __real_posix_memalign(void** ptr, size_t alignment, size_t size);
+
+extern "C" int __wrap_posix_memalign(void** ptr, size_t alignment, size_t size) {
+  allocated_bytes += size;
+  allocation_count++;
+  return __real_posix_memalign(ptr, alignment, size);
+}
+
+//! Timing of one benchmark case
+struct BenchResult {
+  BenchResult(const std::string& name, size_t m, size_t k, size_t n, size_t repeats, double element_ops)
+             :name(name), m(m), k(k), n(n), threads(Matrix::thread_count()), repeats(repeats), times(),
+              element_ops(element_ops), bytes_allocated(0), allocations(0) {}
+  std::string name;
+  size_t m;
+  size_t k;
+  size_t n;
+  size_t threads;
+  size_t repeats;
+  //! Times of the runs in ms, sorted
+  std::vector<double> times;
+  /**
+   * Element operations per run: m * k * n for products, m * k for element-wise operations (n is 0),
+   * 0 if the work is not known in advance (only times are reported then)
+   */
+  double element_ops;
+  size_t bytes_allocated;
+  size_t allocations;
+};
+
+struct BenchOptions {
+  BenchOptions() :repeats(0), quick(false), filter(), json(), profile() {}
+  size_t repeats;
+  bool quick;
+  std::string filter;
+  std::string json;
+  //! Strassen recursion profile of all the cases, empty unless built with STRASSEN_PROFILE
+  std::string profile;
+};
+
+//! Nearest-rank percentile of sorted times
+static double percentile(const std::vector<double>& times, double p) {
+  size_t rank = static_cast<size_t>(p / 100 * times.size() + 0.5);
+  rank = std::min(std::max<size_t>(rank, 1), times.size());
+  return times[rank - 1];
+}
+
+static void fill_random(Matrix& m, std::mt19937& gen) {
+  std::vector<uint8_t> elements(m.row() * m.col());
+  for (size_t i = 0; i < elements.size(); ++i) {
+    elements[i] = gen();
+  }
+  m.set_elements(elements.data());
+}
+
+//! Multiplication of random [size x size] matrices of Bits-bit elements
+template <unsigned Bits>
+static std::function<void()> bench_basic_multiply(size_t size, std::mt19937& gen) {
+  std::shared_ptr<BasicMatrix<Bits> > a = std::make_shared<BasicMatrix<Bits> >(size, size);
+  std::shared_ptr<BasicMatrix<Bits> > b = std::make_shared<BasicMatrix<Bits> >(size, size);
+  for (size_t i = 0; i < size; ++i) {
+    for (size_t j = 0; j < size; ++j) {
+      a->set(i, j, gen());
+      b->set(i, j, gen());
+    }
+  }
+  return [a, b] { *a * *b; };
+}
+
+/**
+ * Runs op once to warm up caches and kernels, then repeats times with timing.
+ * Allocations are counted over the timed runs and reported per run
+ */
+static BenchResult run_case(const std::string& name, size_t m, size_t k, size_t n, double element_ops,
+                            size_t repeats, const std::function<void()>& op) {
+  BenchResult r(name, m, k, n, repeats, element_ops);
+  op();
+  size_t bytes = allocated_bytes.load();
+  size_t count = allocation_count.load();
+  for (size_t i = 0; i < repeats; ++i) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    op();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    r.times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+  }
+  r.bytes_allocated = (allocated_bytes.load() - bytes) / repeats;
+  r.allocations = (allocation_count.load() - count) / repeats;
+  std::sort(r.times.begin(), r.times.end());
+  return r;
+}
+
+static void print_result(const BenchResult& r) {
+  double median = percentile(r.times, 50);
+  std::cout << r.name << " [" << r.m << " x " << r.k << "]";
+  if (r.n)
+    std::cout << " * [" << r.k << " x " << r.n << "]";
+  std::cout << " threads=" << r.threads
+            << ": median " << median << " ms, p10 " << percentile(r.times, 10)
+            << " ms, p90 " << percentile(r.times, 90) << " ms, p99 " << percentile(r.times, 99) << " ms, ";
+  if (r.element_ops > 0)
+    std::cout << r.element_ops / (median / 1000) << " elem-ops/s, ";
+  std::cout << r.bytes_allocated << " bytes in " << r.allocations << " allocations" << std::endl;
+}
+
+static void write_json(const std::string& path, const std::vector<BenchResult>& results) {
+  std::ofstream out(path.c_str());
+  Matrix::Tuning tuning = Matrix::tuning();
+  out << "{\n  \"version\": 1,\n"
+      << "  \"simd\": \"" << Matrix::simd_level_name(Matrix::simd_level()) << "\",\n"
+      << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+      << "  \"crossover\": " << tuning.crossover << ",\n"
+      << "  \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchResult& r = results[i];
+    double median = percentile(r.times, 50);
+    out << (i ? "," : "") << "\n    {\"name\": \"" << r.name << "\", \"m\": " << r.m
+        << ", \"k\": " << r.k << ", \"n\": " << r.n << ", \"threads\": " << r.threads
+        << ", \"repeats\": " << r.repeats << ", \"min_ms\": " << r.times.front()
+        << ", \"median_ms\": " << median << ", \"p10_ms\": " << percentile(r.times, 10)
+        << ", \"p90_ms\": " << percentile(r.times, 90) << ", \"p99_ms\": " << percentile(r.times, 99)
+        << ", \"max_ms\": " << r.times.back() << ", \"element_ops_per_s\": ";
+    if (r.element_ops > 0)
+      out << r.element_ops / (median / 1000);
+    else
+      out << "null";
+    out << ", \"bytes_allocated\": " << r.bytes_allocated << ", \"allocations\": " << r.allocations << "}";
+  }
+  out << "\n  ]\n}\n";
+  if (!out)
+    std::cerr << "Can not write " << path << std::endl;
+}
+
+/**
+ * Benchmark suite: every multiplication algorithm on square, non power of 2
+ * and rectangular shapes, element-wise operations and thread scaling of Strassen algorithm.
+ * Inputs are generated once per shape with fixed seed, so results of different builds can be compared
+ */
+static void run_benchmarks(const BenchOptions& options) {
+  std::vector<BenchResult> results;
+  std::mt19937 gen(12345);
+  size_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t saved_threads = Matrix::thread_count();
+  Matrix::Algorithm saved_base = Matrix::base_algorithm();
+  std::vector<std::vector<size_t> > shapes;
+  if (options.quick) {
+    shapes = {{64, 64, 64}, {256, 256, 256}, {300, 300, 300}, {512, 64, 512}};
+  } else {
+    shapes = {{64, 64, 64}, {128, 128, 128}, {256, 256, 256}, {512, 512, 512}, {1024, 1024, 1024},
+              {100, 100, 100}, {300, 300, 300}, {1025, 1025, 1025},
+              {2048, 64, 2048}, {64, 2048, 64}, {1500, 700, 300}};
+  }
+  auto selected = [&options](const std::string& name) {
+    return options.filter.empty() || (name.find(options.filter) != std::string::npos);
+  };
+  auto add = [&results](const BenchResult& r) {
+    print_result(r);
+    results.push_back(r);
+  };
+  Matrix::set_thread_count(1);
+  for (size_t s = 0; s < shapes.size(); ++s) {
+    size_t m = shapes[s][0];
+    size_t k = shapes[s][1];
+    size_t n = shapes[s][2];
+    Matrix a(m, k);
+    Matrix b(k, n);
+    fill_random(a, gen);
+    fill_random(b, gen);
+    double ops = static_cast<double>(m) * k * n;
+    if (selected("trivial"))
+      add(run_case("trivial", m, k, n, ops, options.repeats, [&] { Matrix::multiply_trivial(a, b); }));
+    if (selected("m4rm"))
+      add(run_case("m4rm", m, k, n, ops, options.repeats, [&] { Matrix::multiply_m4rm(a, b); }));
+    if (selected("strassen"))
+      add(run_case("strassen", m, k, n, ops, options.repeats, [&] { Matrix::multiply_strassen(a, b); }));
+    if (selected("strassen_m4rm")) {
+      Matrix::set_base_algorithm(Matrix::Algorithm::M4RM);
+      add(run_case("strassen_m4rm", m, k, n, ops, options.repeats, [&] { Matrix::multiply_strassen(a, b); }));
+      Matrix::set_base_algorithm(saved_base);
+    }
+    if (selected("winograd"))
+      add(run_case("winograd", m, k, n, ops, options.repeats, [&] { Matrix::multiply_winograd(a, b); }));
+    if (selected("strassen_parallel")) {
+      Matrix::set_thread_count(hardware_threads);
+      add(run_case("strassen_parallel", m, k, n, ops, options.repeats, [&] { Matrix::multiply_strassen(a, b); }));
+      Matrix::set_thread_count(1);
+    }
+    // Element-wise operations on the [m x k] operand
+    Matrix c(m, k);
+    fill_random(c, gen);
+    double elements = static_cast<double>(m) * k;
+    if (selected("add"))
+      add(run_case("add", m, k, 0, elements, options.repeats, [&] { Matrix d = a + c; }));
+    if (selected("sub"))
+      add(run_case("sub", m, k, 0, elements, options.repeats, [&] { Matrix d = a - c; }));
+    if (selected("transposed"))
+      add(run_case("transposed", m, k, 0, elements, options.repeats, [&] { a.transposed(); }));
+  }
+  if (selected("batch")) {
+    // Many independent small products, one at a time and as a batch
+    size_t sizes[] = {16, 64, 128};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+      size_t size = sizes[s];
+      size_t count = options.quick ? 100 : 1000;
+      std::vector<Matrix> lhs(count, Matrix(size, size));
+      std::vector<Matrix> rhs(count, Matrix(size, size));
+      std::vector<Matrix> out(count, Matrix(size, size));
+      for (size_t i = 0; i < count; ++i) {
+        fill_random(lhs[i], gen);
+        fill_random(rhs[i], gen);
+      }
+      double ops = static_cast<double>(count) * size * size * size;
+      add(run_case("batch_loop", size, size, size, ops, options.repeats, [&] {
+        for (size_t i = 0; i < count; ++i) {
+          out[i] = lhs[i] * rhs[i];
+        }
+      }));
+      for (size_t t = 1; ; t = std::min(2 * t, hardware_threads)) {
+        Matrix::set_thread_count(t);
+        add(run_case("batch", size, size, size, ops, options.repeats, [&] {
+          Matrix::multiply_batch(lhs.data(), rhs.data(), out.data(), count);
+        }));
+        if (t == hardware_threads)
+          break;
+      }
+      Matrix::set_thread_count(1);
+    }
+  }
+  if (selected("gemv") || selected("gevm")) {
+    // Matrix-vector products of iterative propagation x <- A * x, bound by memory bandwidth
+    size_t size = options.quick ? 2048 : 8192;
+    Matrix a(size, size);
+    Matrix x(size, 1);
+    Matrix y(1, size);
+    fill_random(a, gen);
+    fill_random(x, gen);
+    fill_random(y, gen);
+    double ops = static_cast<double>(size) * size;
+    if (selected("gemv"))
+      add(run_case("gemv", size, size, 1, ops, options.repeats, [&] { Matrix::multiply_vector(a, x); }));
+    if (selected("gevm"))
+      add(run_case("gevm", 1, size, size, ops, options.repeats, [&] { Matrix::multiply_vector(y, a); }));
+  }
+  if (selected("basic")) {
+    // Row multiplication kernels of the other element widths
+    size_t size = options.quick ? 256 : 1024;
+    double ops = static_cast<double>(size) * size * size;
+    add(run_case("basic_gf2", size, size, size, ops, options.repeats,
+                 bench_basic_multiply<1>(size, gen)));
+    add(run_case("basic_z16", size, size, size, ops, options.repeats,
+                 bench_basic_multiply<4>(size, gen)));
+    add(run_case("basic_z256", size, size, size, ops, options.repeats,
+                 bench_basic_multiply<8>(size, gen)));
+  }
+  if (selected("gf2")) {
+    // GF(2) products by M4RM and Strassen recursion on 64 elements per word, conversions from and to Matrix
+    size_t size = options.quick ? 1024 : 4096;
+    double ops = static_cast<double>(size) * size * size;
+    add(run_case("gf2_multiply", size, size, size, ops, options.repeats,
+                 bench_basic_multiply<1>(size, gen)));
+    Matrix a(size, size);
+    fill_random(a, gen);
+    BitMatrix bits(a.mod2());
+    ops = static_cast<double>(size) * size;
+    add(run_case("gf2_mod2", size, size, 0, ops, options.repeats, [&] { a.mod2(); }));
+    add(run_case("gf2_lift", size, size, 0, ops, options.repeats, [&] { Matrix m(bits); }));
+  }
+  if (selected("sparse")) {
+    // Adjacency-like lhs of given density (per mille): sparse products against the dense algorithms
+    size_t size = options.quick ? 512 : 2048;
+    double ops = static_cast<double>(size) * size * size;
+    double saved_density = Matrix::sparse_density();
+    const size_t per_mille[] = {1, 10, 50};
+    Matrix b(size, size);
+    fill_random(b, gen);
+    for (size_t d : per_mille) {
+      Matrix a(size, size);
+      for (size_t i = 0; i < size; ++i) {
+        for (size_t j = 0; j < size; ++j) {
+          if (gen() % 1000 < d)
+            a.set(i, j, gen() % 3 + 1);
+        }
+      }
+      SparseMatrix s(a);
+      // Product of sparse matrices multiplies every nonzero (i, k) of lhs by the nonzeros of row k of rhs
+      std::vector<size_t> row_nonzeros(size);
+      for (size_t i = 0; i < size; ++i) {
+        for (size_t j = 0; j < size; ++j) {
+          row_nonzeros[i] += (a.get(i, j) != 0);
+        }
+      }
+      double sparse_ops = 0;
+      for (size_t i = 0; i < size; ++i) {
+        for (size_t k = 0; k < size; ++k) {
+          if (a.get(i, k))
+            sparse_ops += row_nonzeros[k];
+        }
+      }
+      std::string suffix = "_" + std::to_string(d) + "pm";
+      add(run_case("sparse_dense" + suffix, size, size, size, ops, options.repeats, [&] { s * b; }));
+      add(run_case("sparse_sparse" + suffix, size, size, size, sparse_ops, options.repeats, [&] { s * s; }));
+      Matrix::set_sparse_density(0);
+      add(run_case("sparse_as_dense" + suffix, size, size, size, ops, options.repeats, [&] { a * b; }));
+      Matrix::set_sparse_density(saved_density);
+    }
+  }
+  if (selected("import") || selected("export")) {
+    // Bulk packing and unpacking of byte per element buffers against element by element access
+    size_t size = options.quick ? 1024 : 4096;
+    double ops = static_cast<double>(size) * size;
+    Matrix a(size, size);
+    std::vector<uint8_t> elements(size * size);
+    for (size_t i = 0; i < elements.size(); ++i) {
+      elements[i] = gen();
+    }
+    if (selected("import")) {
+      add(run_case("import", size, size, 0, ops, options.repeats, [&] { a.set_elements(elements.data()); }));
+      add(run_case("import_set", size, size, 0, ops, options.repeats, [&] {
+        for (size_t i = 0; i < size; ++i) {
+          for (size_t j = 0; j < size; ++j) {
+            a.set(i, j, elements[i * size + j]);
+          }
+        }
+      }));
+    }
+    if (selected("export")) {
+      add(run_case("export", size, size, 0, ops, options.repeats, [&] { a.get_elements(elements.data()); }));
+      add(run_case("export_get", size, size, 0, ops, options.repeats, [&] {
+        for (size_t i = 0; i < size; ++i) {
+          for (size_t j = 0; j < size; ++j) {
+            elements[i * size + j] = a.get(i, j);
+          }
+        }
+      }));
+    }
+  }
+  if (selected("pow")) {
+    /*
+     * High power of the matrix by repeated squaring. Only time is reported: Matrix::pow()
+     * reduces the exponent by the period of the powers and stops squaring at an idempotent,
+     * so the number of products depends on the matrix
+     */
+    size_t size = options.quick ? 256 : 1024;
+    uint64_t exponent = 1000000;
+    Matrix a(size, size);
+    fill_random(a, gen);
+    add(run_case("pow", size, size, size, 0, options.repeats, [&] { a.pow(exponent); }));
+  }
+  if (selected("inverse") || selected("rank")) {
+    // Elimination over Z/4, its cost should grow as of the multiplication
+    size_t size = options.quick ? 512 : 2048;
+    Matrix l(size, size);
+    Matrix u(size, size);
+    for (size_t i = 0; i < size; ++i) {
+      for (size_t j = 0; j < size; ++j) {
+        l.set(i, j, (j < i) ? gen() : (j == i));
+        u.set(i, j, (j > i) ? gen() : (j == i));
+      }
+    }
+    // Invertible matrix: product of unit triangular ones
+    Matrix a(l * u);
+    double ops = static_cast<double>(size) * size * size;
+    if (selected("inverse"))
+      add(run_case("inverse", size, size, size, ops, options.repeats, [&] { a.inverse(); }));
+    if (selected("rank"))
+      add(run_case("rank", size, size, size, ops, options.repeats, [&] { a.rank(); }));
+  }
+  if (selected("file")) {
+    // Bulk write and read of the binary format and zero-copy mapping with checksum verification
+    size_t size = options.quick ? 2048 : 8192;
+    const char* path = "qmatrix_bench.bin";
+    Matrix a(size, size);
+    fill_random(a, gen);
+    double elements = static_cast<double>(size) * size;
+    add(run_case("file_save", size, size, 0, elements, options.repeats, [&] { a.save(path); }));
+    add(run_case("file_load", size, size, 0, elements, options.repeats, [&] { Matrix::load(path); }));
+    add(run_case("file_map", size, size, 0, elements, options.repeats, [&] { MappedMatrix mapped(path); }));
+    remove(path);
+  }
+  if (selected("scaling")) {
+    size_t size = options.quick ? 512 : 2048;
+    Matrix a(size, size);
+    Matrix b(size, size);
+    fill_random(a, gen);
+    fill_random(b, gen);
+    double ops = static_cast<double>(size) * size * size;
+    for (size_t t = 1; ; t = std::min(2 * t, hardware_threads)) {
+      Matrix::set_thread_count(t);
+      add(run_case("scaling", size, size, size, ops, options.repeats, [&] { Matrix::multiply_strassen(a, b); }));
+      if (t == hardware_threads)
+        break;
+    }
+  }
+  Matrix::set_thread_count(saved_threads);
+  if (!options.json.empty())
+    write_json(options.json, results);
+  if (!options.profile.empty()) {
+    std::ofstream out(options.profile.c_str());
+    out << strassen_profile().to_json();
+  }
+}
+
+static void usage(const char* name) {
+  std::cout << "Usage: " << name << " [--repeats N] [--quick] [--filter NAME] [--json PATH] [--profile PATH]" << std::endl
+            << "       " << name << " --tune [PATH]" << std::endl;
+}
 
 int main(int argc, char** argv) {
   /*Matrix x({{0, 1, 2, 3}, {0, 1, 2, 3}, {0, 1, 2, 3}});
@@ -21,30 +463,45 @@ int main(int argc, char** argv) {
   z.dump();
   return 0;*/
   srand (time(NULL));
-  std::vector<size_t> sizes({32, 64, 100, 128, 256, 512, 1024});
-  for (auto it = sizes.begin(); it != sizes.end(); ++it) {
-    size_t m = *it;
-    size_t n = m;
-    size_t k = m;
-    size_t count = 100;
-    Matrix a(m, n);
-    Matrix b(n, k);
-    std::chrono::microseconds sum(0);
-    for (size_t ctr = 0; ctr < count; ++ctr) {
-      for (size_t i = 0; i < m; ++i) {
-        for (size_t j = 0; j < m; ++j) {
-            a.set(i, j, rand());
-            b.set(i, j, rand());
-          }
-        }
-      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-      Matrix c = a*b;
-      std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-      sum += std::chrono::duration_cast<std::chrono::microseconds> (end - start);
-      std::cout << "\rSize [" << m  << "; " << m << "]: " << ctr << "/" << count << std::flush;
+  if ((argc > 1) && (strcmp(argv[1], "--tune") == 0)) {
+    // Calibrates this host and writes the tuning file loaded by the benchmark,
+    // the library itself reads it only through QMATRIX_TUNING_FILE or Matrix::load_tuning()
+    const char* path = (argc > 2) ? argv[2] : Matrix::default_tuning_path();
+    Matrix::Tuning tuning = Matrix::calibrate();
+    Matrix::save_tuning(path, tuning);
+    std::cout << "Crossover: " << tuning.crossover
+              << ", base algorithm: " << ((tuning.base_algorithm == Matrix::Algorithm::M4RM) ? "m4rm" : "trivial")
+              << ", parallel depth: " << tuning.parallel_max_depth
+              << ", parallel min size: " << tuning.parallel_min_size << std::endl
+              << "Saved to " << path << std::endl;
+    return 0;
+  }
+  BenchOptions options;
+  for (int i = 1; i < argc; ++i) {
+    if ((strcmp(argv[i], "--repeats") == 0) && (i + 1 < argc)) {
+      options.repeats = atol(argv[++i]);
+    } else if (strcmp(argv[i], "--quick") == 0) {
+      options.quick = true;
+    } else if ((strcmp(argv[i], "--filter") == 0) && (i + 1 < argc)) {
+      options.filter = argv[++i];
+    } else if ((strcmp(argv[i], "--json") == 0) && (i + 1 < argc)) {
+      options.json = argv[++i];
+    } else if ((strcmp(argv[i], "--profile") == 0) && (i + 1 < argc)) {
+      options.profile = argv[++i];
+    } else {
+      usage(argv[0]);
+      return 1;
     }
-    double multiplication_time_ms = static_cast<double>(sum.count()) / (count * 1000);
-    std::cout << "\rSize [" << m  << "; " << m << "]: time = " << multiplication_time_ms << " ms."<< std::endl;
   }
+  if (options.repeats == 0)
+    options.repeats = options.quick ? 5 : 11;
+  // Benchmarks run with the tuning written by --tune, if there is one
+  try {
+    Matrix::load_tuning(Matrix::default_tuning_path());
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  run_benchmarks(options);
   return 0;
 }
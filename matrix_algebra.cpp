@@ -0,0 +1,339 @@
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "packed_kernels.h"
+
+static uint64_t gcd(uint64_t a, uint64_t b) {
+  while (b) {
+    uint64_t r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+//! a * b or 0 if the product does not fit into 64 bits
+static uint64_t checked_multiply(uint64_t a, uint64_t b) {
+  if (a && (b > UINT64_MAX / a))
+    return 0;
+  return a * b;
+}
+
+/**
+ * Period U such that A^(2n + U) = A^(2n) for every [n x n] matrix A over Z/4,
+ * 0 if it does not fit into 64 bits.
+ * By Fitting lemma Z/4^n is a direct sum of two A-invariant submodules:
+ * A is nilpotent on the first one (its length is at most 2n, so A^(2n) vanishes there)
+ * and invertible on the second one, which is free of some rank r <= n.
+ * Order of any element of GL_r(Z/2) divides 2^ceil(log2 r) * lcm(2^d - 1, d = 1..r),
+ * and if B = I + 2X then B^2 = I, so U = 2 * 2^ceil(log2 n) * lcm(2^d - 1, d = 1..n)
+ */
+static uint64_t power_period(size_t n) {
+  if (n >= 64)
+    return 0;
+  uint64_t period = 1;
+  for (size_t d = 1; (d <= n) && period; ++d) {
+    uint64_t order = (1ULL << d) - 1;
+    period = checked_multiply(period / gcd(period, order), order);
+  }
+  for (size_t p = 1; (p < n) && period; p *= 2) {
+    period = checked_multiply(period, 2);
+  }
+  return checked_multiply(period, 2);
+}
+
+Matrix Matrix::identity(size_t size) {
+  Matrix m(size, size);
+  for (size_t i = 0; i < size; ++i) {
+    m.set(i, i, 1);
+  }
+  return m;
+}
+
+Matrix Matrix::pow(uint64_t k) const {
+  if (row_ != col_) {
+    std::stringstream msg;
+    msg << "Matrix::pow: Matrix should be square (" << row_ << "x" << col_ << " provided)";
+    throw std::length_error(msg.str());
+  }
+  size_t n = row_;
+  uint64_t start = 2 * n;
+  uint64_t period = power_period(n);
+  if (period && (k >= start) && (k - start >= period))
+    k = start + (k - start) % period;
+  if ((k == 0) || (n == 0))
+    return identity(n);
+
+  // Right-to-left binary powering: base runs through A^(2^i), result collects the set bits
+  Matrix result(n, n);
+  Matrix base(*this);
+  Matrix spare(n, n);
+  bool first = true;
+  while (true) {
+    if (k & 1) {
+      if (first) {
+        copy(result.view(), base.view());
+      } else {
+        spare.clear();
+        gemm(spare, result, base);
+        std::swap(result, spare);
+      }
+      first = false;
+    }
+    k >>= 1;
+    if (k == 0)
+      break;
+    spare.clear();
+    gemm(spare, base, base);
+    std::swap(base, spare);
+    if (base == spare) {
+      // Squares of an idempotent do not change, the remaining bits multiply by it once
+      if (first) {
+        copy(result.view(), base.view());
+      } else {
+        spare.clear();
+        gemm(spare, result, base);
+        std::swap(result, spare);
+      }
+      break;
+    }
+  }
+  return result;
+}
+
+/**
+ * Columns eliminated by one panel: rows are combined only inside of the panel,
+ * the rest of the columns is updated by gemm() once per panel (a multiple of 4)
+ */
+#ifndef ELIMINATION_BLOCK_SIZE
+#define ELIMINATION_BLOCK_SIZE 256
+#endif
+
+//! dst -= f * src on bytes [begin, end) of packed rows, f is a splatted factor
+static void subtract_multiple(int8_t* dst, const int8_t* src, size_t begin, size_t end, uint64_t f) {
+  size_t b = begin;
+  for (; b + 8 <= end; b += 8) {
+    store_word(dst + b, word_diff(load_word(dst + b), word_multiply(load_word(src + b), f)));
+  }
+  if (b < end) {
+    uint64_t w = word_multiply(load_partial_word(src + b, end - b), f);
+    store_partial_word(dst + b, word_diff(load_partial_word(dst + b, end - b), w), end - b);
+  }
+}
+
+//! row *= f on bytes [begin, end) of packed row, f is a splatted factor
+static void scale_row(int8_t* row, size_t begin, size_t end, uint64_t f) {
+  size_t b = begin;
+  for (; b + 8 <= end; b += 8) {
+    store_word(row + b, word_multiply(load_word(row + b), f));
+  }
+  if (b < end)
+    store_partial_word(row + b, word_multiply(load_partial_word(row + b, end - b), f), end - b);
+}
+
+static void swap_rows(MatrixView v, size_t i, size_t j) {
+  std::swap_ranges(v.row_data(i), v.row_data(i) + v.stride(), v.row_data(j));
+}
+
+static size_t round_up4(size_t n) {
+  return (n + 3) / 4 * 4;
+}
+
+/**
+ * Eliminates columns [0, col) of w in rows from first at one level of Z/4.
+ * Level 0 is elimination modulo 2 carried in Z/4: odd (unit) pivots, scaled to 1.
+ * Level 1 lifts it to the rows left by level 0, whose elements are even: pivots are equal to 2.
+ * Rows are swapped and combined as a whole, so columns from col (right-hand sides)
+ * get the same transformation. The pivot rows are placed from first in the order
+ * of their columns, which are returned; below them the eliminated columns are zero
+ * (level 0 leaves even elements there).
+ * The panel is eliminated by row operations restricted to its columns, the multipliers
+ * are collected into a matrix, so the rest of the rows below the pivots is updated by one gemm()
+ */
+static std::vector<size_t> eliminate(Matrix& w, size_t first, size_t col, int level) {
+  MatrixView v = w.view();
+  size_t m = w.row();
+  size_t total = w.col();
+  size_t total_bytes = (total + 3) / 4;
+  std::vector<size_t> pivots;
+  size_t r = first;
+  for (size_t j0 = 0; (j0 < col) && (r < m); j0 += ELIMINATION_BLOCK_SIZE) {
+    size_t j1 = std::min<size_t>(j0 + ELIMINATION_BLOCK_SIZE, round_up4(col));
+    // multipliers(t - r, i): multiple of i-th pivot row of the panel subtracted from row t
+    Matrix multipliers(m - r, j1 - j0);
+    std::vector<int8_t> scales;
+    size_t k = 0;
+    for (size_t j = j0; (j < std::min(j1, col)) && (r + k < m); ++j) {
+      size_t p = r + k;
+      size_t t = p;
+      while ((t < m) && !(level ? (v.get(t, j) == 2) : (v.get(t, j) & 1)))
+        ++t;
+      if (t == m)
+        continue;
+      if (t != p) {
+        swap_rows(v, t, p);
+        swap_rows(multipliers, t - r, p - r);
+      }
+      // Units of Z/4 are their own inverses
+      int8_t scale = level ? 1 : v.get(p, j);
+      if (scale != 1)
+        scale_row(v.row_data(p), j0 / 4, j1 / 4, word_splat(scale));
+      for (t = p + 1; t < m; ++t) {
+        int8_t f = level ? v.get(t, j) / 2 : v.get(t, j);
+        if (f) {
+          subtract_multiple(v.row_data(t), v.row_data(p), j0 / 4, j1 / 4, word_splat(f));
+          multipliers.set(t - r, k, f);
+        }
+      }
+      scales.push_back(scale);
+      pivots.push_back(j);
+      ++k;
+    }
+    if (k && (j1 < total)) {
+      // Pivot rows repeat the panel operations, the other rows subtract their multiples
+      for (size_t i = 0; i < k; ++i) {
+        for (size_t i2 = 0; i2 < i; ++i2) {
+          int8_t f = multipliers.get(i, i2);
+          if (f)
+            subtract_multiple(v.row_data(r + i), v.row_data(r + i2), j1 / 4, total_bytes, word_splat(f));
+        }
+        if (scales[i] != 1)
+          scale_row(v.row_data(r + i), j1 / 4, total_bytes, word_splat(scales[i]));
+      }
+      if (r + k < m) {
+        ConstMatrixView below = ConstMatrixView(multipliers).block(k, 0, m - r - k, k);
+        Matrix::gemm(v.block(r + k, j1, m - r - k, total - j1), below, v.block(r, j1, k, total - j1), -1);
+      }
+    }
+    r += k;
+  }
+  return pivots;
+}
+
+/**
+ * Solves u * y = c in place of c for unit upper triangular u.
+ * Diagonal blocks are solved by row operations, the rows above them are updated by gemm()
+ */
+static void solve_upper(ConstMatrixView u, MatrixView c) {
+  size_t n_bytes = (c.col() + 3) / 4;
+  for (size_t end = u.row(); end > 0; ) {
+    size_t begin = (end - 1) / ELIMINATION_BLOCK_SIZE * ELIMINATION_BLOCK_SIZE;
+    for (size_t i = end; i-- > begin; ) {
+      for (size_t j = i + 1; j < end; ++j) {
+        int8_t f = u.get(i, j);
+        if (f)
+          subtract_multiple(c.row_data(i), c.row_data(j), 0, n_bytes, word_splat(f));
+      }
+    }
+    if (begin)
+      Matrix::gemm(c.block(0, 0, begin, c.col()), u.block(0, begin, begin, end - begin),
+                   c.block(begin, 0, end - begin, c.col()), -1);
+    end = begin;
+  }
+}
+
+//! Columns of rows [first, first + rows) of m, elements are divided by divisor
+static Matrix gather_columns(const Matrix& m, size_t first, size_t rows, const std::vector<size_t>& columns,
+                             int8_t divisor) {
+  Matrix g(rows, columns.size());
+  for (size_t i = 0; i < rows; ++i) {
+    for (size_t j = 0; j < columns.size(); ++j) {
+      g.set(i, j, m.get(first + i, columns[j]) / divisor);
+    }
+  }
+  return g;
+}
+
+//! [a | 0 | b] with b starting at column round_up4(a.col())
+static Matrix augmented(const Matrix& a, const Matrix& b) {
+  size_t offset = round_up4(a.col());
+  Matrix w(a.row(), offset + b.col());
+  Matrix::copy(w.view().block(0, 0, a.row(), a.col()), a);
+  Matrix::copy(w.view().block(0, offset, b.row(), b.col()), b);
+  return w;
+}
+
+size_t Matrix::rank() const {
+  Matrix w(*this);
+  size_t units = eliminate(w, 0, col_, 0).size();
+  return units + eliminate(w, units, col_, 1).size();
+}
+
+Matrix Matrix::solve(const Matrix& b) const {
+  if (b.row_ != row_) {
+    std::stringstream msg;
+    msg << "Matrix::solve: Row number of the right-hand side should be equal to row number of the matrix ("
+        << b.row_ << " and " << row_ << " provided)";
+    throw std::length_error(msg.str());
+  }
+  Matrix w(augmented(*this, b));
+  std::vector<size_t> units = eliminate(w, 0, col_, 0);
+  std::vector<size_t> twos = eliminate(w, units.size(), col_, 1);
+  size_t r1 = units.size();
+  size_t r2 = twos.size();
+  ConstMatrixView rhs = w.view().block(0, round_up4(col_), row_, b.col_);
+  size_t n_bytes = (b.col_ + 3) / 4;
+  // Rows with pivot 2 need even right-hand sides, zero rows need zero ones
+  for (size_t i = r1; i < row_; ++i) {
+    int8_t mask = (i < r1 + r2) ? 0x55 : static_cast<int8_t>(0xFF);
+    for (size_t byte = 0; byte < n_bytes; ++byte) {
+      if (rhs.row_data(i)[byte] & mask) {
+        std::stringstream msg;
+        msg << "Matrix::solve: System has no solution";
+        throw std::runtime_error(msg.str());
+      }
+    }
+  }
+
+  /*
+   * Free variables are zero. Rows with pivot 2 are 2 * (u * y) = rhs with unit upper triangular u,
+   * so it is enough to solve u * y = rhs / 2; then the rows with unit pivots are solved
+   * after moving the found variables to the right-hand side
+   */
+  Matrix x(col_, b.col_);
+  MatrixView xv = x.view();
+  Matrix y2(r2, b.col_);
+  MatrixView y2v = y2.view();
+  for (size_t i = 0; i < r2; ++i) {
+    for (size_t byte = 0; byte < n_bytes; ++byte) {
+      y2v.row_data(i)[byte] = (rhs.row_data(r1 + i)[byte] >> 1) & 0x55;
+    }
+  }
+  Matrix u2(gather_columns(w, r1, r2, twos, 2));
+  solve_upper(u2, y2);
+  for (size_t i = 0; i < r2; ++i) {
+    memcpy(xv.row_data(twos[i]), y2v.row_data(i), n_bytes);
+  }
+  Matrix y1(rhs.block(0, 0, r1, b.col_));
+  MatrixView y1v = y1.view();
+  if (r1 && r2)
+    gemm(y1, gather_columns(w, 0, r1, twos, 1), y2, -1);
+  Matrix u1(gather_columns(w, 0, r1, units, 1));
+  solve_upper(u1, y1);
+  for (size_t i = 0; i < r1; ++i) {
+    memcpy(xv.row_data(units[i]), y1v.row_data(i), n_bytes);
+  }
+  return x;
+}
+
+Matrix Matrix::inverse() const {
+  if (row_ != col_) {
+    std::stringstream msg;
+    msg << "Matrix::inverse: Matrix should be square (" << row_ << "x" << col_ << " provided)";
+    throw std::length_error(msg.str());
+  }
+  Matrix w(augmented(*this, identity(row_)));
+  // Invertible over Z/4 if and only if modulo 2, so all pivots are units
+  if (eliminate(w, 0, col_, 0).size() < row_) {
+    std::stringstream msg;
+    msg << "Matrix::inverse: Matrix is singular";
+    throw std::runtime_error(msg.str());
+  }
+  MatrixView v = w.view();
+  Matrix x(v.block(0, round_up4(col_), row_, row_));
+  solve_upper(v.block(0, 0, row_, col_), x);
+  return x;
+}
@@ -0,0 +1,183 @@
+#include <stdexcept>
+#include <sstream>
+#include <fstream>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "matrix_file.h"
+#include "packed_kernels.h"
+
+//! Data offset of written files: header is padded up to MATRIX_FILE_ALIGNMENT bytes
+#ifndef MATRIX_FILE_ALIGNMENT
+#define MATRIX_FILE_ALIGNMENT 64
+#endif
+
+static const char matrix_file_magic[8] = {'Q', 'M', 'A', 'T', 'R', 'I', 'X', 0};
+
+/*
+ * FNV-1a over 64-bit words, the last partial word is zero padded.
+ * Word steps keep it close to the memory bandwidth for large files
+ */
+uint64_t matrix_file_checksum(const int8_t* data, size_t n_bytes, uint64_t hash) {
+  size_t full = n_bytes / 8 * 8;
+  for (size_t i = 0; i < full; i += 8) {
+    hash = (hash ^ load_word(data + i)) * 0x100000001B3ULL;
+  }
+  if (n_bytes > full)
+    hash = (hash ^ load_partial_word(data + full, n_bytes - full)) * 0x100000001B3ULL;
+  return hash;
+}
+
+static void throw_file_error(const char* func, const std::string& path, const std::string& what) {
+  std::stringstream msg;
+  msg << func << ": " << path << ": " << what;
+  throw std::runtime_error(msg.str());
+}
+
+/**
+ * Checks header of the file of file_size bytes and returns size of the data in bytes.
+ * Throws std::runtime_error with func name if the header is malformed
+ */
+static size_t check_header(const char* func, const std::string& path, const MatrixFileHeader& header,
+                           uint64_t file_size) {
+  if (memcmp(header.magic, matrix_file_magic, sizeof(matrix_file_magic)) != 0)
+    throw_file_error(func, path, "Not a matrix file");
+  if (header.byte_order != QMATRIX_FILE_BYTE_ORDER)
+    throw_file_error(func, path, "Byte order of the file differs from the host one");
+  if (header.version != QMATRIX_FILE_VERSION) {
+    std::stringstream msg;
+    msg << "Unsupported version " << header.version;
+    throw_file_error(func, path, msg.str());
+  }
+  // Stride is bounded first so that neither the row length nor the data size can wrap around
+  if ((header.alignment == 0) || (header.stride > UINT64_MAX / 4) || (header.stride % header.alignment) ||
+      (header.data_offset % header.alignment) || (header.data_offset < sizeof(MatrixFileHeader)) ||
+      (header.data_offset > file_size) || (header.col > 4 * header.stride)) {
+    throw_file_error(func, path, "Bad layout of rows");
+  }
+  if ((header.stride != 0) && (header.row > (file_size - header.data_offset) / header.stride))
+    throw_file_error(func, path, "File is truncated");
+  return header.row * header.stride;
+}
+
+MatrixFileHeader matrix_file_header(size_t row, size_t col, size_t stride) {
+  MatrixFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, matrix_file_magic, sizeof(matrix_file_magic));
+  header.version = QMATRIX_FILE_VERSION;
+  header.byte_order = QMATRIX_FILE_BYTE_ORDER;
+  header.row = row;
+  header.col = col;
+  header.stride = stride;
+  // The largest power of 2 dividing both the stride and the data offset
+  header.alignment = MATRIX_FILE_ALIGNMENT;
+  while (stride % header.alignment)
+    header.alignment /= 2;
+  header.data_offset = (sizeof(header) + MATRIX_FILE_ALIGNMENT - 1) / MATRIX_FILE_ALIGNMENT * MATRIX_FILE_ALIGNMENT;
+  return header;
+}
+
+MatrixFileHeader read_matrix_file_header(const char* func, const std::string& path, int fd) {
+  struct stat st;
+  MatrixFileHeader header;
+  if ((fstat(fd, &st) != 0) || (static_cast<uint64_t>(st.st_size) < sizeof(header)) ||
+      (pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)))) {
+    throw_file_error(func, path, "File is truncated");
+  }
+  check_header(func, path, header, st.st_size);
+  return header;
+}
+
+void Matrix::save(const std::string& path) const {
+  MatrixFileHeader header = matrix_file_header(row_, col_, stride_);
+  header.checksum = matrix_file_checksum(data_, storage_size());
+  std::vector<char> head(header.data_offset, 0);
+  memcpy(head.data(), &header, sizeof(header));
+  std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+  out.write(head.data(), head.size());
+  if (storage_size())
+    out.write(reinterpret_cast<const char*>(data_), storage_size());
+  out.close();
+  if (!out)
+    throw_file_error("Matrix::save", path, "Can not write the file");
+}
+
+Matrix Matrix::load(const std::string& path) {
+  std::ifstream in(path.c_str(), std::ios::binary | std::ios::ate);
+  if (!in)
+    throw_file_error("Matrix::load", path, "Can not open the file");
+  uint64_t file_size = in.tellg();
+  MatrixFileHeader header;
+  in.seekg(0);
+  if ((file_size < sizeof(header)) || !in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    throw_file_error("Matrix::load", path, "File is truncated");
+  size_t n_bytes = check_header("Matrix::load", path, header, file_size);
+  Matrix m(header.row, header.col);
+  in.seekg(header.data_offset);
+  // Rows are read in place if the layout is the same as in memory
+  std::vector<int8_t> buffer((m.stride_ == header.stride) ? 0 : n_bytes);
+  int8_t* data = (m.stride_ == header.stride) ? m.data_ : buffer.data();
+  if (n_bytes && !in.read(reinterpret_cast<char*>(data), n_bytes))
+    throw_file_error("Matrix::load", path, "File is truncated");
+  if (matrix_file_checksum(data, n_bytes) != header.checksum)
+    throw_file_error("Matrix::load", path, "Checksum mismatch");
+  size_t row_bytes = (m.col_ + 3) / 4;
+  int8_t tail_mask = (m.col_ % 4) ? (0xFF >> (8 - 2 * (m.col_ % 4))) : 0xFF;
+  // Rows of zero columns are not touched: their number is not bounded by the file size
+  for (size_t i = 0; row_bytes && (i < m.row_); ++i) {
+    int8_t* row = m.row_data(i);
+    if (data != m.data_)
+      memcpy(row, data + i * header.stride, row_bytes);
+    // Padding bits of the file are not trusted
+    row[row_bytes - 1] &= tail_mask;
+    memset(row + row_bytes, 0, m.stride_ - row_bytes);
+  }
+  return m;
+}
+
+MappedMatrix::MappedMatrix(const std::string& path, bool verify)
+                          :map_(nullptr), map_size_(0), view_(nullptr, 0, 0, 0) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw_file_error("MappedMatrix", path, "Can not open the file");
+  struct stat st;
+  if ((fstat(fd, &st) != 0) || (static_cast<uint64_t>(st.st_size) < sizeof(MatrixFileHeader))) {
+    close(fd);
+    throw_file_error("MappedMatrix", path, "File is truncated");
+  }
+  void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    throw_file_error("MappedMatrix", path, "Can not map the file");
+  map_ = map;
+  map_size_ = st.st_size;
+  try {
+    MatrixFileHeader header;
+    memcpy(&header, map_, sizeof(header));
+    size_t n_bytes = check_header("MappedMatrix", path, header, map_size_);
+    const int8_t* data = static_cast<const int8_t*>(map_) + header.data_offset;
+    if (verify && (matrix_file_checksum(data, n_bytes) != header.checksum))
+      throw_file_error("MappedMatrix", path, "Checksum mismatch");
+    view_ = ConstMatrixView(data, header.row, header.col, header.stride);
+  } catch (...) {
+    munmap(map_, map_size_);
+    throw;
+  }
+}
+
+MappedMatrix::MappedMatrix(MappedMatrix&& other) noexcept
+                          :map_(other.map_), map_size_(other.map_size_), view_(other.view_) {
+  other.map_ = nullptr;
+  other.map_size_ = 0;
+  other.view_ = ConstMatrixView(nullptr, 0, 0, 0);
+}
+
+MappedMatrix::~MappedMatrix() {
+  if (map_)
+    munmap(map_, map_size_);
+}
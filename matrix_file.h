@@ -0,0 +1,90 @@
+#ifndef MATRIX_FILE_H
+#define MATRIX_FILE_H
+
+#include <cstddef>
+#include <string>
+
+#include <stdint.h>
+
+#include "matrix_strassen.h"
+
+//! Format version written by Matrix::save()
+#define QMATRIX_FILE_VERSION 1
+
+//! Value of MatrixFileHeader::byte_order as seen by the host which wrote the file
+#define QMATRIX_FILE_BYTE_ORDER 0x01020304
+
+/**
+ * Binary matrix file: this header followed by row * stride bytes of packed rows
+ * at data_offset, exactly as they are placed in memory by Matrix (padding bits are zero).
+ * Fields are written in the byte order of the host, files of the other byte order are rejected
+ */
+struct MatrixFileHeader {
+  //! "QMATRIX" followed by zero byte
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t row;
+  uint64_t col;
+  //! Distance between rows in bytes, a multiple of alignment
+  uint64_t stride;
+  uint64_t alignment;
+  //! Offset of the first row from the start of the file, a multiple of alignment
+  uint64_t data_offset;
+  //! Checksum of row * stride data bytes
+  uint64_t checksum;
+};
+
+//! Initial value of the checksum
+#define QMATRIX_FILE_CHECKSUM_SEED 0xCBF29CE484222325ULL
+
+/**
+ * Checksum of n_bytes of data continuing hash of the preceding data,
+ * so that large files may be hashed by chunks (all chunks except the last one
+ * should have size multiple of 8)
+ */
+uint64_t matrix_file_checksum(const int8_t* data, size_t n_bytes, uint64_t hash = QMATRIX_FILE_CHECKSUM_SEED);
+
+//! Header of the file with [row x col] matrix with rows of stride bytes, checksum is zero
+MatrixFileHeader matrix_file_header(size_t row, size_t col, size_t stride);
+
+/**
+ * Reads header of the opened matrix file and checks it against the file size.
+ * Throws std::runtime_error with func name if the header is malformed
+ */
+MatrixFileHeader read_matrix_file_header(const char* func, const std::string& path, int fd);
+
+/**
+ * Read-only memory mapping of a file written by Matrix::save().
+ * Packed rows are used in place: nothing is parsed or copied, pages are read
+ * by the OS at the first access. view() can be passed to any function taking ConstMatrixView
+ * (e.g. Matrix::gemm() or Matrix(ConstMatrixView)) while the mapping is alive
+ */
+class MappedMatrix {
+public:
+  /**
+   * Maps the file. If verify is true, checksum of the data is checked, which reads the whole file.
+   * Throws std::runtime_error if the file can not be mapped or is malformed
+   */
+  explicit MappedMatrix(const std::string& path, bool verify = true);
+  //! Takes mapping of other, other becomes empty
+  MappedMatrix(MappedMatrix&& other) noexcept;
+  ~MappedMatrix();
+  MappedMatrix(const MappedMatrix&) = delete;
+  MappedMatrix& operator=(const MappedMatrix&) = delete;
+  inline ConstMatrixView view() const {
+    return view_;
+  }
+  inline size_t row() const {
+    return view_.row();
+  }
+  inline size_t col() const {
+    return view_.col();
+  }
+private:
+  void* map_;
+  size_t map_size_;
+  ConstMatrixView view_;
+};
+
+#endif // MATRIX_FILE_H
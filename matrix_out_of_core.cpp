@@ -0,0 +1,317 @@
+#include <stdexcept>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "matrix_file.h"
+#include "packed_gemm.h"
+
+//! Side of the tiles is a multiple of this size
+#ifndef OUT_OF_CORE_TILE_STEP
+#define OUT_OF_CORE_TILE_STEP 64
+#endif
+
+//! Tiles are chosen so that the memory budget holds at least this number of them
+#ifndef OUT_OF_CORE_MIN_TILES
+#define OUT_OF_CORE_MIN_TILES 16
+#endif
+
+/*
+ * Tiles of the budget which are not cached: the result tile, operand tiles of the current
+ * product (they stay alive when they are evicted), two tiles read ahead and the operands
+ * packed by packed_gemm, each of them takes no more than a tile
+ */
+#define OUT_OF_CORE_WORK_TILES 7
+
+//! Bytes of the packed_gemm accumulator of one block, the rest of its workspace is counted in tiles
+#define OUT_OF_CORE_ACC_BYTES (GEMM_MC * GEMM_NC)
+
+//! Size of the chunks used to compute checksum of the result file
+#define OUT_OF_CORE_CHECKSUM_CHUNK (1 << 24)
+
+static void throw_io_error(const std::string& path, const char* what) {
+  std::stringstream msg;
+  msg << "Matrix::multiply_out_of_core: " << path << ": " << what << " (" << strerror(errno) << ")";
+  throw std::runtime_error(msg.str());
+}
+
+//! Matrix file opened for the out-of-core multiplication, closed at destruction
+struct OutOfCoreFile {
+  OutOfCoreFile(const std::string& file_path, int flags) :path(file_path), fd(-1), header() {
+    fd = open(path.c_str(), flags, 0644);
+    if (fd < 0)
+      throw_io_error(path, "Can not open the file");
+  }
+  ~OutOfCoreFile() {
+    close(fd);
+  }
+  OutOfCoreFile(const OutOfCoreFile&) = delete;
+  OutOfCoreFile& operator=(const OutOfCoreFile&) = delete;
+  void read(void* data, size_t n_bytes, uint64_t offset) const {
+    int8_t* p = static_cast<int8_t*>(data);
+    while (n_bytes) {
+      ssize_t done = pread(fd, p, n_bytes, offset);
+      if ((done < 0) && (errno == EINTR))
+        continue;
+      if (done <= 0)
+        throw_io_error(path, "Can not read the file");
+      p += done;
+      n_bytes -= done;
+      offset += done;
+    }
+  }
+  void write(const void* data, size_t n_bytes, uint64_t offset) const {
+    const int8_t* p = static_cast<const int8_t*>(data);
+    while (n_bytes) {
+      ssize_t done = pwrite(fd, p, n_bytes, offset);
+      if ((done < 0) && (errno == EINTR))
+        continue;
+      if (done <= 0)
+        throw_io_error(path, "Can not write the file");
+      p += done;
+      n_bytes -= done;
+      offset += done;
+    }
+  }
+  //! Offset of the byte with element (i, j)
+  uint64_t offset(size_t i, size_t j) const {
+    return header.data_offset + i * header.stride + j / 4;
+  }
+  std::string path;
+  int fd;
+  MatrixFileHeader header;
+};
+
+//! Reads tile (bi, bj) of the file: [tile x tile] block or smaller one at the edges
+static std::shared_ptr<Matrix> read_tile(const OutOfCoreFile& file, size_t bi, size_t bj, size_t tile) {
+  size_t rows = std::min<size_t>(tile, file.header.row - bi * tile);
+  size_t cols = std::min<size_t>(tile, file.header.col - bj * tile);
+  std::shared_ptr<Matrix> m = std::make_shared<Matrix>(rows, cols);
+  MatrixView v = m->view();
+  size_t n_bytes = (cols + 3) / 4;
+  int8_t tail_mask = (cols % 4) ? (0xFF >> (8 - 2 * (cols % 4))) : 0xFF;
+  for (size_t i = 0; i < rows; ++i) {
+    file.read(v.row_data(i), n_bytes, file.offset(bi * tile + i, bj * tile));
+    // Padding bits of the file are not trusted
+    v.row_data(i)[n_bytes - 1] &= tail_mask;
+  }
+  return m;
+}
+
+static void write_tile(const OutOfCoreFile& file, size_t bi, size_t bj, size_t tile, const Matrix& m) {
+  ConstMatrixView v = m.view();
+  size_t n_bytes = (m.col() + 3) / 4;
+  for (size_t i = 0; i < m.row(); ++i) {
+    file.write(v.row_data(i), n_bytes, file.offset(bi * tile + i, bj * tile));
+  }
+}
+
+//! Operand (0 for lhs, 1 for rhs) and block coordinates of a tile
+typedef std::tuple<int, size_t, size_t> TileKey;
+
+/**
+ * Least recently used tiles up to capacity.
+ * Evicted tiles stay alive while they are used by the current tile product
+ */
+class TileCache {
+public:
+  explicit TileCache(size_t capacity) :capacity_(capacity), order_(), tiles_() {}
+  //! Tile or nullptr if it is not resident; found tile becomes the most recently used one
+  std::shared_ptr<Matrix> find(const TileKey& key) {
+    auto it = tiles_.find(key);
+    if (it == tiles_.end())
+      return nullptr;
+    order_.splice(order_.begin(), order_, it->second.second);
+    return it->second.first;
+  }
+  void insert(const TileKey& key, const std::shared_ptr<Matrix>& tile) {
+    if (find(key) || (capacity_ == 0))
+      return;
+    order_.push_front(key);
+    tiles_[key] = std::make_pair(tile, order_.begin());
+    if (tiles_.size() > capacity_) {
+      tiles_.erase(order_.back());
+      order_.pop_back();
+    }
+  }
+private:
+  size_t capacity_;
+  //! The most recently used tile first
+  std::list<TileKey> order_;
+  std::map<TileKey, std::pair<std::shared_ptr<Matrix>, std::list<TileKey>::iterator> > tiles_;
+};
+
+//! One tile product: c(i, j) += a(i, l) * b(l, j)
+struct TileStep {
+  size_t i;
+  size_t j;
+  size_t l;
+  bool first;
+  bool last;
+};
+
+/**
+ * s-th tile product in snake order: columns of the result go back and forth
+ * on consecutive rows of tiles and so do the products summed into one result tile,
+ * so every product shares an operand tile with the previous one
+ */
+static TileStep tile_step(size_t s, size_t n_tiles, size_t k_tiles) {
+  size_t count = s / k_tiles;
+  size_t ll = s % k_tiles;
+  size_t i = count / n_tiles;
+  size_t jj = count % n_tiles;
+  TileStep step = {i, (i % 2) ? n_tiles - 1 - jj : jj, (count % 2) ? k_tiles - 1 - ll : ll, ll == 0, ll == k_tiles - 1};
+  return step;
+}
+
+//! Throws std::invalid_argument if the output file exists and is one of the operand files
+static void check_output_file(const std::string& out_path, const OutOfCoreFile& a, const OutOfCoreFile& b) {
+  struct stat out_stat;
+  if (stat(out_path.c_str(), &out_stat) != 0)
+    return;
+  const OutOfCoreFile* operands[] = {&a, &b};
+  for (const OutOfCoreFile* file : operands) {
+    struct stat operand_stat;
+    if (fstat(file->fd, &operand_stat) != 0)
+      throw_io_error(file->path, "Can not read the file");
+    if ((operand_stat.st_dev == out_stat.st_dev) && (operand_stat.st_ino == out_stat.st_ino)) {
+      std::stringstream msg;
+      msg << "Matrix::multiply_out_of_core: Output file " << out_path
+          << " should differ from the operand file " << file->path;
+      throw std::invalid_argument(msg.str());
+    }
+  }
+}
+
+//! Bytes of [tile x tile] block, the tile side is a multiple of 64 so rows are not padded
+inline size_t tile_bytes(size_t tile) {
+  return tile * tile / 4;
+}
+
+//! Checksum of the data of the file read by chunks of chunk_size bytes (a multiple of 8)
+static uint64_t file_checksum(const OutOfCoreFile& file, size_t chunk_size) {
+  uint64_t data_size = file.header.row * file.header.stride;
+  uint64_t checksum = QMATRIX_FILE_CHECKSUM_SEED;
+  std::vector<int8_t> chunk(std::min<uint64_t>(chunk_size, data_size));
+  for (uint64_t offset = 0; offset < data_size; offset += chunk.size()) {
+    size_t n_bytes = std::min<uint64_t>(chunk.size(), data_size - offset);
+    file.read(chunk.data(), n_bytes, file.header.data_offset + offset);
+    checksum = matrix_file_checksum(chunk.data(), n_bytes, checksum);
+  }
+  return checksum;
+}
+
+void Matrix::multiply_out_of_core(const std::string& lhs_path, const std::string& rhs_path,
+                                  const std::string& out_path, size_t memory_budget, bool verify) {
+  OutOfCoreFile a(lhs_path, O_RDONLY);
+  OutOfCoreFile b(rhs_path, O_RDONLY);
+  a.header = read_matrix_file_header("Matrix::multiply_out_of_core", a.path, a.fd);
+  b.header = read_matrix_file_header("Matrix::multiply_out_of_core", b.path, b.fd);
+  if (a.header.col != b.header.row) {
+    std::stringstream msg;
+    msg << "Matrix::multiply_out_of_core: Column number of first matrix should be equal to row number of the second matrix ("
+        << a.header.col << " and " << b.header.row << " provided)";
+    throw std::length_error(msg.str());
+  }
+  size_t min_budget = OUT_OF_CORE_ACC_BYTES + OUT_OF_CORE_MIN_TILES * tile_bytes(OUT_OF_CORE_TILE_STEP);
+  if (memory_budget < min_budget) {
+    std::stringstream msg;
+    msg << "Matrix::multiply_out_of_core: Memory budget should be at least " << min_budget
+        << " bytes (" << memory_budget << " provided)";
+    throw std::invalid_argument(msg.str());
+  }
+  // Checksums are computed by chunks of half of the budget, nothing else is resident then
+  size_t chunk_size = std::min<size_t>(OUT_OF_CORE_CHECKSUM_CHUNK, memory_budget / 2 / 8 * 8);
+  const OutOfCoreFile* operands[] = {&a, &b};
+  for (size_t i = 0; verify && (i < 2); ++i) {
+    if (file_checksum(*operands[i], chunk_size) != operands[i]->header.checksum) {
+      std::stringstream msg;
+      msg << "Matrix::multiply_out_of_core: " << operands[i]->path << ": Checksum mismatch";
+      throw std::runtime_error(msg.str());
+    }
+  }
+  size_t m = a.header.row;
+  size_t k = a.header.col;
+  size_t n = b.header.col;
+  // The largest tiles which fit into the budget, but not larger than the matrices
+  size_t max_dim = std::max(std::max(m, k), n);
+  size_t tile = OUT_OF_CORE_TILE_STEP;
+  size_t tiles_budget = memory_budget - OUT_OF_CORE_ACC_BYTES;
+  while ((tile < max_dim) && (OUT_OF_CORE_MIN_TILES * tile_bytes(tile + OUT_OF_CORE_TILE_STEP) <= tiles_budget))
+    tile += OUT_OF_CORE_TILE_STEP;
+
+  check_output_file(out_path, a, b);
+  // Rows of the result are laid out as in memory, the file is filled with zeroes up front
+  OutOfCoreFile c(out_path, O_RDWR | O_CREAT | O_TRUNC);
+  c.header = matrix_file_header(m, n, row_stride(n));
+  uint64_t data_size = c.header.row * c.header.stride;
+  if (ftruncate(c.fd, c.header.data_offset + data_size) != 0)
+    throw_io_error(c.path, "Can not write the file");
+
+  size_t n_tiles = (n + tile - 1) / tile;
+  size_t k_tiles = (k + tile - 1) / tile;
+  size_t n_steps = ((m + tile - 1) / tile) * n_tiles * k_tiles;
+  {
+    /*
+     * Tiles are multiplied by packed_gemm with one workspace, so the working memory is known
+     * in advance, unlike the one of Strassen recursion with its temporaries on every level
+     */
+    TileCache cache(tiles_budget / tile_bytes(tile) - OUT_OF_CORE_WORK_TILES);
+    PackedGemmWorkspace workspace;
+    // Operand tiles of the step which are not resident are read in the background
+    typedef std::pair<std::shared_ptr<Matrix>, std::shared_ptr<Matrix> > TilePair;
+    auto read_ahead = [&](const TileStep& step) {
+      std::shared_ptr<Matrix> a_tile = cache.find(TileKey(0, step.i, step.l));
+      std::shared_ptr<Matrix> b_tile = cache.find(TileKey(1, step.l, step.j));
+      const OutOfCoreFile* a_file = &a;
+      const OutOfCoreFile* b_file = &b;
+      std::launch policy = (a_tile && b_tile) ? std::launch::deferred : std::launch::async;
+      return std::async(policy, [a_file, b_file, step, tile, a_tile, b_tile]() {
+        return TilePair(a_tile ? a_tile : read_tile(*a_file, step.i, step.l, tile),
+                        b_tile ? b_tile : read_tile(*b_file, step.l, step.j, tile));
+      });
+    };
+    std::future<TilePair> next;
+    if (n_steps)
+      next = read_ahead(tile_step(0, n_tiles, k_tiles));
+    Matrix c_tile(0, 0);
+    for (size_t s = 0; s < n_steps; ++s) {
+      TileStep step = tile_step(s, n_tiles, k_tiles);
+      TilePair tiles = next.get();
+      cache.insert(TileKey(0, step.i, step.l), tiles.first);
+      cache.insert(TileKey(1, step.l, step.j), tiles.second);
+      if (s + 1 < n_steps)
+        next = read_ahead(tile_step(s + 1, n_tiles, k_tiles));
+      if (step.first) {
+        size_t rows = std::min(tile, m - step.i * tile);
+        size_t cols = std::min(tile, n - step.j * tile);
+        if ((c_tile.row() != rows) || (c_tile.col() != cols))
+          c_tile = Matrix(rows, cols);
+        else
+          c_tile.clear();
+      }
+      const Matrix& a_tile = *tiles.first;
+      const Matrix& b_tile = *tiles.second;
+      packed_gemm(c_tile.row_data(0), c_tile.stride_, a_tile.row_data(0), a_tile.stride_, false,
+                  b_tile.row_data(0), b_tile.stride_, false, a_tile.row(), a_tile.col(), b_tile.col(),
+                  PackedStore::Add, workspace);
+      if (step.last)
+        write_tile(c, step.i, step.j, tile, c_tile);
+    }
+  }
+
+  // Checksum is computed over the written rows
+  c.header.checksum = file_checksum(c, chunk_size);
+  c.write(&c.header, sizeof(c.header), 0);
+}
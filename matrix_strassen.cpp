@@ -1,17 +1,114 @@
 #include <stdexcept>
 #include <sstream>
 #include <cstring>
+#include <cstdlib>
+#include <new>
 #include <iostream>
 #include <algorithm>
-#include <future>
 #include <functional>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "matrix_strassen.h"
+#include "packed_gemm.h"
+#include "packed_gemv.h"
+#include "packed_kernels.h"
+#include "packed_m4rm.h"
+#include "sparse_matrix.h"
+#include "strassen_profile.h"
+#include "thread_pool.h"
 
 #ifndef STRASSEN_MATRIX_SIZE
 #define STRASSEN_MATRIX_SIZE 64
 #endif
 
+#ifndef MATRIX_DATA_ALIGNMENT
+#define MATRIX_DATA_ALIGNMENT 64
+#endif
+
+#ifndef MATRIX_ROW_ALIGNMENT
+#define MATRIX_ROW_ALIGNMENT 8
+#endif
+
+#ifdef TRIVIAL_ALGORITHM
+static std::atomic<Matrix::Algorithm> current_algorithm(Matrix::Algorithm::Trivial);
+#else
+static std::atomic<Matrix::Algorithm> current_algorithm(Matrix::Algorithm::Strassen);
+#endif
+
+static std::atomic<Matrix::Algorithm> current_base_algorithm(Matrix::Algorithm::Trivial);
+
+#ifndef PARALLEL_MAX_DEPTH
+#define PARALLEL_MAX_DEPTH 3
+#endif
+
+#ifndef PARALLEL_MIN_SIZE
+#define PARALLEL_MIN_SIZE 256
+#endif
+
+//! Rows and columns of the tiles of blocks visited together by Matrix::transposed()
+#ifndef MATRIX_TRANSPOSE_TILE
+#define MATRIX_TRANSPOSE_TILE 256
+#endif
+
+//! See Matrix::sparse_density()
+#ifndef SPARSE_DENSITY
+#define SPARSE_DENSITY 0.05
+#endif
+
+static std::atomic<size_t> parallel_max_depth_value(PARALLEL_MAX_DEPTH);
+static std::atomic<size_t> parallel_min_size_value(PARALLEL_MIN_SIZE);
+static std::atomic<size_t> strassen_crossover_value(STRASSEN_MATRIX_SIZE);
+static std::atomic<double> sparse_density_value(SPARSE_DENSITY);
+
+#ifndef QMATRIX_TUNING_FILE
+#define QMATRIX_TUNING_FILE "qmatrix.tuning"
+#endif
+
+/*
+ * Tuning file named by QMATRIX_TUNING_FILE environment variable is loaded once,
+ * before the first multiplication or access to the tuned values.
+ * Values set explicitly afterwards are kept
+ */
+static std::once_flag tuning_once;
+
+/*
+ * Workers of Strassen algorithm: thread_count - 1 threads, the calling thread
+ * takes part in the work while it waits for the sub-products.
+ * The pool is created at the first parallel multiplication
+ */
+static std::mutex pool_mutex;
+static std::shared_ptr<ThreadPool> strassen_pool;
+static size_t strassen_threads = 0;
+
+static size_t default_thread_count() {
+  const char* env = getenv("QMATRIX_THREADS");
+  if (env) {
+    long count = atol(env);
+    if (count > 0)
+      return count;
+  }
+#ifdef PARALLEL_STRASSEN
+  size_t count = std::thread::hardware_concurrency();
+  return count ? count : 1;
+#else
+  return 1;
+#endif
+}
+
+//! Pool for the next multiplication or nullptr if it should be sequential
+static std::shared_ptr<ThreadPool> acquire_pool() {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  if (strassen_threads == 0)
+    strassen_threads = default_thread_count();
+  if ((strassen_threads > 1) && !strassen_pool)
+    strassen_pool = std::make_shared<ThreadPool>(strassen_threads - 1);
+  return strassen_pool;
+}
+
 inline size_t packed_bytes_size(size_t col) {
   size_t n_bytes = col / 4;
   if (col % 4)
@@ -19,6 +116,11 @@ inline size_t packed_bytes_size(size_t col) {
   return n_bytes;
 }
 
+size_t Matrix::row_stride(size_t col) {
+  size_t n_bytes = packed_bytes_size(col);
+  return (n_bytes + MATRIX_ROW_ALIGNMENT - 1) / MATRIX_ROW_ALIGNMENT * MATRIX_ROW_ALIGNMENT;
+}
+
 #ifndef TEST_MODE
 inline int8_t packed_sum(int8_t a, int8_t b)
 #else
@@ -58,8 +160,38 @@ int8_t Matrix::packed_multiply(int8_t a, int8_t b)
   return v3 | v2 | v1 | v0;
 }
 
-Matrix::Matrix(std::initializer_list<std::initializer_list<int8_t> > data)
-       :row_(data.size()), col_(0), data_(nullptr) {
+/*
+ * Word versions of packed_sum/packed_diff/packed_multiply
+ */
+#ifndef TEST_MODE
+inline uint64_t packed_sum_word(uint64_t a, uint64_t b)
+#else
+uint64_t Matrix::packed_sum_word(uint64_t a, uint64_t b)
+#endif
+{
+  return word_sum(a, b);
+}
+
+#ifndef TEST_MODE
+inline uint64_t packed_diff_word(uint64_t a, uint64_t b)
+#else
+uint64_t Matrix::packed_diff_word(uint64_t a, uint64_t b)
+#endif
+{
+  return word_diff(a, b);
+}
+
+#ifndef TEST_MODE
+inline uint64_t packed_multiply_word(uint64_t a, uint64_t b)
+#else
+uint64_t Matrix::packed_multiply_word(uint64_t a, uint64_t b)
+#endif
+{
+  return word_multiply(a, b);
+}
+
+Matrix::BasicMatrix(std::initializer_list<std::initializer_list<int> > data)
+       :row_(data.size()), col_(0), stride_(0), data_(nullptr) {
   if (row_ > 0) {
     col_ = (*data.begin()).size();
     size_t row_ctr = 0;
@@ -71,11 +203,8 @@ Matrix::Matrix(std::initializer_list<std::initializer_list<int8_t> > data)
         throw std::length_error(msg.str());
       }
     }
-    data_ = new int8_t*[row_];
+    allocate(true);
     for (auto it = data.begin(); it != data.end(); ++it) {
-      size_t packed_size = packed_bytes_size((*it).size());
-      data_[row_ctr] = new int8_t[packed_size];
-      memset(data_[row_ctr], 0, packed_size);
       size_t col_ctr = 0;
       for (auto it1 = (*it).begin(); it1 != (*it).end(); ++it1) {
         set(row_ctr, col_ctr, *it1);
@@ -86,65 +215,82 @@ Matrix::Matrix(std::initializer_list<std::initializer_list<int8_t> > data)
   }
 }
 
-Matrix::Matrix(size_t row, size_t col)
-                     :row_(row), col_(col), data_(nullptr) {
-  data_ = new int8_t*[row_];
-  for (size_t i = 0; i < row_; ++i) {
-    size_t packed_size = packed_bytes_size(col_);
-    data_[i] = new int8_t[packed_size];
-    memset(data_[i], 0, packed_size);
-  }
-  clear();
+Matrix::BasicMatrix(size_t row, size_t col)
+                     :row_(row), col_(col), stride_(0), data_(nullptr) {
+  allocate(true);
 }
 
-Matrix::Matrix(const Matrix& other)
-                     :row_(other.row_), col_(other.col_), data_(nullptr) {
-  data_ = new int8_t*[row_];
-  for (size_t i = 0; i < row_; ++i) {
-    size_t packed_size = packed_bytes_size(col_);
-    data_[i] = new int8_t[packed_size];
-    memset(data_[i], 0, packed_size);
-  }
-  clear();
-  for (size_t i = 0; i < row_; ++i) {
-    memcpy(data_[i], other.data_[i], packed_bytes_size(col_));
-  }
+Matrix::BasicMatrix(const Matrix& other)
+                     :row_(other.row_), col_(other.col_), stride_(0), data_(nullptr) {
+  allocate(false);
+  if (storage_size())
+    memcpy(data_, other.data_, storage_size());
+}
+
+Matrix::BasicMatrix(Matrix&& other) noexcept
+              :row_(other.row_), col_(other.col_), stride_(other.stride_), data_(other.data_) {
+  other.row_ = 0;
+  other.col_ = 0;
+  other.stride_ = 0;
+  other.data_ = nullptr;
 }
 
 Matrix::~Matrix() {
-  for (size_t i = 0; i < row_; ++i) {
-    if (data_[i])
-      delete[] data_[i];
-  }
-  if (data_)
-    delete[] data_;
+  free(data_);
 }
 
+void Matrix::allocate(bool zeroize) {
+  stride_ = row_stride(col_);
+  data_ = nullptr;
+  size_t sz = storage_size();
+  if (sz == 0)
+    return;
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, MATRIX_DATA_ALIGNMENT, sz) != 0)
+    throw std::bad_alloc();
+  data_ = static_cast<int8_t*>(ptr);
+  if (zeroize)
+    memset(data_, 0, sz);
+}
 
 Matrix& Matrix::operator=(const Matrix& rhs) {
   if (this == &rhs)
     return *this;
-  clear();
-  row_ = rhs.row_;
-  col_ = rhs.col_;
-  for (size_t i = 0; i < row_; ++i) {
-    memcpy(data_[i], rhs.data_[i], packed_bytes_size(col_));
+  if ((row_ != rhs.row_) || (col_ != rhs.col_)) {
+    free(data_);
+    row_ = rhs.row_;
+    col_ = rhs.col_;
+    allocate(false);
   }
+  if (storage_size())
+    memcpy(data_, rhs.data_, storage_size());
   return *this;
 }
 
-bool Matrix::operator==(const Matrix& rhs) const {
+Matrix& Matrix::operator=(Matrix&& rhs) noexcept {
   if (this == &rhs)
+    return *this;
+  free(data_);
+  row_ = rhs.row_;
+  col_ = rhs.col_;
+  stride_ = rhs.stride_;
+  data_ = rhs.data_;
+  rhs.row_ = 0;
+  rhs.col_ = 0;
+  rhs.stride_ = 0;
+  rhs.data_ = nullptr;
+  return *this;
+}
+
+bool operator==(const Matrix& lhs, const Matrix& rhs) {
+  if (&lhs == &rhs)
     return true;
-  if ((row_ != rhs.row_) || (col_ != rhs.col_))
+  if ((lhs.row_ != rhs.row_) || (lhs.col_ != rhs.col_))
     return false;
-  for (size_t i = 0; i < row_; ++i) {
-    size_t packed_size = packed_bytes_size(col_);
-    if (memcmp(data_[i], rhs.data_[i], packed_size) != 0) {
-      return false;
-    }
-  }
-  return true;
+  // Padding bits are always zero, so the whole buffers can be compared at once
+  if (lhs.storage_size() == 0)
+    return true;
+  return memcmp(lhs.data_, rhs.data_, lhs.storage_size()) == 0;
 }
 
 Matrix Matrix::operator*(const Matrix& rhs) const {
@@ -154,92 +300,307 @@ Matrix Matrix::operator*(const Matrix& rhs) const {
         << col_ << " and " << rhs.row_ << " provided)";
     throw std::length_error(msg.str());
   }
+  // Products with a vector are memory bound, they do not need any of the algorithms below
+  if ((row_ == 1) || (rhs.col_ == 1))
+    return multiply_vector(*this, rhs);
+  // Sparse lhs costs its nonzeros times a row of rhs
+  double density = sparse_density_value.load(std::memory_order_relaxed);
+  if (density > 0) {
+    size_t limit = static_cast<size_t>(density * row_ * col_);
+    if (SparseMatrix::count_nonzeros(*this, limit) <= limit)
+      return SparseMatrix(*this) * rhs;
+  }
   size_t max_size = std::max(std::max(col_, row_), std::max(rhs.col_, rhs.row_));
-#ifdef TRIVIAL_ALGORITHM
-  return multiply_trivial(*this, rhs);
-#else
+  Algorithm alg = algorithm();
   /*
    * Strassen algorithm is effective for matrices of size
-   * more than 64x64. For small matrices we use the trivial algorithm.
-   * Note: If STRASSEN_MATRIX_SIZE is too low and matrices is big (256*256 and more)
-   * multiply_strassen may throw std::system_error
+   * more than crossover (64x64 by default). For small matrices we use the base case algorithm.
    */
-  if (max_size <= STRASSEN_MATRIX_SIZE) {
+  if (((alg == Algorithm::Strassen) || (alg == Algorithm::Winograd)) && (max_size <= strassen_crossover()))
+    alg = base_algorithm();
+  switch (alg) {
+  case Algorithm::Trivial:
     return multiply_trivial(*this, rhs);
-  } else {
+  case Algorithm::M4RM:
+    return multiply_m4rm(*this, rhs);
+  case Algorithm::Winograd:
+    return multiply_winograd(*this, rhs);
+  default:
     return multiply_strassen(*this, rhs);
   }
-#endif
 }
 
-Matrix Matrix::operator+(const Matrix& rhs) const {
-  if ((row_ != rhs.row_) || (col_ != rhs.col_)) {
+Matrix::Algorithm Matrix::algorithm() {
+  return current_algorithm.load(std::memory_order_relaxed);
+}
+
+void Matrix::set_algorithm(Algorithm algorithm) {
+  current_algorithm.store(algorithm, std::memory_order_relaxed);
+}
+
+size_t Matrix::thread_count() {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  if (strassen_threads == 0)
+    strassen_threads = default_thread_count();
+  return strassen_threads;
+}
+
+void Matrix::set_thread_count(size_t count) {
+  if (count == 0) {
     std::stringstream msg;
-    msg << "Matrix::operator+: Sizes of matricies should be equal("
-        << row_ << "x" << col_ << " and " << rhs.row_ << "x" << rhs.col_ << " provided)";
-    throw std::length_error(msg.str());
+    msg << "Matrix::set_thread_count: Thread count should be positive";
+    throw std::invalid_argument(msg.str());
   }
-  Matrix m(row_, col_);
-  for (size_t i = 0; i < row_; ++i) {
-    size_t n_bytes = packed_bytes_size(col_);
-    for (size_t j = 0; j < n_bytes; ++j) {
-      m.data_[i][j] = packed_sum(data_[i][j], rhs.data_[i][j]);
-    }
+  std::shared_ptr<ThreadPool> old_pool;
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (count == strassen_threads)
+      return;
+    strassen_threads = count;
+    old_pool.swap(strassen_pool);
   }
-  return m;
+  // Workers of the old pool are joined here, or by the last running multiplication
+}
+
+size_t Matrix::parallel_max_depth() {
+  load_default_tuning();
+  return parallel_max_depth_value.load(std::memory_order_relaxed);
+}
+
+size_t Matrix::parallel_min_size() {
+  load_default_tuning();
+  return parallel_min_size_value.load(std::memory_order_relaxed);
+}
+
+void Matrix::set_parallel_limits(size_t max_depth, size_t min_size) {
+  load_default_tuning();
+  parallel_max_depth_value.store(max_depth, std::memory_order_relaxed);
+  parallel_min_size_value.store(min_size, std::memory_order_relaxed);
+}
+
+size_t Matrix::strassen_crossover() {
+  load_default_tuning();
+  return strassen_crossover_value.load(std::memory_order_relaxed);
 }
 
-Matrix Matrix::operator-(const Matrix& rhs) const {
-  if ((this->row() != rhs.row_) || (this->col() != rhs.col_)) {
+void Matrix::set_strassen_crossover(size_t size) {
+  check_crossover("Matrix::set_strassen_crossover", size);
+  load_default_tuning();
+  strassen_crossover_value.store(size, std::memory_order_relaxed);
+}
+
+double Matrix::sparse_density() {
+  return sparse_density_value.load(std::memory_order_relaxed);
+}
+
+void Matrix::set_sparse_density(double density) {
+  if (!(density >= 0) || (density > 1)) {
     std::stringstream msg;
-    msg << "Matrix::operator-: Sizes of matricies should be equal("
-        << this->col() << "x" << this->row() << " and " << rhs.col_ << "x" << rhs.row_ << " provided)";
-    throw std::length_error(msg.str());
+    msg << "Matrix::set_sparse_density: Density should be in [0, 1] (" << density << " provided)";
+    throw std::invalid_argument(msg.str());
   }
-  Matrix m(this->row(), this->col());
-  for (size_t i = 0; i < row_; ++i) {
-    size_t n_bytes = packed_bytes_size(col_);
-    for (size_t j = 0; j < n_bytes; ++j) {
-      m.data_[i][j] = packed_diff(data_[i][j], rhs.data_[i][j]);
-    }
+  sparse_density_value.store(density, std::memory_order_relaxed);
+}
+
+void Matrix::check_crossover(const char* func, size_t size) {
+  // Strassen step needs column halves of at least 4 elements
+  if (size < 8) {
+    std::stringstream msg;
+    msg << func << ": Crossover size should be at least 8 (" << size << " provided)";
+    throw std::invalid_argument(msg.str());
   }
-  return m;
+}
+
+Matrix::Tuning Matrix::tuning() {
+  Tuning t;
+  t.crossover = strassen_crossover();
+  t.base_algorithm = base_algorithm();
+  t.parallel_max_depth = parallel_max_depth();
+  t.parallel_min_size = parallel_min_size();
+  return t;
+}
+
+void Matrix::set_tuning(const Tuning& tuning) {
+  check_crossover("Matrix::set_tuning", tuning.crossover);
+  check_base_algorithm("Matrix::set_tuning", tuning.base_algorithm);
+  load_default_tuning();
+  store_tuning(tuning);
+}
+
+void Matrix::store_tuning(const Tuning& tuning) {
+  strassen_crossover_value.store(tuning.crossover, std::memory_order_relaxed);
+  current_base_algorithm.store(tuning.base_algorithm, std::memory_order_relaxed);
+  parallel_max_depth_value.store(tuning.parallel_max_depth, std::memory_order_relaxed);
+  parallel_min_size_value.store(tuning.parallel_min_size, std::memory_order_relaxed);
+}
+
+bool Matrix::load_tuning(const std::string& path) {
+  load_default_tuning();
+  Tuning tuning;
+  if (!read_tuning(path, tuning))
+    return false;
+  store_tuning(tuning);
+  return true;
+}
+
+void Matrix::load_default_tuning() {
+  // If the file is malformed, the exception leaves the flag unset and the next call reads it again
+  std::call_once(tuning_once, [] {
+    const char* path = getenv("QMATRIX_TUNING_FILE");
+    Tuning tuning;
+    if (path && read_tuning(path, tuning))
+      store_tuning(tuning);
+  });
+}
+
+const char* Matrix::default_tuning_path() {
+  const char* env = getenv("QMATRIX_TUNING_FILE");
+  return env ? env : QMATRIX_TUNING_FILE;
+}
+
+Matrix::Algorithm Matrix::base_algorithm() {
+  load_default_tuning();
+  return current_base_algorithm.load(std::memory_order_relaxed);
+}
+
+void Matrix::set_base_algorithm(Algorithm algorithm) {
+  check_base_algorithm("Matrix::set_base_algorithm", algorithm);
+  load_default_tuning();
+  current_base_algorithm.store(algorithm, std::memory_order_relaxed);
+}
+
+void Matrix::check_base_algorithm(const char* func, Algorithm algorithm) {
+  if ((algorithm == Algorithm::Strassen) || (algorithm == Algorithm::Winograd)) {
+    std::stringstream msg;
+    msg << func << ": Recursive algorithms can not be used as the base case";
+    throw std::invalid_argument(msg.str());
+  }
+}
+
+void Matrix::check_sizes(const char* func, size_t row, size_t col, size_t other_row, size_t other_col) {
+  if ((row != other_row) || (col != other_col)) {
+    std::stringstream msg;
+    msg << func << ": Sizes of matricies should be equal("
+        << row << "x" << col << " and " << other_row << "x" << other_col << " provided)";
+    throw std::length_error(msg.str());
+  }
+}
+
+void Matrix::sum_bytes(int8_t* dst, const int8_t* a, const int8_t* b, size_t n_bytes) {
+  packed_kernels().sum(dst, a, b, n_bytes);
+}
+
+void Matrix::diff_bytes(int8_t* dst, const int8_t* a, const int8_t* b, size_t n_bytes) {
+  packed_kernels().diff(dst, a, b, n_bytes);
 }
 
 void Matrix::resize(size_t row, size_t col) {
   size_t old_col = col_;
   size_t old_row = row_;
+  size_t old_stride = stride_;
+  int8_t* old_data = data_;
   col_ = col;
   row_ = row;
-  int8_t** new_data = new int8_t*[row_];
-  for (size_t i = 0; i < col_; ++i) {
-    new_data[i] = new int8_t[packed_bytes_size(col_)];
-    memset(new_data[i], 0, packed_bytes_size(col_));
-    if (i < old_row) {
-      size_t sz = std::min(old_col, col_);
-      size_t packed_sz = packed_bytes_size(sz);
-      memcpy(new_data[i], data_[i], packed_sz);
-      // If column size is not multiple of 4, we need to zeroize
-      // 2, 4 or 6 most significant bits in the last byte of current row
-      // Number of bits to be zeroized depends on column size modulo 4
-      int8_t shift = sz % 4;
-      int8_t mask = 0xFF >> shift*2;
-      new_data[i][packed_sz - 1] &= mask;
+  allocate(true);
+  size_t sz = std::min(old_col, col_);
+  size_t packed_sz = packed_bytes_size(sz);
+  size_t copy_rows = std::min(old_row, row_);
+  if (packed_sz > 0) {
+    // If column size is not multiple of 4, we need to zeroize
+    // 2, 4 or 6 most significant bits in the last byte of current row
+    // Number of bits to be zeroized depends on column size modulo 4
+    int8_t shift = sz % 4;
+    int8_t mask = shift ? (0xFF >> (8 - shift*2)) : 0xFF;
+    for (size_t i = 0; i < copy_rows; ++i) {
+      int8_t* dst = row_data(i);
+      memcpy(dst, old_data + i * old_stride, packed_sz);
+      dst[packed_sz - 1] &= mask;
     }
   }
-  for (size_t i = 0; i < old_row; ++i) {
-    delete[] data_[i];
-  }
-  delete[] data_;
-  data_ = new_data;
+  free(old_data);
 }
 
 void Matrix::clear() {
+  if (storage_size())
+    memset(data_, 0, storage_size());
+}
+
+void Matrix::check_row_index(const char* func, size_t i) const {
+  if (i >= row_) {
+    std::stringstream msg;
+    msg << func << ": Row index " << i << " is out of range for " << row_ << "x" << col_ << " matrix";
+    throw std::out_of_range(msg.str());
+  }
+}
+
+void Matrix::check_leading_dimension(const char* func, size_t ld) const {
+  if (ld < col_) {
+    std::stringstream msg;
+    msg << func << ": Distance between rows should not be less than column number ("
+        << ld << " and " << col_ << " provided)";
+    throw std::invalid_argument(msg.str());
+  }
+}
+
+void Matrix::set_elements(const uint8_t* src, size_t ld) {
+  ld = ld ? ld : col_;
+  check_leading_dimension("Matrix::set_elements", ld);
+  const PackedKernels& kernels = packed_kernels();
   for (size_t i = 0; i < row_; ++i) {
-    memset(data_[i], 0, packed_bytes_size(col_));
+    kernels.pack(row_data(i), src + i * ld, col_);
   }
 }
 
+void Matrix::set_elements(const int8_t* src, size_t ld) {
+  set_elements(reinterpret_cast<const uint8_t*>(src), ld);
+}
+
+void Matrix::get_elements(uint8_t* dst, size_t ld) const {
+  ld = ld ? ld : col_;
+  check_leading_dimension("Matrix::get_elements", ld);
+  const PackedKernels& kernels = packed_kernels();
+  for (size_t i = 0; i < row_; ++i) {
+    kernels.unpack(dst + i * ld, row_data(i), col_);
+  }
+}
+
+void Matrix::get_elements(int8_t* dst, size_t ld) const {
+  get_elements(reinterpret_cast<uint8_t*>(dst), ld);
+}
+
+void Matrix::set_row(size_t i, const uint8_t* src) {
+  check_row_index("Matrix::set_row", i);
+  packed_kernels().pack(row_data(i), src, col_);
+}
+
+void Matrix::set_row(size_t i, const int8_t* src) {
+  set_row(i, reinterpret_cast<const uint8_t*>(src));
+}
+
+void Matrix::get_row(size_t i, uint8_t* dst) const {
+  check_row_index("Matrix::get_row", i);
+  packed_kernels().unpack(dst, row_data(i), col_);
+}
+
+void Matrix::get_row(size_t i, int8_t* dst) const {
+  get_row(i, reinterpret_cast<uint8_t*>(dst));
+}
+
+void Matrix::set_packed_row(size_t i, const int8_t* src) {
+  check_row_index("Matrix::set_packed_row", i);
+  size_t n_bytes = packed_bytes_size(col_);
+  int8_t* row = row_data(i);
+  memcpy(row, src, n_bytes);
+  // Padding elements of the last byte should stay zero
+  if (col_ % 4)
+    row[n_bytes - 1] &= (1 << (2 * (col_ % 4))) - 1;
+}
+
+void Matrix::get_packed_row(size_t i, int8_t* dst) const {
+  check_row_index("Matrix::get_packed_row", i);
+  memcpy(dst, row_data(i), packed_bytes_size(col_));
+}
+
 void Matrix::dump_size() const {
   std::cout << "[" << row_ << " x " << col_ << "]" << std::endl;
 }
@@ -247,8 +608,9 @@ void Matrix::dump_size() const {
 void Matrix::dump_raw_bytes() const {
   for (size_t i = 0; i < row_; ++i) {
     size_t n_bytes = packed_bytes_size(col_);
+    const uint8_t* row = reinterpret_cast<const uint8_t*>(row_data(i));
     for (size_t j = 0; j < n_bytes; ++j) {
-      printf("%02X ", data_[i][j]);
+      printf("%02X ", row[j]);
     }
     std::cout << std::endl;
   }
@@ -274,11 +636,287 @@ size_t Matrix::col() const {
   return col_;
 }
 
+MatrixView Matrix::view() {
+  return MatrixView(*this);
+}
+
+ConstMatrixView Matrix::view() const {
+  return ConstMatrixView(*this);
+}
+
+Matrix::BasicMatrix(ConstMatrixView view)
+              :row_(view.row()), col_(view.col()), stride_(0), data_(nullptr) {
+  allocate(true);
+  copy(*this, view);
+}
+
+ConstMatrixView::ConstMatrixView(const Matrix& m)
+                :data_(m.data_), row_(m.row_), col_(m.col_), stride_(m.stride_) {
+}
+
+MatrixView::MatrixView(Matrix& m)
+           :data_(m.data_), row_(m.row_), col_(m.col_), stride_(m.stride_) {
+}
+
+//! Checks that the block [row, row + rows) x [col, col + cols) can be viewed in [n_row x n_col] view
+static void check_view_block(const char* func, size_t n_row, size_t n_col,
+                             size_t row, size_t col, size_t rows, size_t cols) {
+  if ((row > n_row) || (rows > n_row - row) || (col > n_col) || (cols > n_col - col)) {
+    std::stringstream msg;
+    msg << func << ": Block [" << row << ", " << col << "] of size " << rows << "x" << cols
+        << " does not fit into " << n_row << "x" << n_col << " matrix";
+    throw std::out_of_range(msg.str());
+  }
+  if (col % 4) {
+    std::stringstream msg;
+    msg << func << ": Column offset of the view should be a multiple of 4 (" << col << " provided)";
+    throw std::invalid_argument(msg.str());
+  }
+}
+
+ConstMatrixView ConstMatrixView::block(size_t row, size_t col, size_t rows, size_t cols) const {
+  check_view_block("ConstMatrixView::block", row_, col_, row, col, rows, cols);
+  return ConstMatrixView(data_ + row * stride_ + col / 4, rows, cols, stride_);
+}
+
+MatrixView MatrixView::block(size_t row, size_t col, size_t rows, size_t cols) const {
+  check_view_block("MatrixView::block", row_, col_, row, col, rows, cols);
+  return MatrixView(data_ + row * stride_ + col / 4, rows, cols, stride_);
+}
+
+/**
+ * Copies count elements of packed row src starting from element first
+ * into the beginning of packed row dst. Bytes of dst are overwritten as a whole,
+ * lanes beyond count in the last byte are zero.
+ * Every output word is assembled from two adjacent source words
+ */
+static void copy_shifted(int8_t* dst, const int8_t* src, size_t first, size_t count) {
+  size_t src_end = packed_bytes_size(first + count);
+  size_t dst_bytes = packed_bytes_size(count);
+  size_t shift = (first % 4) * 2;
+  for (size_t w = 0; w < dst_bytes; w += 8) {
+    size_t byte = first / 4 + w;
+    size_t available = src_end - byte;
+    uint64_t word = load_partial_word(src + byte, std::min<size_t>(8, available)) >> shift;
+    if (shift && (available > 8))
+      word |= static_cast<uint64_t>(static_cast<uint8_t>(src[byte + 8])) << (64 - shift);
+    size_t n_elements = std::min<size_t>(32, count - 4 * w);
+    if (n_elements < 32)
+      word &= (1ULL << (2 * n_elements)) - 1;
+    store_partial_word(dst + w, word, std::min<size_t>(8, dst_bytes - w));
+  }
+}
+
+Matrix Matrix::block(size_t row, size_t col, size_t rows, size_t cols) const {
+  if ((row > row_) || (rows > row_ - row) || (col > col_) || (cols > col_ - col)) {
+    std::stringstream msg;
+    msg << "Matrix::block: Block [" << row << ", " << col << "] of size " << rows << "x" << cols
+        << " does not fit into " << row_ << "x" << col_ << " matrix";
+    throw std::out_of_range(msg.str());
+  }
+  Matrix m(rows, cols);
+  if (cols == 0)
+    return m;
+  for (size_t i = 0; i < rows; ++i) {
+    copy_shifted(m.row_data(i), row_data(row + i), col, cols);
+  }
+  return m;
+}
+
+//! Checks that all views passed to the element-wise operation have the same size
+static void check_same_size(const char* func, ConstMatrixView dst, ConstMatrixView src) {
+  if ((dst.row() != src.row()) || (dst.col() != src.col())) {
+    std::stringstream msg;
+    msg << func << ": Sizes of matricies should be equal("
+        << dst.row() << "x" << dst.col() << " and " << src.row() << "x" << src.col() << " provided)";
+    throw std::length_error(msg.str());
+  }
+}
+
+/**
+ * Applies packed kernel to all rows of the views.
+ * Full bytes are processed by the kernel in place, the last byte of every row
+ * is computed separately and merged so that lanes beyond col of dst are kept
+ */
+static void apply_rows(void (*kernel)(int8_t*, const int8_t*, const int8_t*, size_t),
+                       MatrixView dst, ConstMatrixView lhs, ConstMatrixView rhs) {
+  size_t full_bytes = dst.col() / 4;
+  size_t tail = dst.col() % 4;
+  int8_t tail_mask = 0xFF >> (8 - 2 * tail);
+  for (size_t i = 0; i < dst.row(); ++i) {
+    int8_t* d = dst.row_data(i);
+    const int8_t* a = lhs.row_data(i);
+    const int8_t* b = rhs.row_data(i);
+    if (full_bytes)
+      kernel(d, a, b, full_bytes);
+    if (tail) {
+      int8_t value;
+      kernel(&value, a + full_bytes, b + full_bytes, 1);
+      d[full_bytes] = (d[full_bytes] & ~tail_mask) | (value & tail_mask);
+    }
+  }
+}
+
+void Matrix::add(MatrixView dst, ConstMatrixView lhs, ConstMatrixView rhs) {
+  check_same_size("Matrix::add", dst, lhs);
+  check_same_size("Matrix::add", dst, rhs);
+  apply_rows(packed_kernels().sum, dst, lhs, rhs);
+}
+
+void Matrix::subtract(MatrixView dst, ConstMatrixView lhs, ConstMatrixView rhs) {
+  check_same_size("Matrix::subtract", dst, lhs);
+  check_same_size("Matrix::subtract", dst, rhs);
+  apply_rows(packed_kernels().diff, dst, lhs, rhs);
+}
+
+void Matrix::copy(MatrixView dst, ConstMatrixView src) {
+  check_same_size("Matrix::copy", dst, src);
+  size_t full_bytes = dst.col() / 4;
+  size_t tail = dst.col() % 4;
+  int8_t tail_mask = 0xFF >> (8 - 2 * tail);
+  for (size_t i = 0; i < dst.row(); ++i) {
+    int8_t* d = dst.row_data(i);
+    const int8_t* s = src.row_data(i);
+    if (d == s)
+      continue;
+    memmove(d, s, full_bytes);
+    if (tail)
+      d[full_bytes] = (d[full_bytes] & ~tail_mask) | (s[full_bytes] & tail_mask);
+  }
+}
+
+/**
+ * Loads block of 32x32 elements at [row, col] (col is a multiple of 32) into 32 words.
+ * Elements outside of the view are zero
+ */
+static void load_block32(uint64_t* block, ConstMatrixView src, size_t row, size_t col) {
+  size_t rows = std::min<size_t>(32, src.row() - row);
+  size_t lanes = std::min<size_t>(32, src.col() - col);
+  size_t n_bytes = (lanes + 3) / 4;
+  // The last byte of a view may hold elements of the next columns
+  uint64_t mask = (lanes == 32) ? ~0ULL : ((1ULL << (2 * lanes)) - 1);
+  for (size_t r = 0; r < rows; ++r) {
+    const int8_t* p = src.row_data(row + r) + col / 4;
+    block[r] = ((n_bytes == 8) ? load_word(p) : load_partial_word(p, n_bytes)) & mask;
+  }
+  std::fill(block + rows, block + 32, 0);
+}
+
+/**
+ * Stores the part of 32x32 block which fits into [row, col] of dst.
+ * The last byte of rows is written as a whole, so dst should own whole rows
+ */
+static void store_block32(const uint64_t* block, MatrixView dst, size_t row, size_t col) {
+  size_t rows = std::min<size_t>(32, dst.row() - row);
+  size_t n_bytes = (std::min<size_t>(32, dst.col() - col) + 3) / 4;
+  for (size_t r = 0; r < rows; ++r) {
+    int8_t* p = dst.row_data(row + r) + col / 4;
+    if (n_bytes == 8)
+      store_word(p, block[r]);
+    else
+      store_partial_word(p, block[r], n_bytes);
+  }
+}
+
+/**
+ * dst = src transposed by blocks of 32x32 elements. Blocks are visited
+ * by tiles of MATRIX_TRANSPOSE_TILE rows and columns, so that the rows
+ * read and written by a tile stay in cache
+ */
+static void transpose_blocks(Matrix& dst, ConstMatrixView src) {
+  const PackedKernels& kernels = packed_kernels();
+  MatrixView d(dst);
+  uint64_t block[32];
+  for (size_t ti = 0; ti < src.row(); ti += MATRIX_TRANSPOSE_TILE) {
+    for (size_t tj = 0; tj < src.col(); tj += MATRIX_TRANSPOSE_TILE) {
+      size_t i_end = std::min<size_t>(ti + MATRIX_TRANSPOSE_TILE, src.row());
+      size_t j_end = std::min<size_t>(tj + MATRIX_TRANSPOSE_TILE, src.col());
+      for (size_t i = ti; i < i_end; i += 32) {
+        for (size_t j = tj; j < j_end; j += 32) {
+          load_block32(block, src, i, j);
+          kernels.transpose32(block);
+          store_block32(block, d, j, i);
+        }
+      }
+    }
+  }
+}
+
 Matrix Matrix::transposed() const {
   Matrix m(col_, row_);
+  transpose_blocks(m, *this);
+  return m;
+}
+
+Matrix& Matrix::transpose() {
+  if (row_ != col_) {
+    *this = transposed();
+    return *this;
+  }
+  // Blocks symmetric about the diagonal are exchanged
+  const PackedKernels& kernels = packed_kernels();
+  MatrixView v(*this);
+  uint64_t upper[32];
+  uint64_t lower[32];
+  for (size_t i = 0; i < row_; i += 32) {
+    load_block32(upper, v, i, i);
+    kernels.transpose32(upper);
+    store_block32(upper, v, i, i);
+    for (size_t j = i + 32; j < col_; j += 32) {
+      load_block32(upper, v, i, j);
+      load_block32(lower, v, j, i);
+      kernels.transpose32(upper);
+      kernels.transpose32(lower);
+      store_block32(upper, v, j, i);
+      store_block32(lower, v, i, j);
+    }
+  }
+  return *this;
+}
+
+//! Packs even bits of x (low bits of 32 Z/4 elements) into 32 bits
+static inline uint64_t compress_even_bits(uint64_t x) {
+  x &= 0x5555555555555555ULL;
+  x = (x | (x >> 1)) & 0x3333333333333333ULL;
+  x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+  x = (x | (x >> 4)) & 0x00FF00FF00FF00FFULL;
+  x = (x | (x >> 8)) & 0x0000FFFF0000FFFFULL;
+  return (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+}
+
+//! Inverse of compress_even_bits(): bit t of x becomes bit 2t
+static inline uint64_t spread_even_bits(uint64_t x) {
+  x &= 0x00000000FFFFFFFFULL;
+  x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+  x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+  x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  x = (x | (x << 2)) & 0x3333333333333333ULL;
+  return (x | (x << 1)) & 0x5555555555555555ULL;
+}
+
+Matrix::BasicMatrix(const BitMatrix& m)
+              :row_(m.row()), col_(m.col()), stride_(0), data_(nullptr) {
+  allocate(true);
+  size_t n_bytes = (col_ + 3) / 4;
   for (size_t i = 0; i < row_; ++i) {
-    for (size_t j = 0; j < col_; ++j) {
-      m.set(j, i, get(i, j));
+    const uint64_t* src = m.row_words(i);
+    int8_t* dst = row_data(i);
+    for (size_t byte = 0; byte < n_bytes; byte += 8) {
+      uint64_t half = src[byte / 16] >> (byte % 16 * 4);
+      store_partial_word(dst + byte, spread_even_bits(half), std::min<size_t>(8, n_bytes - byte));
+    }
+  }
+}
+
+BitMatrix Matrix::mod2() const {
+  BitMatrix m(row_, col_);
+  size_t n_bytes = (col_ + 3) / 4;
+  for (size_t i = 0; i < row_; ++i) {
+    const int8_t* src = row_data(i);
+    uint64_t* dst = m.row_words(i);
+    for (size_t byte = 0; byte < n_bytes; byte += 8) {
+      uint64_t w = load_partial_word(src + byte, std::min<size_t>(8, n_bytes - byte));
+      dst[byte / 16] |= compress_even_bits(w) << (byte % 16 * 4);
     }
   }
   return m;
@@ -293,143 +931,532 @@ Matrix Matrix::multiply_trivial(const Matrix& lhs, const Matrix& rhs) {
   }
 
   Matrix m(lhs.row_, rhs.col_);
-  Matrix rhs_tr(rhs.transposed());
-  size_t l_bytes = packed_bytes_size(lhs.col_);
-  for (size_t i = 0; i < lhs.row_; ++i) {
-    for (size_t j = 0; j < rhs_tr.row_; ++j) {
-      int8_t sum = 0;
-      for (size_t k = 0; k < l_bytes; ++k) {
-        int8_t prod = packed_multiply(lhs.data_[i][k], rhs_tr.data_[j][k]);
-        sum = packed_sum(sum, prod);
-      }
-      int8_t sum_pack = ((sum & 0x03) + ((sum >> 2) & 0x03) + ((sum >> 4) & 0x03) + ((sum >> 6) & 0x03)) & 0x03;
-      m.set(i, j, sum_pack);
-    }
+  packed_gemm(m.data_, m.stride_, lhs.data_, lhs.stride_, rhs.data_, rhs.stride_,
+              lhs.row_, lhs.col_, rhs.col_);
+  return m;
+}
+
+Matrix Matrix::multiply_m4rm(const Matrix& lhs, const Matrix& rhs) {
+  if (lhs.col_ != rhs.row_) {
+    std::stringstream msg;
+    msg << "Matrix::multiply_m4rm: Column number of first matrix should be equal to row number of the second matrix ("
+        << lhs.col_ << " and " << rhs.row_ << " provided)";
+    throw std::length_error(msg.str());
   }
+  Matrix m(lhs.row_, rhs.col_);
+  packed_m4rm(m.data_, m.stride_, lhs.data_, lhs.stride_, rhs.data_, rhs.stride_,
+              lhs.row_, lhs.col_, rhs.col_);
+  return m;
+}
+
+Matrix Matrix::multiply_vector(const Matrix& lhs, const Matrix& rhs) {
+  if (lhs.col_ != rhs.row_) {
+    std::stringstream msg;
+    msg << "Matrix::multiply_vector: Column number of first matrix should be equal to row number of the second matrix ("
+        << lhs.col_ << " and " << rhs.row_ << " provided)";
+    throw std::length_error(msg.str());
+  }
+  if ((lhs.row_ != 1) && (rhs.col_ != 1)) {
+    std::stringstream msg;
+    msg << "Matrix::multiply_vector: One of the operands should be a vector ("
+        << lhs.row_ << "x" << lhs.col_ << " and " << rhs.row_ << "x" << rhs.col_ << " provided)";
+    throw std::invalid_argument(msg.str());
+  }
+  Matrix m(lhs.row_, rhs.col_);
+  if ((m.row_ == 0) || (m.col_ == 0) || (lhs.col_ == 0))
+    return m;
+  std::shared_ptr<ThreadPool> pool(acquire_pool());
+  if (rhs.col_ == 1)
+    packed_gemv(m.data_, m.stride_, lhs.data_, lhs.stride_, rhs.data_, rhs.stride_, lhs.row_, lhs.col_, pool.get());
+  else
+    packed_gevm(m.data_, lhs.data_, rhs.data_, rhs.stride_, lhs.col_, rhs.col_, pool.get());
   return m;
 }
 
-Matrix Matrix::calculate_p1(const Matrix& a11, const Matrix& a22, const Matrix& b11, const Matrix& b22) {
-  return (a11 + a22)*(b11 + b22);
+void Matrix::gemm(MatrixView c, ConstMatrixView a, ConstMatrixView b, int sign,
+                  bool transpose_a, bool transpose_b) {
+  if ((sign != 1) && (sign != -1)) {
+    std::stringstream msg;
+    msg << "Matrix::gemm: Sign should be 1 or -1 (" << sign << " provided)";
+    throw std::invalid_argument(msg.str());
+  }
+  size_t m = transpose_a ? a.col() : a.row();
+  size_t k = transpose_a ? a.row() : a.col();
+  size_t n = transpose_b ? b.row() : b.col();
+  size_t b_row = transpose_b ? b.col() : b.row();
+  if (k != b_row) {
+    std::stringstream msg;
+    msg << "Matrix::gemm: Column number of first matrix should be equal to row number of the second matrix ("
+        << k << " and " << b_row << " provided)";
+    throw std::length_error(msg.str());
+  }
+  check_sizes("Matrix::gemm", c.row(), c.col(), m, n);
+  if ((m == 0) || (n == 0) || (k == 0))
+    return;
+  Tuning t = tuning();
+  PackedStore store = (sign == 1) ? PackedStore::Add : PackedStore::Subtract;
+  Algorithm alg = algorithm();
+  bool recursive = (alg == Algorithm::Strassen) || (alg == Algorithm::Winograd);
+  size_t min_dim = std::min(std::min(m, k), n);
+  if (recursive && (min_dim > t.crossover)) {
+    // Recursion works on views of the operands, so transposed ones are copied
+    Matrix a_t(transpose_a ? a.col() : 0, transpose_a ? a.row() : 0);
+    Matrix b_t(transpose_b ? b.col() : 0, transpose_b ? b.row() : 0);
+    if (transpose_a)
+      transpose_blocks(a_t, a);
+    if (transpose_b)
+      transpose_blocks(b_t, b);
+    std::shared_ptr<ThreadPool> pool(acquire_pool());
+    strassen(c, transpose_a ? a_t.view() : a, transpose_b ? b_t.view() : b, store, pool.get(), t, 0);
+    return;
+  }
+  if (((recursive ? t.base_algorithm : alg) == Algorithm::M4RM) && !transpose_a && !transpose_b) {
+    packed_m4rm(c.row_data(0), c.stride(), a.row_data(0), a.stride(), b.row_data(0), b.stride(), m, k, n, store);
+    return;
+  }
+  PackedGemmWorkspace workspace;
+  packed_gemm(c.row_data(0), c.stride(), a.row_data(0), a.stride(), transpose_a,
+              b.row_data(0), b.stride(), transpose_b, m, k, n, store, workspace);
+}
+
+void Matrix::multiply_batch(const Matrix* lhs, const Matrix* rhs, Matrix* out, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    if (lhs[i].col_ != rhs[i].row_) {
+      std::stringstream msg;
+      msg << "Matrix::multiply_batch: Column number of first matrix should be equal to row number of the second matrix ("
+          << lhs[i].col_ << " and " << rhs[i].row_ << " provided for product " << i << ")";
+      throw std::length_error(msg.str());
+    }
+  }
+  Tuning t = tuning();
+  // The same choice of the base case as in operator*: large products go to Strassen recursion
+  Algorithm alg = algorithm();
+  bool recursive = (alg == Algorithm::Strassen) || (alg == Algorithm::Winograd);
+  size_t crossover = recursive ? t.crossover : SIZE_MAX;
+  bool m4rm = ((recursive ? t.base_algorithm : alg) == Algorithm::M4RM);
+  // Products are taken one by one by all threads, every thread reuses its own packing buffers
+  std::shared_ptr<ThreadPool> pool(acquire_pool());
+  std::atomic<size_t> next(0);
+  auto worker = [&] {
+    PackedGemmWorkspace workspace;
+    for (size_t i = next++; i < count; i = next++) {
+      const Matrix& a = lhs[i];
+      const Matrix& b = rhs[i];
+      Matrix& c = out[i];
+      if ((c.row_ != a.row_) || (c.col_ != b.col_))
+        c = Matrix(a.row_, b.col_);
+      size_t max_size = std::max(std::max(a.row_, a.col_), b.col_);
+      if (max_size > crossover) {
+        if (a.col_)
+          strassen(c, a, b, PackedStore::Assign, pool.get(), t, 0);
+        else
+          c.clear();
+      } else if (m4rm)
+        packed_m4rm(c.data_, c.stride_, a.data_, a.stride_, b.data_, b.stride_, a.row_, a.col_, b.col_);
+      else
+        packed_gemm(c.data_, c.stride_, a.data_, a.stride_, b.data_, b.stride_, a.row_, a.col_, b.col_, workspace);
+    }
+  };
+  size_t tasks = (pool && (count > 1)) ? std::min(count, thread_count()) : 1;
+  TaskGroup group(tasks > 1 ? pool.get() : nullptr);
+  for (size_t task = 0; task < tasks; ++task) {
+    group.run(worker);
+  }
+  group.wait();
 }
 
-Matrix Matrix::calculate_p2(const Matrix& a21, const Matrix& a22, const Matrix& b11) {
-  return (a21 + a22) * b11;
+/**
+ * Blocks are split into quadrants while they are larger than the crossover size
+ * and the quadrants start at byte boundaries, so that they can be viewed in place
+ */
+inline bool split_quadrants(size_t size, size_t crossover) {
+  return (size > crossover) && (size % 2 == 0) && ((size / 2) % 4 == 0);
 }
 
-Matrix Matrix::calculate_p3(const Matrix& a11, const Matrix& b12, const Matrix& b22) {
-  return a11 * (b12 - b22);
+//! Scratch bytes used by Matrix::winograd() for [size x size] blocks: X and Y of every level
+static size_t winograd_workspace_size(size_t size, size_t crossover) {
+  size_t n_bytes = 0;
+  for (; split_quadrants(size, crossover); size /= 2) {
+    n_bytes += 2 * (size / 2) * Matrix::row_stride(size / 2);
+  }
+  return n_bytes;
 }
 
-Matrix Matrix::calculate_p4(const Matrix& a22, const Matrix& b21, const Matrix& b11) {
-  return a22 * (b21 - b11);
+void Matrix::multiply_base(MatrixView c, ConstMatrixView a, ConstMatrixView b, PackedStore store, const Tuning& tuning) {
+  if (tuning.base_algorithm == Algorithm::M4RM) {
+    packed_m4rm(c.row_data(0), c.stride(), a.row_data(0), a.stride(), b.row_data(0), b.stride(),
+                a.row(), a.col(), b.col(), store);
+  } else {
+    PackedGemmWorkspace workspace;
+    packed_gemm(c.row_data(0), c.stride(), a.row_data(0), a.stride(), false, b.row_data(0), b.stride(), false,
+                a.row(), a.col(), b.col(), store, workspace);
+  }
 }
 
-Matrix Matrix::calculate_p5(const Matrix& a11, const Matrix& a12, const Matrix& b22) {
-  return (a11 + a12) * b22;
+void Matrix::calculate_p1(MatrixView p, ConstMatrixView a11, ConstMatrixView a22, ConstMatrixView b11, ConstMatrixView b22,
+                          ThreadPool* pool, const Tuning& tuning, size_t depth) {
+  STRASSEN_PROFILE_START(depth - 1, Operands);
+  Matrix a(a11.row(), a11.col());
+  Matrix b(b11.row(), b11.col());
+  add(a, a11, a22);
+  add(b, b11, b22);
+  STRASSEN_PROFILE_STOP(Operands);
+  STRASSEN_PROFILE_MEMORY(depth - 1, a.storage_size() + b.storage_size());
+  strassen(p, a, b, PackedStore::Assign, pool, tuning, depth);
 }
 
-Matrix Matrix::calculate_p6(const Matrix& a21, const Matrix& a11, const Matrix& b11, const Matrix& b12) {
-  return (a21 - a11) * (b11 + b12);
+void Matrix::calculate_p2(MatrixView p, ConstMatrixView a21, ConstMatrixView a22, ConstMatrixView b11,
+                          ThreadPool* pool, const Tuning& tuning, size_t depth) {
+  STRASSEN_PROFILE_START(depth - 1, Operands);
+  Matrix a(a21.row(), a21.col());
+  add(a, a21, a22);
+  STRASSEN_PROFILE_STOP(Operands);
+  STRASSEN_PROFILE_MEMORY(depth - 1, a.storage_size());
+  strassen(p, a, b11, PackedStore::Assign, pool, tuning, depth);
 }
 
-Matrix Matrix::calculate_p7(const Matrix& a12, const Matrix& a22, const Matrix& b21, const Matrix& b22) {
-  return (a12 - a22) * (b21 + b22);
+void Matrix::calculate_p3(MatrixView p, ConstMatrixView a11, ConstMatrixView b12, ConstMatrixView b22,
+                          ThreadPool* pool, const Tuning& tuning, size_t depth) {
+  STRASSEN_PROFILE_START(depth - 1, Operands);
+  Matrix b(b12.row(), b12.col());
+  subtract(b, b12, b22);
+  STRASSEN_PROFILE_STOP(Operands);
+  STRASSEN_PROFILE_MEMORY(depth - 1, b.storage_size());
+  strassen(p, a11, b, PackedStore::Assign, pool, tuning, depth);
 }
 
-Matrix Matrix::multiply_strassen(const Matrix& lhs, const Matrix& rhs) {
+void Matrix::calculate_p4(MatrixView p, ConstMatrixView a22, ConstMatrixView b21, ConstMatrixView b11,
+                          ThreadPool* pool, const Tuning& tuning, size_t depth) {
+  STRASSEN_PROFILE_START(depth - 1, Operands);
+  Matrix b(b21.row(), b21.col());
+  subtract(b, b21, b11);
+  STRASSEN_PROFILE_STOP(Operands);
+  STRASSEN_PROFILE_MEMORY(depth - 1, b.storage_size());
+  strassen(p, a22, b, PackedStore::Assign, pool, tuning, depth);
+}
+
+void Matrix::calculate_p5(MatrixView p, ConstMatrixView a11, ConstMatrixView a12, ConstMatrixView b22,
+                          ThreadPool* pool, const Tuning& tuning, size_t depth) {
+  STRASSEN_PROFILE_START(depth - 1, Operands);
+  Matrix a(a11.row(), a11.col());
+  add(a, a11, a12);
+  STRASSEN_PROFILE_STOP(Operands);
+  STRASSEN_PROFILE_MEMORY(depth - 1, a.storage_size());
+  strassen(p, a, b22, PackedStore::Assign, pool, tuning, depth);
+}
+
+void Matrix::calculate_p6(MatrixView p, ConstMatrixView a21, ConstMatrixView a11, ConstMatrixView b11, ConstMatrixView b12,
+                          PackedStore store, ThreadPool* pool, const Tuning& tuning, size_t depth) {
+  STRASSEN_PROFILE_START(depth - 1, Operands);
+  Matrix a(a21.row(), a21.col());
+  Matrix b(b11.row(), b11.col());
+  subtract(a, a21, a11);
+  add(b, b11, b12);
+  STRASSEN_PROFILE_STOP(Operands);
+  STRASSEN_PROFILE_MEMORY(depth - 1, a.storage_size() + b.storage_size());
+  strassen(p, a, b, store, pool, tuning, depth);
+}
+
+void Matrix::calculate_p7(MatrixView p, ConstMatrixView a12, ConstMatrixView a22, ConstMatrixView b21, ConstMatrixView b22,
+                          PackedStore store, ThreadPool* pool, const Tuning& tuning, size_t depth) {
+  STRASSEN_PROFILE_START(depth - 1, Operands);
+  Matrix a(a12.row(), a12.col());
+  Matrix b(b21.row(), b21.col());
+  subtract(a, a12, a22);
+  add(b, b21, b22);
+  STRASSEN_PROFILE_STOP(Operands);
+  STRASSEN_PROFILE_MEMORY(depth - 1, a.storage_size() + b.storage_size());
+  strassen(p, a, b, store, pool, tuning, depth);
+}
+
+//! Store mode of the products which are added to the already written part of the result
+inline PackedStore accumulated(PackedStore store) {
+  return (store == PackedStore::Assign) ? PackedStore::Add : store;
+}
+
+void Matrix::split_product(MatrixView c, ConstMatrixView a, ConstMatrixView b, bool split_k, PackedStore store,
+                           ThreadPool* pool, const Tuning& tuning, size_t depth, bool parallel) {
+  size_t m = a.row();
+  size_t k = a.col();
+  size_t n = b.col();
+  TaskGroup group(parallel ? pool : nullptr);
+  size_t next = depth + 1;
+  STRASSEN_PROFILE_COUNT(depth, SplitCalls, 1);
+  STRASSEN_PROFILE_COUNT(depth, Tasks, parallel ? 2 : 0);
+  if (split_k && (k >= m) && (k >= n)) {
+    // c = a_1 * b_1 + a_2 * b_2
+    size_t half = k / 8 * 4;
+    ConstMatrixView a_1 = a.block(0, 0, m, half);
+    ConstMatrixView a_2 = a.block(0, half, m, k - half);
+    ConstMatrixView b_1 = b.block(0, 0, half, n);
+    ConstMatrixView b_2 = b.block(half, 0, k - half, n);
+    if (!parallel) {
+      // The second product is accumulated into c in place
+      strassen(c, a_1, b_1, store, pool, tuning, next);
+      strassen(c, a_2, b_2, accumulated(store), pool, tuning, next);
+      return;
+    }
+    // Products computed at once need their own outputs: the second one goes into a temporary
+    Matrix t(m, n);
+    STRASSEN_PROFILE_MEMORY(depth, t.storage_size());
+    group.run([&] { strassen(c, a_1, b_1, store, pool, tuning, next); });
+    group.run([&] { strassen(t, a_2, b_2, PackedStore::Assign, pool, tuning, next); });
+    group.wait();
+    STRASSEN_PROFILE_START(depth, Combine);
+    if (store == PackedStore::Subtract)
+      subtract(c, c, t);
+    else
+      add(c, c, t);
+  } else if (n >= m) {
+    size_t half = n / 8 * 4;
+    MatrixView c_1 = c.block(0, 0, m, half);
+    MatrixView c_2 = c.block(0, half, m, n - half);
+    ConstMatrixView b_1 = b.block(0, 0, k, half);
+    ConstMatrixView b_2 = b.block(0, half, k, n - half);
+    group.run([&] { strassen(c_1, a, b_1, store, pool, tuning, next); });
+    group.run([&] { strassen(c_2, a, b_2, store, pool, tuning, next); });
+    group.wait();
+  } else {
+    size_t half = m / 2;
+    MatrixView c_1 = c.block(0, 0, half, n);
+    MatrixView c_2 = c.block(half, 0, m - half, n);
+    ConstMatrixView a_1 = a.block(0, 0, half, k);
+    ConstMatrixView a_2 = a.block(half, 0, m - half, k);
+    group.run([&] { strassen(c_1, a_1, b, store, pool, tuning, next); });
+    group.run([&] { strassen(c_2, a_2, b, store, pool, tuning, next); });
+    group.wait();
+  }
+}
+
+void Matrix::strassen(MatrixView c, ConstMatrixView a, ConstMatrixView b, PackedStore store,
+                      ThreadPool* pool, const Tuning& tuning, size_t depth) {
   /*
    * Strassen algorithm implementation
    * See https://en.wikipedia.org/wiki/Strassen_algorithm for details
    */
-  if ((lhs.row_ == 1) && (lhs.col_ == 1) && (rhs.col_ == 1) && (rhs.col_ == 1)) {
-    Matrix m(1, 1);
-    m.data_[0][0] = lhs.data_[0][0] * rhs.data_[0][0];
-    return m;
+  size_t m = a.row();
+  size_t k = a.col();
+  size_t n = b.col();
+  size_t max_dim = std::max(std::max(m, k), n);
+  size_t min_dim = std::min(std::min(m, k), n);
+  size_t crossover = tuning.crossover;
+  // Lower levels of the recursion are run sequentially in the thread of their task
+  bool parallel = pool && (depth < tuning.parallel_max_depth) && (max_dim >= tuning.parallel_min_size);
+  STRASSEN_PROFILE_COUNT(depth, Calls, 1);
+  STRASSEN_PROFILE_COUNT(depth, ElementOps, static_cast<uint64_t>(m) * k * n);
+  if (min_dim <= crossover) {
+    // Strassen step does not pay off, large blocks are only split to be computed in parallel
+    if (parallel && (std::max(m, n) > crossover)) {
+      split_product(c, a, b, false, store, pool, tuning, depth, parallel);
+    } else {
+      STRASSEN_PROFILE_COUNT(depth, BaseCalls, 1);
+      STRASSEN_PROFILE_START(depth, Base);
+      multiply_base(c, a, b, store, tuning);
+    }
+    return;
+  }
+  if (max_dim >= 2 * min_dim) {
+    // Long and thin blocks are halved along the longest dimension until they become square-like
+    split_product(c, a, b, true, store, pool, tuning, depth, parallel);
+    return;
+  }
+  /*
+   * Dynamic peeling: Strassen step is applied to the even-sized core
+   * [2 * m_2 x 2 * k_2] * [2 * k_2 x 2 * n_2] with column halves multiple of 4,
+   * the remaining rows and columns (at most 1 row and 7 columns) are added by the base case algorithm
+   */
+  size_t m_2 = m / 2;
+  size_t k_2 = k / 8 * 4;
+  size_t n_2 = n / 8 * 4;
+  ConstMatrixView a_1_1 = a.block(0, 0, m_2, k_2);
+  ConstMatrixView a_1_2 = a.block(0, k_2, m_2, k_2);
+  ConstMatrixView a_2_1 = a.block(m_2, 0, m_2, k_2);
+  ConstMatrixView a_2_2 = a.block(m_2, k_2, m_2, k_2);
+  ConstMatrixView b_1_1 = b.block(0, 0, k_2, n_2);
+  ConstMatrixView b_1_2 = b.block(0, n_2, k_2, n_2);
+  ConstMatrixView b_2_1 = b.block(k_2, 0, k_2, n_2);
+  ConstMatrixView b_2_2 = b.block(k_2, n_2, k_2, n_2);
+  MatrixView c_1_1 = c.block(0, 0, m_2, n_2);
+  MatrixView c_1_2 = c.block(0, n_2, m_2, n_2);
+  MatrixView c_2_1 = c.block(m_2, 0, m_2, n_2);
+  MatrixView c_2_2 = c.block(m_2, n_2, m_2, n_2);
+  STRASSEN_PROFILE_COUNT(depth, StrassenSteps, 1);
+  STRASSEN_PROFILE_START(depth, Split);
+  Matrix p_1(m_2, n_2);
+  Matrix p_2(m_2, n_2);
+  Matrix p_3(m_2, n_2);
+  Matrix p_4(m_2, n_2);
+  Matrix p_5(m_2, n_2);
+  STRASSEN_PROFILE_STOP(Split);
+  STRASSEN_PROFILE_MEMORY(depth, 5 * p_1.storage_size());
+  TaskGroup group(parallel ? pool : nullptr);
+  size_t next = depth + 1;
+  STRASSEN_PROFILE_COUNT(depth, Tasks, parallel ? 7 : 0);
+  group.run([&] { calculate_p1(p_1, a_1_1, a_2_2, b_1_1, b_2_2, pool, tuning, next); });
+  group.run([&] { calculate_p2(p_2, a_2_1, a_2_2, b_1_1, pool, tuning, next); });
+  group.run([&] { calculate_p3(p_3, a_1_1, b_1_2, b_2_2, pool, tuning, next); });
+  group.run([&] { calculate_p4(p_4, a_2_2, b_2_1, b_1_1, pool, tuning, next); });
+  group.run([&] { calculate_p5(p_5, a_1_1, a_1_2, b_2_2, pool, tuning, next); });
+  // p6 and p7 are the only products used by one quadrant, they are stored there directly
+  group.run([&] { calculate_p6(c_2_2, a_2_1, a_1_1, b_1_1, b_1_2, store, pool, tuning, next); });
+  group.run([&] { calculate_p7(c_1_1, a_1_2, a_2_2, b_2_1, b_2_2, store, pool, tuning, next); });
+  group.wait();
+
+  // The rest of the quadrants is combined in place, each in one pass
+  STRASSEN_PROFILE_START(depth, Combine);
+  if (store == PackedStore::Assign) {
+    assign(c_1_1, c_1_1 + p_1 + p_4 - p_5);
+    assign(c_1_2, p_3.view() + p_5);
+    assign(c_2_1, p_2.view() + p_4);
+    assign(c_2_2, c_2_2 + p_1 - p_2 + p_3);
+  } else if (store == PackedStore::Add) {
+    assign(c_1_1, c_1_1 + p_1 + p_4 - p_5);
+    assign(c_1_2, c_1_2 + p_3 + p_5);
+    assign(c_2_1, c_2_1 + p_2 + p_4);
+    assign(c_2_2, c_2_2 + p_1 - p_2 + p_3);
+  } else {
+    assign(c_1_1, c_1_1 - p_1 - p_4 + p_5);
+    assign(c_1_2, c_1_2 - p_3 - p_5);
+    assign(c_2_1, c_2_1 - p_2 - p_4);
+    assign(c_2_2, c_2_2 - p_1 + p_2 - p_3);
+  }
+  STRASSEN_PROFILE_STOP(Combine);
+
+  size_t m_core = 2 * m_2;
+  size_t k_core = 2 * k_2;
+  size_t n_core = 2 * n_2;
+  STRASSEN_PROFILE_COUNT(depth, BaseCalls, (k > k_core) + (n > n_core) + (m > m_core));
+  STRASSEN_PROFILE_COUNT(depth, PeeledOps, static_cast<uint64_t>(m) * k * n -
+                                           static_cast<uint64_t>(m_core) * k_core * n_core);
+  STRASSEN_PROFILE_START(depth, Peeling);
+  if (k > k_core) {
+    // Rank update of the core by the last columns of a and rows of b
+    multiply_base(c.block(0, 0, m_core, n_core), a.block(0, k_core, m_core, k - k_core),
+                  b.block(k_core, 0, k - k_core, n_core), accumulated(store), tuning);
+  }
+  if (n > n_core)
+    multiply_base(c.block(0, n_core, m_core, n - n_core), a.block(0, 0, m_core, k), b.block(0, n_core, k, n - n_core), store, tuning);
+  if (m > m_core)
+    multiply_base(c.block(m_core, 0, m - m_core, n), a.block(m_core, 0, m - m_core, k), b, store, tuning);
+}
+
+void Matrix::winograd(MatrixView c, ConstMatrixView a, ConstMatrixView b, int8_t* workspace, const Tuning& tuning) {
+  /*
+   * Strassen-Winograd schedule with two temporaries X and Y, see
+   * Boyer, Dumas, Pernet, Zhou "Memory efficient scheduling of Strassen-Winograd's
+   * matrix multiplication algorithm" (2009). Products P1..P7 and sums U1..U7
+   * are placed in X and quadrants of c as soon as their operands are consumed
+   */
+  size_t size = a.row();
+  if (!split_quadrants(size, tuning.crossover)) {
+    multiply_base(c, a, b, PackedStore::Assign, tuning);
+    return;
+  }
+  size_t half_size = size / 2;
+  size_t stride = row_stride(half_size);
+  MatrixView x(workspace, half_size, half_size, stride);
+  MatrixView y(workspace + half_size * stride, half_size, half_size, stride);
+  int8_t* next = workspace + 2 * half_size * stride;
+  ConstMatrixView a_1_1 = a.block(0, 0, half_size, half_size);
+  ConstMatrixView a_1_2 = a.block(0, half_size, half_size, half_size);
+  ConstMatrixView a_2_1 = a.block(half_size, 0, half_size, half_size);
+  ConstMatrixView a_2_2 = a.block(half_size, half_size, half_size, half_size);
+  ConstMatrixView b_1_1 = b.block(0, 0, half_size, half_size);
+  ConstMatrixView b_1_2 = b.block(0, half_size, half_size, half_size);
+  ConstMatrixView b_2_1 = b.block(half_size, 0, half_size, half_size);
+  ConstMatrixView b_2_2 = b.block(half_size, half_size, half_size, half_size);
+  MatrixView c_1_1 = c.block(0, 0, half_size, half_size);
+  MatrixView c_1_2 = c.block(0, half_size, half_size, half_size);
+  MatrixView c_2_1 = c.block(half_size, 0, half_size, half_size);
+  MatrixView c_2_2 = c.block(half_size, half_size, half_size, half_size);
+  subtract(x, a_1_1, a_2_1);                   // S3 = A11 - A21
+  subtract(y, b_2_2, b_1_2);                   // T3 = B22 - B12
+  winograd(c_2_1, x, y, next, tuning);         // P7 = S3 * T3
+  add(x, a_2_1, a_2_2);                        // S1 = A21 + A22
+  subtract(y, b_1_2, b_1_1);                   // T1 = B12 - B11
+  winograd(c_2_2, x, y, next, tuning);         // P5 = S1 * T1
+  subtract(x, x, a_1_1);                       // S2 = S1 - A11
+  subtract(y, b_2_2, y);                       // T2 = B22 - T1
+  winograd(c_1_2, x, y, next, tuning);         // P6 = S2 * T2
+  subtract(x, a_1_2, x);                       // S4 = A12 - S2
+  winograd(c_1_1, x, b_2_2, next, tuning);     // P3 = S4 * B22
+  winograd(x, a_1_1, b_1_1, next, tuning);     // P1 = A11 * B11
+  add(c_1_2, x, c_1_2);                        // U2 = P1 + P6
+  add(c_2_1, c_1_2, c_2_1);                    // U3 = U2 + P7
+  add(c_1_2, c_1_2, c_2_2);                    // U4 = U2 + P5
+  add(c_2_2, c_2_1, c_2_2);                    // U7 = U3 + P5 = C22
+  add(c_1_2, c_1_2, c_1_1);                    // U5 = U4 + P3 = C12
+  subtract(y, y, b_2_1);                       // T4 = T2 - B21
+  winograd(c_1_1, a_2_2, y, next, tuning);     // P4 = A22 * T4
+  subtract(c_2_1, c_2_1, c_1_1);               // U6 = U3 - P4 = C21
+  winograd(c_1_1, a_1_2, b_2_1, next, tuning); // P2 = A12 * B21
+  add(c_1_1, x, c_1_1);                        // U1 = P1 + P2 = C11
+}
+
+/**
+ * Multiplies lhs and rhs with recursive algorithm working on [power x power] blocks.
+ * Operands are copied into zero padded matrices only if their sizes differ from power,
+ * the result is copied out of the padded block in the same way
+ */
+static Matrix multiply_padded(const char* func, const Matrix& lhs, const Matrix& rhs,
+                              const std::function<void(MatrixView, ConstMatrixView, ConstMatrixView)>& multiply) {
+  if (lhs.col() != rhs.row()) {
+    std::stringstream msg;
+    msg << func << ": Column number of first matrix should be equal to row number of the second matrix ("
+        << lhs.col() << " and " << rhs.row() << " provided)";
+    throw std::length_error(msg.str());
   }
-  size_t max_size = std::max(std::max(lhs.col_, lhs.row_), std::max(rhs.col_, rhs.row_));
+  size_t max_size = std::max(std::max(lhs.col(), lhs.row()), std::max(rhs.col(), rhs.row()));
   size_t power = 1;
   // Find next highest power of 2
   while (max_size > power) power *= 2;
-  // Prepare matrices to be squared with sizes [power x power]
-  Matrix a(lhs);
-  Matrix b(rhs);
-  a.resize(power, power);
-  b.resize(power, power);
-  size_t half_size = power / 2;
-  //size_t packed_size = packed_bytes_size(half_size);
-  // Initialize and fill quarters of matrices
-  Matrix a_1_1(half_size, half_size);
-  Matrix a_1_2(half_size, half_size);
-  Matrix a_2_1(half_size, half_size);
-  Matrix a_2_2(half_size, half_size);
-  Matrix b_1_1(half_size, half_size);
-  Matrix b_1_2(half_size, half_size);
-  Matrix b_2_1(half_size, half_size);
-  Matrix b_2_2(half_size, half_size);
-  for (size_t i = 0; i < half_size; ++i) {
-    for (size_t j = 0; j < half_size; ++j) {
-      a_1_1.set(i, j, a.get(i, j));
-      a_1_2.set(i, j, a.get(i, j + half_size));
-      a_2_1.set(i, j, a.get(i + half_size, j));
-      a_2_2.set(i, j, a.get(i + half_size, j + half_size));
-      b_1_1.set(i, j, b.get(i, j));
-      b_1_2.set(i, j, b.get(i, j + half_size));
-      b_2_1.set(i, j, b.get(i + half_size, j));
-      b_2_2.set(i, j, b.get(i + half_size, j + half_size));
-    }
+  Matrix m(lhs.row(), rhs.col());
+  if ((m.row() == 0) || (m.col() == 0))
+    return m;
+  bool pad_lhs = (lhs.row() != power) || (lhs.col() != power);
+  bool pad_rhs = (rhs.row() != power) || (rhs.col() != power);
+  Matrix a(pad_lhs ? power : 0, pad_lhs ? power : 0);
+  Matrix b(pad_rhs ? power : 0, pad_rhs ? power : 0);
+  if (pad_lhs)
+    Matrix::copy(a.view().block(0, 0, lhs.row(), lhs.col()), lhs);
+  if (pad_rhs)
+    Matrix::copy(b.view().block(0, 0, rhs.row(), rhs.col()), rhs);
+  ConstMatrixView a_view = pad_lhs ? a.view() : lhs.view();
+  ConstMatrixView b_view = pad_rhs ? b.view() : rhs.view();
+  if ((m.row() == power) && (m.col() == power)) {
+    multiply(m, a_view, b_view);
+  } else {
+    Matrix c(power, power);
+    multiply(c, a_view, b_view);
+    Matrix::copy(m, c.view().block(0, 0, m.row(), m.col()));
   }
-#ifdef PARALLEL_STRASSEN
-#pragma message "parellelized Strassen algorithm implementation"
-#pragma message "Undefine PARALLEL_STRASSEN to disable parallelization"
-  std::future<Matrix> f1 = std::async(std::launch::async, Matrix::calculate_p1, std::cref(a_1_1), std::cref(a_2_2), std::cref(b_1_1), std::cref(b_2_2));
-  std::future<Matrix> f2 = std::async(std::launch::async, Matrix::calculate_p2, std::cref(a_2_1), std::cref(a_2_2), std::cref(b_1_1));
-  std::future<Matrix> f3 = std::async(std::launch::async, Matrix::calculate_p3, std::cref(a_1_1), std::cref(b_1_2), std::cref(b_2_2));
-  std::future<Matrix> f4 = std::async(std::launch::async, Matrix::calculate_p4, std::cref(a_2_2), std::cref(b_2_1), std::cref(b_1_1));
-  std::future<Matrix> f5 = std::async(std::launch::async, Matrix::calculate_p5, std::cref(a_1_1), std::cref(a_1_2), std::cref(b_2_2));
-  std::future<Matrix> f6 = std::async(std::launch::async, Matrix::calculate_p6, std::cref(a_2_1), std::cref(a_1_1), std::cref(b_1_1), std::cref(b_1_2));
-  std::future<Matrix> f7 = std::async(std::launch::async, Matrix::calculate_p7, std::cref(a_1_2), std::cref(a_2_2), std::cref(b_2_1), std::cref(b_2_2));
-  f1.wait();
-  f2.wait();
-  f3.wait();
-  f4.wait();
-  f5.wait();
-  f6.wait();
-  f7.wait();
-  Matrix p_1(f1.get());
-  Matrix p_2(f2.get());
-  Matrix p_3(f3.get());
-  Matrix p_4(f4.get());
-  Matrix p_5(f5.get());
-  Matrix p_6(f6.get());
-  Matrix p_7(f7.get());
-#else
-#pragma message "Non-parellelized Strassen algorithm implementation"
-#pragma message "Define PARALLEL_STRASSEN to enable parallelization"
-  Matrix p_1((a_1_1 + a_2_2) * (b_1_1 + b_2_2));
-  Matrix p_2((a_2_1 + a_2_2) * b_1_1);
-  Matrix p_3(a_1_1 * (b_1_2 - b_2_2));
-  Matrix p_4(a_2_2 * (b_2_1 - b_1_1));
-  Matrix p_5((a_1_1 + a_1_2) * b_2_2);
-  Matrix p_6((a_2_1 - a_1_1) * (b_1_1 + b_1_2));
-  Matrix p_7((a_1_2 - a_2_2) * (b_2_1 + b_2_2));
-#endif
-
-  Matrix c_1_1(p_1 + p_4 - p_5 + p_7);
-  Matrix c_1_2(p_3 + p_5);
-  Matrix c_2_1(p_2 + p_4);
-  Matrix c_2_2(p_1 - p_2 + p_3 + p_6);
+  return m;
+}
 
-  Matrix c(power, power);
+Matrix Matrix::multiply_strassen(const Matrix& lhs, const Matrix& rhs) {
+  return multiply_strassen(lhs, rhs, tuning());
+}
 
-  for (size_t i = 0; i < half_size; ++i) {
-    for (size_t j = 0; j < half_size; ++j) {
-      c.set(i, j, c_1_1.get(i, j));
-      c.set(i, j + half_size, c_1_2.get(i, j));
-      c.set(i + half_size, j, c_2_1.get(i, j));
-      c.set(i + half_size, j + half_size, c_2_2.get(i, j));
-    }
+Matrix Matrix::multiply_strassen(const Matrix& lhs, const Matrix& rhs, const Tuning& tuning) {
+  if (lhs.col_ != rhs.row_) {
+    std::stringstream msg;
+    msg << "Matrix::multiply_strassen: Column number of first matrix should be equal to row number of the second matrix ("
+        << lhs.col_ << " and " << rhs.row_ << " provided)";
+    throw std::length_error(msg.str());
   }
-  c.resize(lhs.row_, rhs.col_);
-  return c;
+  Matrix m(lhs.row_, rhs.col_);
+  if ((m.row_ == 0) || (m.col_ == 0) || (lhs.col_ == 0))
+    return m;
+  std::shared_ptr<ThreadPool> pool(acquire_pool());
+  strassen(m, lhs, rhs, PackedStore::Assign, pool.get(), tuning, 0);
+  return m;
+}
+
+Matrix Matrix::multiply_winograd(const Matrix& lhs, const Matrix& rhs) {
+  Tuning t = tuning();
+  return multiply_padded("Matrix::multiply_winograd", lhs, rhs,
+                         [&t](MatrixView c, ConstMatrixView a, ConstMatrixView b) {
+                           std::vector<int8_t> workspace(winograd_workspace_size(a.row(), t.crossover));
+                           winograd(c, a, b, workspace.data(), t);
+                         });
 }
@@ -1,23 +1,164 @@
 #ifndef MATRIX_STRASSEN_H
 #define MATRIX_STRASSEN_H
 
+#include <algorithm>
 #include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <type_traits>
+#include <utility>
 
 #include <stdint.h>
 
-class Matrix {
+#include "basic_matrix.h"
+
+class ThreadPool;
+enum class PackedStore;
+template <typename Lhs, typename Rhs, bool Subtract> class MatrixExpr;
+
+/**
+ * Non-owning read-only view of a block of packed matrix data:
+ * pointer to the first byte of the first row, sizes and distance between rows in bytes.
+ * Blocks start at byte boundaries, so column offset of a block is a multiple of 4.
+ * The view is valid while the viewed matrix is alive and not resized
+ */
+class ConstMatrixView {
+public:
+  ConstMatrixView(const Matrix& m);
+  ConstMatrixView(const int8_t* data, size_t row, size_t col, size_t stride)
+                 :data_(data), row_(row), col_(col), stride_(stride) {}
+  /**
+   * View of the block [row, row + rows) x [col, col + cols)
+   * Throws std::invalid_argument if col is not a multiple of 4
+   * and std::out_of_range if the block does not fit into the view
+   */
+  ConstMatrixView block(size_t row, size_t col, size_t rows, size_t cols) const;
+  inline uint8_t get(size_t i, size_t j) const {
+    return (data_[i * stride_ + j / 4] >> ((j % 4) * 2)) & 0x03;
+  }
+  //! Pointer to the first byte of i-th row
+  inline const int8_t* row_data(size_t i) const {
+    return data_ + i * stride_;
+  }
+  inline size_t row() const {
+    return row_;
+  }
+  inline size_t col() const {
+    return col_;
+  }
+  inline size_t stride() const {
+    return stride_;
+  }
+private:
+  const int8_t* data_;
+  size_t row_;
+  size_t col_;
+  size_t stride_;
+};
+
+/**
+ * Non-owning view of a block of packed matrix data which allows modification.
+ * Elements of the matrix outside of the block are never changed through the view
+ */
+class MatrixView {
+public:
+  MatrixView(Matrix& m);
+  MatrixView(int8_t* data, size_t row, size_t col, size_t stride)
+            :data_(data), row_(row), col_(col), stride_(stride) {}
+  operator ConstMatrixView() const {
+    return ConstMatrixView(data_, row_, col_, stride_);
+  }
+  //! The same as ConstMatrixView::block()
+  MatrixView block(size_t row, size_t col, size_t rows, size_t cols) const;
+  inline uint8_t get(size_t i, size_t j) const {
+    return (data_[i * stride_ + j / 4] >> ((j % 4) * 2)) & 0x03;
+  }
+  inline void set(size_t i, size_t j, unsigned value) const {
+    size_t shift = (j % 4) * 2;
+    int8_t& byte = data_[i * stride_ + j / 4];
+    byte = (byte & ~(0x03 << shift)) | ((value & 0x03) << shift);
+  }
+  inline int8_t* row_data(size_t i) const {
+    return data_ + i * stride_;
+  }
+  inline size_t row() const {
+    return row_;
+  }
+  inline size_t col() const {
+    return col_;
+  }
+  inline size_t stride() const {
+    return stride_;
+  }
+private:
+  int8_t* data_;
+  size_t row_;
+  size_t col_;
+  size_t stride_;
+};
+
+/**
+ * Matrix of 2-bit elements modulo 4: the specialization of BasicMatrix
+ * with Strassen multiplication, SIMD row kernels and the rest of the library
+ */
+template <>
+class BasicMatrix<2> {
 public:
+  typedef PackedWord<2> Word;
+  //! Multiplication algorithms
+  enum class Algorithm {
+    Trivial,
+    M4RM,
+    Strassen,
+    Winograd
+  };
+  /**
+   * Host specific parameters of the multiplication, see calibrate()
+   */
+  struct Tuning {
+    //! Matrices not larger than crossover are multiplied by base_algorithm
+    size_t crossover;
+    Algorithm base_algorithm;
+    //! The same as set_parallel_limits() arguments
+    size_t parallel_max_depth;
+    size_t parallel_min_size;
+  };
+  //! Instruction sets of the packed row kernels
+  enum class SimdLevel {
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512
+  };
   /**
    * Creates Matrix object and fills it with provided data:
    * Matrix m({ {1, 2, 3}, {4, 5, 6} });
    * Throws std::length_error if some of rows in data have different size
    */
-  Matrix(std::initializer_list<std::initializer_list<int8_t> > data);
-  Matrix(size_t row, size_t col);
-  Matrix(const Matrix& other);
-  ~Matrix();
+  BasicMatrix(std::initializer_list<std::initializer_list<int> > data);
+  BasicMatrix(size_t row, size_t col);
+  BasicMatrix(const Matrix& other);
+  //! Takes data of other, other becomes 0x0 matrix
+  BasicMatrix(Matrix&& other) noexcept;
+  //! Creates Matrix object with a copy of the viewed elements
+  explicit BasicMatrix(ConstMatrixView view);
+  //! Lifts GF(2) matrix to Z/4: elements keep their values 0 and 1
+  explicit BasicMatrix(const BitMatrix& m);
+  //! Evaluates chain of additions and subtractions in one pass
+  template <typename Lhs, typename Rhs, bool Subtract>
+  BasicMatrix(const MatrixExpr<Lhs, Rhs, Subtract>& expr);
+  ~BasicMatrix();
   Matrix& operator=(const Matrix& rhs);
-  bool operator==(const Matrix& rhs) const;
+  Matrix& operator=(Matrix&& rhs) noexcept;
+  /**
+   * Evaluates chain of additions and subtractions in one pass.
+   * The expression may contain this matrix itself
+   */
+  template <typename Lhs, typename Rhs, bool Subtract>
+  Matrix& operator=(const MatrixExpr<Lhs, Rhs, Subtract>& expr);
+  //! Expressions are compared after evaluation
+  friend bool operator==(const Matrix& lhs, const Matrix& rhs);
   /**
    * Matrix multiplication
    * Throws std::length_error if column number of this matrix
@@ -25,15 +166,48 @@ public:
    */
   Matrix operator*(const Matrix& rhs) const;
   /**
-   * Matrix addition
-   * Sizes of matrices should be equal, otherwise std::length_error is thrown
+   * Matrix addition and subtraction, evaluated at once into the new matrix.
+   * Sizes of matrices should be equal, otherwise std::length_error is thrown.
+   * Lazy expressions are built only when one of the operands is a view, see MatrixExpr
    */
   Matrix operator+(const Matrix& rhs) const;
+  Matrix operator-(const Matrix& rhs) const;
   /**
-   * Matrix subtraction
-   * Sizes of matrices should be equal, otherwise std::length_error is thrown
+   * k-th power of the square matrix (identity for k = 0) by repeated squaring:
+   * squares and products are accumulated by gemm() into a spare buffer which is
+   * swapped with the operand, so only three matrices are allocated.
+   * Powers of a matrix over Z/4 are eventually periodic: exponents beyond
+   * the period common to all matrices of this size are reduced, and squaring stops
+   * when the squares repeat (the square became idempotent).
+   * Throws std::length_error if the matrix is not square
+   */
+  Matrix pow(uint64_t k) const;
+  //! [size x size] identity matrix
+  static Matrix identity(size_t size);
+  /*
+   * Linear algebra over Z/4 by blocked elimination of the packed rows:
+   * columns are eliminated modulo 2 with unit pivots (PLE over GF(2) carried in Z/4),
+   * then the remaining rows, which are even, are eliminated with pivots equal to 2.
+   * Panels of columns are reduced by row operations and the trailing rows are updated
+   * by gemm(), as well as the back substitution, so the cost grows as of the multiplication
    */
-  Matrix operator-(const Matrix& rhs) const;
+  /**
+   * Number of nonzero invariant factors of the Smith normal form (ones and twos),
+   * i.e. the least number of generators of the row module.
+   * The number of ones is the rank modulo 2
+   */
+  size_t rank() const;
+  /**
+   * Some x such that this * x = b, b may have several columns (x has the same number of them).
+   * Throws std::length_error if row numbers of the matrix and b differ
+   * and std::runtime_error if the system has no solution
+   */
+  Matrix solve(const Matrix& b) const;
+  /**
+   * Throws std::length_error if the matrix is not square and std::runtime_error if it is singular
+   * (a matrix is invertible over Z/4 if and only if it is invertible modulo 2)
+   */
+  Matrix inverse() const;
   /**
    * Set matrix size to [row, col]
    * If new size is less than old, matrix data will be truncated to fit new size;
@@ -42,37 +216,263 @@ public:
   void resize(size_t row, size_t col);
   //! Zeroize data
   void clear();
+  //! Bytes between the starts of rows with col elements: packed row rounded up to MATRIX_ROW_ALIGNMENT
+  static size_t row_stride(size_t col);
   void dump_size() const;
   void dump_raw_bytes() const;
   void dump() const;
+  /**
+   * Writes binary file with a header and the packed rows (see matrix_file.h),
+   * rows are written by one bulk write.
+   * Throws std::runtime_error if the file can not be written
+   */
+  void save(const std::string& path) const;
+  /**
+   * Reads file written by save() with bulk reads and checks its checksum,
+   * use MappedMatrix to work with the file without reading it.
+   * Throws std::runtime_error if the file can not be read or is malformed
+   */
+  static Matrix load(const std::string& path);
+  /**
+   * Out-of-core multiplication of files written by save(): the product is written into out_path.
+   * Operands and the result are streamed by square tiles, so that no more than memory_budget bytes
+   * are used for the tiles and their products: the result tile, the operands of the current product,
+   * tiles read ahead in the background, the packed_gemm workspace and a cache of the least recently used tiles.
+   * Tile products are ordered so that consecutive ones share an operand tile.
+   * If verify is true, checksums of the operands are checked first by a streaming pass over each file.
+   * Throws std::length_error if sizes of the operands do not match,
+   * std::invalid_argument if the budget is too small for the smallest tiles or out_path is one of the operand files,
+   * and std::runtime_error if some of the files can not be read or written or checksum of an operand does not match
+   */
+  static void multiply_out_of_core(const std::string& lhs_path, const std::string& rhs_path,
+                                   const std::string& out_path, size_t memory_budget, bool verify = true);
   /**
    * Get element in i-th row and j-th column
    * i should be [0..row), j should be [0..col)
    */
-  inline int8_t get(size_t i, size_t j) const {
+  inline uint8_t get(size_t i, size_t j) const {
     size_t n_byte = j / 4;
     size_t shift = (j % 4) * 2;
-    return (data_[i][n_byte] >> shift) & 0x03;
+    return (data_[i * stride_ + n_byte] >> shift) & 0x03;
   }
 
   /**
-   * Set element in i-th row and j-th column
+   * Set element in i-th row and j-th column, value is taken modulo 4
    * i should be [0..row), j should be [0..col)
    */
-  inline void set(size_t i, size_t j, int8_t value) {
+  inline void set(size_t i, size_t j, unsigned value) {
     size_t n_byte = j / 4;
     size_t shift = (j % 4) * 2;
-    int8_t old_byte = data_[i][n_byte];
+    int8_t old_byte = data_[i * stride_ + n_byte];
     int8_t mask = ~(0x03 << shift);
-    value = (value & 0x03) << shift;
-    data_[i][n_byte] = (old_byte & mask) | value;
+    data_[i * stride_ + n_byte] = (old_byte & mask) | ((value & 0x03) << shift);
+  }
+  /**
+   * Pointer to the first word of i-th row: (col() + Word::lanes - 1) / Word::lanes words
+   * with 32 elements each, padding lanes are zero. The same as BasicMatrix::row_words()
+   */
+  inline uint64_t* row_words(size_t i) {
+    return reinterpret_cast<uint64_t*>(row_data(i));
+  }
+  inline const uint64_t* row_words(size_t i) const {
+    return reinterpret_cast<const uint64_t*>(row_data(i));
   }
 
+  /**
+   * Bulk import and export of elements stored one per byte in row-major array
+   * with ld bytes between the starts of rows (col() if 0). Rows are packed and unpacked
+   * by the packed kernels. Imported values are taken modulo 4, exported ones are in [0, 3].
+   * Throws std::invalid_argument if ld is less than col()
+   */
+  void set_elements(const uint8_t* src, size_t ld = 0);
+  void set_elements(const int8_t* src, size_t ld = 0);
+  void get_elements(uint8_t* dst, size_t ld = 0) const;
+  void get_elements(int8_t* dst, size_t ld = 0) const;
+  //! The same for col() elements of i-th row, throw std::out_of_range if i >= row()
+  void set_row(size_t i, const uint8_t* src);
+  void set_row(size_t i, const int8_t* src);
+  void get_row(size_t i, uint8_t* dst) const;
+  void get_row(size_t i, int8_t* dst) const;
+  /**
+   * Copy of i-th row in the packed layout: (col() + 3) / 4 bytes, 4 elements per byte
+   * starting from the lowest bits. Bits beyond col() elements are ignored on import.
+   * Throw std::out_of_range if i >= row()
+   */
+  void set_packed_row(size_t i, const int8_t* src);
+  void get_packed_row(size_t i, int8_t* dst) const;
   size_t row() const;
   size_t col() const;
+  //! View of the whole matrix
+  MatrixView view();
+  ConstMatrixView view() const;
+  /**
+   * Copy of the block [row, row + rows) x [col, col + cols)
+   * Unlike views, the block may start at any column: rows are copied with word-level shifts
+   * Throws std::out_of_range if the block does not fit into the matrix
+   */
+  Matrix block(size_t row, size_t col, size_t rows, size_t cols) const;
+  /**
+   * Element-wise operations on views: dst = lhs + rhs, dst = lhs - rhs, dst = src
+   * Sizes of all arguments should be equal, otherwise std::length_error is thrown;
+   * dst may be the same block as one of the sources
+   */
+  static void add(MatrixView dst, ConstMatrixView lhs, ConstMatrixView rhs);
+  static void subtract(MatrixView dst, ConstMatrixView lhs, ConstMatrixView rhs);
+  static void copy(MatrixView dst, ConstMatrixView src);
+  /**
+   * dst = expr, evaluated in one pass over the rows.
+   * Sizes should be equal, otherwise std::length_error is thrown;
+   * the expression may contain dst itself
+   */
+  template <typename Lhs, typename Rhs, bool Subtract>
+  static void assign(MatrixView dst, const MatrixExpr<Lhs, Rhs, Subtract>& expr);
+  /**
+   * Transposition by blocks of 32x32 elements: rows of a block are loaded as words,
+   * transposed with word shuffles by the packed kernels and stored as whole words
+   */
   Matrix transposed() const;
+  /**
+   * Transposes square matrix in place exchanging blocks symmetric about the diagonal.
+   * Other matrices are replaced with transposed()
+   */
+  Matrix& transpose();
+  //! Reduction of the elements modulo 2 (the low bits of the packed elements)
+  BitMatrix mod2() const;
   static Matrix multiply_trivial(const Matrix& lhs, const Matrix& rhs);
+  /**
+   * Method of Four Russians: rows of lhs are used as indices into precomputed
+   * tables of linear combinations of rhs rows
+   */
+  static Matrix multiply_m4rm(const Matrix& lhs, const Matrix& rhs);
+  /**
+   * Product of matrix and column (rhs has one column) or row and matrix (lhs has one row)
+   * computed with dot products or row updates of packed data, large ones in parallel.
+   * Used by operator* for such shapes.
+   * Throws std::invalid_argument if none of the operands is a vector
+   */
+  static Matrix multiply_vector(const Matrix& lhs, const Matrix& rhs);
+  /**
+   * Fused multiply-accumulate in place: c += sign * op(a) * op(b), sign is 1 or -1,
+   * op(x) is x transposed if the corresponding flag is set and x otherwise.
+   * Nothing is allocated for the result; transposed operands are read directly
+   * by the base case algorithm and copied only for the recursion.
+   * Large products use Strassen recursion when operator* uses a recursive algorithm.
+   * Throws std::invalid_argument for other sign values and
+   * std::length_error if sizes of the operands and c do not match
+   */
+  static void gemm(MatrixView c, ConstMatrixView a, ConstMatrixView b, int sign = 1,
+                   bool transpose_a = false, bool transpose_b = false);
+  /**
+   * out[i] = lhs[i] * rhs[i] for i in [0, count).
+   * Outputs keep their buffers if they already have the size of the product,
+   * otherwise they are reallocated; outputs should not be the operands.
+   * Products are spread across the threads of Strassen algorithm. Products larger than the crossover
+   * are computed by Strassen recursion in place of the outputs when operator* uses a recursive algorithm,
+   * the rest by the base case algorithm with packing buffers reused by their thread.
+   * Unlike operator*, vectors and sparse operands are not detected: all products are dense.
+   * Throws std::length_error if sizes of some operands do not match (outputs are not changed then)
+   */
+  static void multiply_batch(const Matrix* lhs, const Matrix* rhs, Matrix* out, size_t count);
+  /**
+   * Strassen algorithm on the real dimensions of the operands:
+   * no padding to the power of 2, rectangular operands are split along the longest dimension
+   */
   static Matrix multiply_strassen(const Matrix& lhs, const Matrix& rhs);
+  /**
+   * Strassen-Winograd variant: 7 products and 15 additions per level,
+   * computed in place with two temporaries per level.
+   * All temporaries are taken from one scratch buffer allocated up front,
+   * the levels are computed sequentially
+   */
+  static Matrix multiply_winograd(const Matrix& lhs, const Matrix& rhs);
+  /**
+   * Algorithm used by operator*.
+   * Strassen by default (Trivial if TRIVIAL_ALGORITHM is defined)
+   */
+  static Algorithm algorithm();
+  static void set_algorithm(Algorithm algorithm);
+  /**
+   * Algorithm used for matrices not larger than strassen_crossover()
+   * when operator* uses Strassen or Winograd algorithm (Trivial by default).
+   * Throws std::invalid_argument for Algorithm::Strassen and Algorithm::Winograd
+   */
+  static Algorithm base_algorithm();
+  static void set_base_algorithm(Algorithm algorithm);
+  /**
+   * Instruction set of the kernels used by arithmetic operations.
+   * By default the best one supported by CPU is chosen at the first use,
+   * environment variable QMATRIX_SIMD (scalar, sse2, avx2, avx512) overrides it
+   */
+  static SimdLevel simd_level();
+  /**
+   * Forces kernels for given instruction set (e.g. for testing)
+   * Throws std::invalid_argument if CPU does not support it
+   */
+  static void set_simd_level(SimdLevel level);
+  static bool simd_supported(SimdLevel level);
+  static const char* simd_level_name(SimdLevel level);
+  /**
+   * Number of threads used by Strassen algorithm, including the calling one.
+   * Hardware concurrency by default (1 if PARALLEL_STRASSEN is not defined),
+   * environment variable QMATRIX_THREADS overrides it; 1 disables parallelization.
+   * Multiplications which are already running keep using the old threads.
+   * Throws std::invalid_argument for 0
+   */
+  static size_t thread_count();
+  static void set_thread_count(size_t count);
+  /**
+   * Sub-products of Strassen recursion are computed in parallel only on
+   * the first max_depth levels and for blocks of at least min_size rows
+   */
+  static size_t parallel_max_depth();
+  static size_t parallel_min_size();
+  static void set_parallel_limits(size_t max_depth, size_t min_size);
+  /**
+   * Strassen and Winograd recursions switch to the base case algorithm
+   * for blocks not larger than this size (STRASSEN_MATRIX_SIZE by default).
+   * Throws std::invalid_argument for sizes less than 8
+   */
+  static size_t strassen_crossover();
+  static void set_strassen_crossover(size_t size);
+  /**
+   * operator* multiplies lhs as SparseMatrix (see sparse_matrix.h) if the share
+   * of its nonzero elements is not more than this density (SPARSE_DENSITY by default).
+   * Nonzeros are counted only until the limit is exceeded, so dense operands pay a little.
+   * 0 disables the check. Throws std::invalid_argument for values outside of [0, 1]
+   */
+  static double sparse_density();
+  static void set_sparse_density(double density);
+  /**
+   * All tuned parameters at once.
+   * At the first multiplication (or access to any of them) they are loaded from the file
+   * named by QMATRIX_TUNING_FILE environment variable if it is set and the file exists,
+   * otherwise defaults are kept until load_tuning() or set_tuning().
+   * If that file is malformed, the first call throws std::runtime_error
+   */
+  static Tuning tuning();
+  static void set_tuning(const Tuning& tuning);
+  /**
+   * Path of the tuning file: environment variable QMATRIX_TUNING_FILE
+   * or QMATRIX_TUNING_FILE macro ("qmatrix.tuning" by default).
+   * Only the file named by the environment variable is loaded implicitly
+   */
+  static const char* default_tuning_path();
+  /**
+   * Applies tuning from the file written by save_tuning().
+   * Returns false if the file can not be opened,
+   * throws std::runtime_error if its content is malformed
+   */
+  static bool load_tuning(const std::string& path);
+  //! Throws std::runtime_error if the file can not be written
+  static void save_tuning(const std::string& path, const Tuning& tuning);
+  /**
+   * Measures multiplication of random [size x size] matrices on this host
+   * with candidate crossover sizes, base case algorithms and parallel limits
+   * and returns the fastest combination (median of repeats runs).
+   * Candidates are passed to the measured multiplications directly,
+   * so the current tuning is not changed even temporarily
+   */
+  static Tuning calibrate(size_t size = 1024, size_t repeats = 3);
 #ifdef TEST_MODE
   /*
    * For the tesing this functions declared as static methods.
@@ -82,21 +482,315 @@ public:
   static int8_t packed_sum(int8_t a, int8_t b);
   static int8_t packed_diff(int8_t a, int8_t b);
   static int8_t packed_multiply(int8_t a, int8_t b);
+  /*
+   * The same operations applied to 32 packed elements of a 64-bit word
+   */
+  static uint64_t packed_sum_word(uint64_t a, uint64_t b);
+  static uint64_t packed_diff_word(uint64_t a, uint64_t b);
+  static uint64_t packed_multiply_word(uint64_t a, uint64_t b);
 #endif
 private:
-  static Matrix calculate_p1(const Matrix& a11, const Matrix& a22, const Matrix& b11, const Matrix& b22);
-  static Matrix calculate_p2(const Matrix& a21, const Matrix& a22, const Matrix& b11);
-  static Matrix calculate_p3(const Matrix& a11, const Matrix& b12, const Matrix& b22);
-  static Matrix calculate_p4(const Matrix& a22, const Matrix& b21, const Matrix& b11);
-  static Matrix calculate_p5(const Matrix& a11, const Matrix& a12, const Matrix& b22);
-  static Matrix calculate_p6(const Matrix& a21, const Matrix& a11, const Matrix& b11, const Matrix& b12);
-  static Matrix calculate_p7(const Matrix& a12, const Matrix& a22, const Matrix& b21, const Matrix& b22);
+  friend class ConstMatrixView;
+  friend class MatrixView;
+  template <typename Lhs, typename Rhs, bool Subtract> friend class MatrixExpr;
+  /*
+   * Access to operands of expressions:
+   * operand_data() returns n_bytes bytes of i-th row starting from offset,
+   * leaves return pointer to their own data, expressions are evaluated into buffer;
+   * operand_overlaps() checks if any leaf data lies in [begin, end)
+   */
+  static const int8_t* operand_data(const Matrix& m, size_t i, size_t offset, size_t n_bytes, int8_t* buffer);
+  static const int8_t* operand_data(const ConstMatrixView& v, size_t i, size_t offset, size_t n_bytes, int8_t* buffer);
+  template <typename Lhs, typename Rhs, bool Subtract>
+  static const int8_t* operand_data(const MatrixExpr<Lhs, Rhs, Subtract>& e, size_t i, size_t offset, size_t n_bytes, int8_t* buffer);
+  static bool operand_overlaps(const Matrix& m, const int8_t* begin, const int8_t* end);
+  static bool operand_overlaps(const ConstMatrixView& v, const int8_t* begin, const int8_t* end);
+  template <typename Lhs, typename Rhs, bool Subtract>
+  static bool operand_overlaps(const MatrixExpr<Lhs, Rhs, Subtract>& e, const int8_t* begin, const int8_t* end);
+  //! multiply_strassen() with the given parameters instead of the current ones
+  static Matrix multiply_strassen(const Matrix& lhs, const Matrix& rhs, const Tuning& tuning);
+  //! Loads tuning file at the first call
+  static void load_default_tuning();
+  //! Returns false if the file can not be opened
+  static bool read_tuning(const std::string& path, Tuning& tuning);
+  //! Stores tuning without loading of the tuning file
+  static void store_tuning(const Tuning& tuning);
+  //! Throw std::invalid_argument with func name for bad tuning values
+  static void check_crossover(const char* func, size_t size);
+  static void check_base_algorithm(const char* func, Algorithm algorithm);
+  //! Throws std::length_error with func name if sizes differ
+  static void check_sizes(const char* func, size_t row, size_t col, size_t other_row, size_t other_col);
+  //! Packed row kernels of the current instruction set: dst = a + b and dst = a - b
+  static void sum_bytes(int8_t* dst, const int8_t* a, const int8_t* b, size_t n_bytes);
+  static void diff_bytes(int8_t* dst, const int8_t* a, const int8_t* b, size_t n_bytes);
+  /**
+   * Strassen recursion on blocks of any size: c = a * b, c += a * b or c -= a * b depending on store.
+   * Quadrants are views of the operands, products p6 and p7 are accumulated directly
+   * into the quadrants of c, p1..p5 are written into temporary matrices and combined in place.
+   * Odd rows and columns which do not fit into the quadrants are peeled off
+   * and multiplied by the base case algorithm, blocks which are much longer
+   * in one dimension are split by split_product().
+   * Sub-products are submitted to pool (if any) depending on depth and parallel limits
+   */
+  static void strassen(MatrixView c, ConstMatrixView a, ConstMatrixView b, PackedStore store,
+                       ThreadPool* pool, const Tuning& tuning, size_t depth);
+  /**
+   * Splits c = a * b into two products by halving the longest of m, n
+   * (and k if split_k is true, the second half is accumulated into c then)
+   * and continues the recursion on them
+   */
+  static void split_product(MatrixView c, ConstMatrixView a, ConstMatrixView b, bool split_k, PackedStore store,
+                            ThreadPool* pool, const Tuning& tuning, size_t depth, bool parallel);
+  /**
+   * Winograd recursion on square blocks of power of 2 size: c = a * b
+   * Temporaries of all levels are placed in workspace of winograd_workspace_size() bytes
+   */
+  static void winograd(MatrixView c, ConstMatrixView a, ConstMatrixView b, int8_t* workspace, const Tuning& tuning);
+  //! c = a * b (or c += a * b, c -= a * b) with the base case algorithm
+  static void multiply_base(MatrixView c, ConstMatrixView a, ConstMatrixView b, PackedStore store, const Tuning& tuning);
+  static void calculate_p1(MatrixView p, ConstMatrixView a11, ConstMatrixView a22, ConstMatrixView b11, ConstMatrixView b22,
+                           ThreadPool* pool, const Tuning& tuning, size_t depth);
+  static void calculate_p2(MatrixView p, ConstMatrixView a21, ConstMatrixView a22, ConstMatrixView b11,
+                           ThreadPool* pool, const Tuning& tuning, size_t depth);
+  static void calculate_p3(MatrixView p, ConstMatrixView a11, ConstMatrixView b12, ConstMatrixView b22,
+                           ThreadPool* pool, const Tuning& tuning, size_t depth);
+  static void calculate_p4(MatrixView p, ConstMatrixView a22, ConstMatrixView b21, ConstMatrixView b11,
+                           ThreadPool* pool, const Tuning& tuning, size_t depth);
+  static void calculate_p5(MatrixView p, ConstMatrixView a11, ConstMatrixView a12, ConstMatrixView b22,
+                           ThreadPool* pool, const Tuning& tuning, size_t depth);
+  //! p6 and p7 are accumulated into p according to store
+  static void calculate_p6(MatrixView p, ConstMatrixView a21, ConstMatrixView a11, ConstMatrixView b11, ConstMatrixView b12,
+                           PackedStore store, ThreadPool* pool, const Tuning& tuning, size_t depth);
+  static void calculate_p7(MatrixView p, ConstMatrixView a12, ConstMatrixView a22, ConstMatrixView b21, ConstMatrixView b22,
+                           PackedStore store, ThreadPool* pool, const Tuning& tuning, size_t depth);
+  //! Throws std::out_of_range with func name if i >= row_
+  void check_row_index(const char* func, size_t i) const;
+  //! Throws std::invalid_argument with func name if ld < col_
+  void check_leading_dimension(const char* func, size_t ld) const;
+  /**
+   * Allocates storage for row_ x col_ matrix and sets stride_
+   * If zeroize is true, allocated memory is filled with zeroes
+   */
+  void allocate(bool zeroize);
+  //! Size of the whole data buffer in bytes
+  inline size_t storage_size() const {
+    return row_ * stride_;
+  }
+  //! Pointer to the first byte of i-th row
+  inline int8_t* row_data(size_t i) {
+    return data_ + i * stride_;
+  }
+  inline const int8_t* row_data(size_t i) const {
+    return data_ + i * stride_;
+  }
   //! Rows number
   size_t row_;
   //! Columns number
   size_t col_;
-  //! Pointer to matrix data
-  int8_t** data_;
+  /**
+   * Distance between starts of the adjacent rows in bytes.
+   * Packed row size is padded up to MATRIX_ROW_ALIGNMENT bytes,
+   * padding bits are always zero
+   */
+  size_t stride_;
+  /**
+   * Pointer to matrix data: single MATRIX_DATA_ALIGNMENT-aligned buffer
+   * with all rows placed one after another
+   */
+  int8_t* data_;
+};
+
+//! Rows of expressions are evaluated by chunks of this size, so that temporaries stay in L1 cache
+#define MATRIX_EXPR_CHUNK 1024
+
+//! Types which start lazy expressions: views and the expressions themselves
+template <typename T> struct IsLazyOperand : std::false_type {};
+template <> struct IsLazyOperand<ConstMatrixView> : std::true_type {};
+template <> struct IsLazyOperand<MatrixView> : std::true_type {};
+template <typename Lhs, typename Rhs, bool Subtract>
+struct IsLazyOperand<MatrixExpr<Lhs, Rhs, Subtract> > : std::true_type {};
+
+//! Types which can be used as operands of matrix expressions
+template <typename T> struct IsMatrixOperand : IsLazyOperand<T> {};
+template <> struct IsMatrixOperand<Matrix> : std::true_type {};
+
+//! Operators of expressions with at least one lazy operand
+template <typename Lhs, typename Rhs>
+struct IsMatrixExpression : std::integral_constant<bool, IsMatrixOperand<Lhs>::value && IsMatrixOperand<Rhs>::value &&
+                                                         (IsLazyOperand<Lhs>::value || IsLazyOperand<Rhs>::value)> {};
+
+/*
+ * Matrices are referenced by expressions, views and sub-expressions are copied:
+ * they are small and may be temporaries of the enclosing expression
+ */
+template <typename T> struct MatrixOperandStorage {
+  typedef T type;
 };
+template <> struct MatrixOperandStorage<Matrix> {
+  typedef const Matrix& type;
+};
+template <> struct MatrixOperandStorage<MatrixView> {
+  typedef ConstMatrixView type;
+};
+
+/**
+ * Lazy sum (or difference) of views, matrices or other expressions, at least one operand is a view
+ * or an expression (sums of two matrices are Matrix objects, see Matrix::operator+).
+ * Nothing is computed until the expression is assigned to a Matrix or passed to Matrix::assign():
+ * a chain like c.view() + p1 + p4 - p5 is then evaluated in one pass by chunks of rows,
+ * without intermediate matrices. This is how Strassen recursion combines its products.
+ * Expressions reference their operands like views do and are valid while the operands are alive,
+ * temporary matrices can not be their operands
+ */
+template <typename Lhs, typename Rhs, bool Subtract>
+class MatrixExpr {
+public:
+  //! Throws std::length_error if sizes of operands differ
+  MatrixExpr(const Lhs& lhs, const Rhs& rhs) :lhs_(lhs), rhs_(rhs) {
+    Matrix::check_sizes(Subtract ? "Matrix::operator-" : "Matrix::operator+",
+                        lhs.row(), lhs.col(), rhs.row(), rhs.col());
+  }
+  size_t row() const {
+    return lhs_.row();
+  }
+  size_t col() const {
+    return lhs_.col();
+  }
+  /**
+   * Evaluates n_bytes <= MATRIX_EXPR_CHUNK bytes of i-th row starting from offset into buffer.
+   * The left operand is evaluated in the buffer itself, the right one in a temporary chunk
+   */
+  const int8_t* eval(size_t i, size_t offset, size_t n_bytes, int8_t* buffer) const {
+    const int8_t* lhs = Matrix::operand_data(lhs_, i, offset, n_bytes, buffer);
+    int8_t chunk[MATRIX_EXPR_CHUNK];
+    const int8_t* rhs = Matrix::operand_data(rhs_, i, offset, n_bytes, chunk);
+    if (Subtract)
+      Matrix::diff_bytes(buffer, lhs, rhs, n_bytes);
+    else
+      Matrix::sum_bytes(buffer, lhs, rhs, n_bytes);
+    return buffer;
+  }
+  bool overlaps(const int8_t* begin, const int8_t* end) const {
+    return Matrix::operand_overlaps(lhs_, begin, end) || Matrix::operand_overlaps(rhs_, begin, end);
+  }
+private:
+  typename MatrixOperandStorage<Lhs>::type lhs_;
+  typename MatrixOperandStorage<Rhs>::type rhs_;
+};
+
+/**
+ * Lazy addition of a view or an expression
+ * Sizes of operands should be equal, otherwise std::length_error is thrown
+ */
+template <typename Lhs, typename Rhs>
+typename std::enable_if<IsMatrixExpression<Lhs, Rhs>::value, MatrixExpr<Lhs, Rhs, false> >::type
+operator+(const Lhs& lhs, const Rhs& rhs) {
+  return MatrixExpr<Lhs, Rhs, false>(lhs, rhs);
+}
+
+/**
+ * Lazy subtraction of a view or an expression
+ * Sizes of operands should be equal, otherwise std::length_error is thrown
+ */
+template <typename Lhs, typename Rhs>
+typename std::enable_if<IsMatrixExpression<Lhs, Rhs>::value, MatrixExpr<Lhs, Rhs, true> >::type
+operator-(const Lhs& lhs, const Rhs& rhs) {
+  return MatrixExpr<Lhs, Rhs, true>(lhs, rhs);
+}
+
+//! Expressions would keep references to temporary matrices after they are destroyed
+template <typename Lhs>
+typename std::enable_if<IsLazyOperand<Lhs>::value>::type operator+(const Lhs&, Matrix&&) = delete;
+template <typename Rhs>
+typename std::enable_if<IsLazyOperand<Rhs>::value>::type operator+(Matrix&&, const Rhs&) = delete;
+template <typename Lhs>
+typename std::enable_if<IsLazyOperand<Lhs>::value>::type operator-(const Lhs&, Matrix&&) = delete;
+template <typename Rhs>
+typename std::enable_if<IsLazyOperand<Rhs>::value>::type operator-(Matrix&&, const Rhs&) = delete;
+
+inline Matrix Matrix::operator+(const Matrix& rhs) const {
+  return Matrix(MatrixExpr<Matrix, Matrix, false>(*this, rhs));
+}
+
+inline Matrix Matrix::operator-(const Matrix& rhs) const {
+  return Matrix(MatrixExpr<Matrix, Matrix, true>(*this, rhs));
+}
+
+inline const int8_t* Matrix::operand_data(const Matrix& m, size_t i, size_t offset, size_t, int8_t*) {
+  return m.row_data(i) + offset;
+}
+
+inline const int8_t* Matrix::operand_data(const ConstMatrixView& v, size_t i, size_t offset, size_t, int8_t*) {
+  return v.row_data(i) + offset;
+}
+
+template <typename Lhs, typename Rhs, bool Subtract>
+inline const int8_t* Matrix::operand_data(const MatrixExpr<Lhs, Rhs, Subtract>& e, size_t i, size_t offset,
+                                          size_t n_bytes, int8_t* buffer) {
+  return e.eval(i, offset, n_bytes, buffer);
+}
+
+inline bool Matrix::operand_overlaps(const Matrix& m, const int8_t* begin, const int8_t* end) {
+  return (m.data_ < end) && (begin < m.data_ + m.storage_size());
+}
+
+inline bool Matrix::operand_overlaps(const ConstMatrixView& v, const int8_t* begin, const int8_t* end) {
+  if ((v.row() == 0) || (v.col() == 0))
+    return false;
+  return (v.row_data(0) < end) && (begin < v.row_data(v.row() - 1) + (v.col() + 3) / 4);
+}
+
+template <typename Lhs, typename Rhs, bool Subtract>
+inline bool Matrix::operand_overlaps(const MatrixExpr<Lhs, Rhs, Subtract>& e, const int8_t* begin, const int8_t* end) {
+  return e.overlaps(begin, end);
+}
+
+template <typename Lhs, typename Rhs, bool Subtract>
+void Matrix::assign(MatrixView dst, const MatrixExpr<Lhs, Rhs, Subtract>& expr) {
+  check_sizes("Matrix::assign", dst.row(), dst.col(), expr.row(), expr.col());
+  if ((dst.row() == 0) || (dst.col() == 0))
+    return;
+  size_t n_bytes = (dst.col() + 3) / 4;
+  size_t tail = dst.col() % 4;
+  int8_t tail_mask = 0xFF >> (8 - 2 * tail);
+  // Results are written directly into dst unless the expression reads it
+  bool direct = !expr.overlaps(dst.row_data(0), dst.row_data(dst.row() - 1) + n_bytes);
+  int8_t chunk[MATRIX_EXPR_CHUNK];
+  for (size_t i = 0; i < dst.row(); ++i) {
+    int8_t* row = dst.row_data(i);
+    for (size_t offset = 0; offset < n_bytes; offset += MATRIX_EXPR_CHUNK) {
+      size_t count = std::min<size_t>(MATRIX_EXPR_CHUNK, n_bytes - offset);
+      // The last byte is merged with lanes of dst beyond its columns
+      bool partial = tail && (offset + count == n_bytes);
+      if (direct && !partial) {
+        expr.eval(i, offset, count, row + offset);
+        continue;
+      }
+      const int8_t* value = expr.eval(i, offset, count, chunk);
+      size_t full = partial ? count - 1 : count;
+      memcpy(row + offset, value, full);
+      if (partial)
+        row[offset + full] = (row[offset + full] & ~tail_mask) | (value[full] & tail_mask);
+    }
+  }
+}
+
+template <typename Lhs, typename Rhs, bool Subtract>
+Matrix::BasicMatrix(const MatrixExpr<Lhs, Rhs, Subtract>& expr)
+                   :row_(expr.row()), col_(expr.col()), stride_(0), data_(nullptr) {
+  allocate(true);
+  assign(*this, expr);
+}
+
+template <typename Lhs, typename Rhs, bool Subtract>
+Matrix& Matrix::operator=(const MatrixExpr<Lhs, Rhs, Subtract>& expr) {
+  if ((row_ != expr.row()) || (col_ != expr.col())) {
+    // Operands of other size can not share data with this matrix
+    Matrix m(expr);
+    return *this = std::move(m);
+  }
+  assign(*this, expr);
+  return *this;
+}
 
 #endif // MATRIX_STRASSEN_H
@@ -0,0 +1,182 @@
+#include <stdexcept>
+#include <sstream>
+#include <fstream>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "matrix_strassen.h"
+
+//! Format version written into the first meaningful line of tuning files
+#define QMATRIX_TUNING_VERSION 1
+
+static const char* base_algorithm_name(Matrix::Algorithm algorithm) {
+  return (algorithm == Matrix::Algorithm::M4RM) ? "m4rm" : "trivial";
+}
+
+static void throw_malformed(const std::string& path, size_t line, const std::string& what) {
+  std::stringstream msg;
+  msg << "Matrix::load_tuning: " << path << ":" << line << ": " << what;
+  throw std::runtime_error(msg.str());
+}
+
+/**
+ * Tuning file is a text file with "key value" lines, '#' starts a comment:
+ *   version 1
+ *   crossover 128
+ *   base_algorithm trivial
+ *   parallel_max_depth 2
+ *   parallel_min_size 256
+ * All keys are required
+ */
+bool Matrix::read_tuning(const std::string& path, Tuning& tuning) {
+  std::ifstream in(path.c_str());
+  if (!in)
+    return false;
+  Tuning t = Tuning();
+  unsigned found = 0;
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(in, line)) {
+    line_number++;
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    std::string key;
+    std::string value;
+    if (!(fields >> key))
+      continue;
+    if (!(fields >> value))
+      throw_malformed(path, line_number, "Value of " + key + " is missing");
+    if (key == "base_algorithm") {
+      if (value == "trivial")
+        t.base_algorithm = Algorithm::Trivial;
+      else if (value == "m4rm")
+        t.base_algorithm = Algorithm::M4RM;
+      else
+        throw_malformed(path, line_number, "Unknown base algorithm " + value);
+      found |= 1;
+      continue;
+    }
+    char* end = nullptr;
+    unsigned long long number = strtoull(value.c_str(), &end, 10);
+    if (*end || (value[0] == '-'))
+      throw_malformed(path, line_number, "Bad number " + value);
+    if (key == "version") {
+      if (number != QMATRIX_TUNING_VERSION)
+        throw_malformed(path, line_number, "Unsupported version " + value);
+      found |= 2;
+    } else if (key == "crossover") {
+      t.crossover = number;
+      found |= 4;
+    } else if (key == "parallel_max_depth") {
+      t.parallel_max_depth = number;
+      found |= 8;
+    } else if (key == "parallel_min_size") {
+      t.parallel_min_size = number;
+      found |= 16;
+    } else {
+      throw_malformed(path, line_number, "Unknown key " + key);
+    }
+  }
+  if (found != 31)
+    throw_malformed(path, line_number, "Some of the keys are missing");
+  check_crossover("Matrix::load_tuning", t.crossover);
+  tuning = t;
+  return true;
+}
+
+void Matrix::save_tuning(const std::string& path, const Tuning& tuning) {
+  check_crossover("Matrix::save_tuning", tuning.crossover);
+  check_base_algorithm("Matrix::save_tuning", tuning.base_algorithm);
+  std::ofstream out(path.c_str());
+  out << "# qmatrix tuning, see Matrix::calibrate()" << std::endl
+      << "version " << QMATRIX_TUNING_VERSION << std::endl
+      << "crossover " << tuning.crossover << std::endl
+      << "base_algorithm " << base_algorithm_name(tuning.base_algorithm) << std::endl
+      << "parallel_max_depth " << tuning.parallel_max_depth << std::endl
+      << "parallel_min_size " << tuning.parallel_min_size << std::endl;
+  out.close();
+  if (!out) {
+    std::stringstream msg;
+    msg << "Matrix::save_tuning: Can not write " << path;
+    throw std::runtime_error(msg.str());
+  }
+}
+
+//! Median time of repeats runs of multiply in seconds
+static double median_time(const std::function<void()>& multiply, size_t repeats) {
+  std::vector<double> times;
+  for (size_t r = 0; r < repeats; ++r) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    multiply();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    times.push_back(std::chrono::duration<double>(end - start).count());
+  }
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+Matrix::Tuning Matrix::calibrate(size_t size, size_t repeats) {
+  if ((size < 16) || (repeats == 0)) {
+    std::stringstream msg;
+    msg << "Matrix::calibrate: Size should be at least 16 and repeats positive ("
+        << size << " and " << repeats << " provided)";
+    throw std::invalid_argument(msg.str());
+  }
+  Matrix a(size, size);
+  Matrix b(size, size);
+  for (size_t i = 0; i < size; ++i) {
+    for (size_t j = 0; j < size; ++j) {
+      a.set(i, j, rand());
+      b.set(i, j, rand());
+    }
+  }
+  const size_t crossovers[] = {32, 48, 64, 96, 128, 192, 256, 384, 512};
+  const Algorithm base_algorithms[] = {Algorithm::Trivial, Algorithm::M4RM};
+  const size_t min_sizes[] = {128, 256, 512, 1024};
+  // Candidates are passed to the recursion, tuning of the other threads' multiplications is not touched
+  Tuning best = tuning();
+  Tuning t = best;
+  auto measure = [&] { return median_time([&] { multiply_strassen(a, b, t); }, repeats); };
+  // Crossover and base case are chosen for sequential recursion
+  double best_time = std::numeric_limits<double>::max();
+  t.parallel_max_depth = 0;
+  for (size_t c = 0; c < sizeof(crossovers) / sizeof(crossovers[0]); ++c) {
+    if ((crossovers[c] >= size) && (c > 0))
+      break;
+    t.crossover = crossovers[c];
+    for (size_t n = 0; n < sizeof(base_algorithms) / sizeof(base_algorithms[0]); ++n) {
+      t.base_algorithm = base_algorithms[n];
+      double time = measure();
+      if (time < best_time) {
+        best_time = time;
+        best.crossover = t.crossover;
+        best.base_algorithm = t.base_algorithm;
+      }
+    }
+  }
+  // Parallel limits do not matter for a single thread, current ones are kept then
+  if (thread_count() > 1) {
+    // Sequential recursion is the time to beat, parallel one may be slower on some hosts
+    best.parallel_max_depth = 0;
+    t = best;
+    for (size_t depth = 1; depth <= 4; ++depth) {
+      t.parallel_max_depth = depth;
+      for (size_t n = 0; n < sizeof(min_sizes) / sizeof(min_sizes[0]); ++n) {
+        if ((min_sizes[n] > size) && (n > 0))
+          break;
+        t.parallel_min_size = min_sizes[n];
+        double time = measure();
+        if (time < best_time) {
+          best_time = time;
+          best.parallel_max_depth = t.parallel_max_depth;
+          best.parallel_min_size = t.parallel_min_size;
+        }
+      }
+    }
+  }
+  return best;
+}
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "packed_gemm.h"
+#include "packed_kernels.h"
+
+static_assert(GEMM_MC % PLANES_TILE_ROWS == 0, "GEMM_MC should be a multiple of PLANES_TILE_ROWS");
+static_assert(GEMM_NC % 32 == 0, "GEMM_NC columns should fill whole words of packed rows");
+
+inline size_t round_up(size_t value, size_t step) {
+  return (value + step - 1) / step * step;
+}
+
+//! Gathers even bits of the word into its lower half
+inline uint64_t compress_even_bits(uint64_t x) {
+  x &= PACKED_LO_BITS;
+  x = (x | (x >> 1)) & 0x3333333333333333ULL;
+  x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0FULL;
+  x = (x | (x >> 4)) & 0x00FF00FF00FF00FFULL;
+  x = (x | (x >> 8)) & 0x0000FFFF0000FFFFULL;
+  x = (x | (x >> 16)) & 0x00000000FFFFFFFFULL;
+  return x;
+}
+
+/**
+ * Bit planes of elements [64*w, 64*w + 64) of packed row with col elements
+ * Elements beyond col are zero
+ */
+inline void load_planes(const int8_t* row, size_t col, size_t w, uint64_t& lo, uint64_t& hi) {
+  size_t first = 64 * w;
+  size_t count = std::min<size_t>(64, col - first);
+  size_t n_bytes = (count + 3) / 4;
+  const int8_t* p = row + first / 4;
+  uint64_t w0 = load_partial_word(p, std::min<size_t>(8, n_bytes));
+  uint64_t w1 = (n_bytes > 8) ? load_partial_word(p + 8, n_bytes - 8) : 0;
+  uint64_t mask = (count == 64) ? ~0ULL : ((1ULL << count) - 1);
+  lo = (compress_even_bits(w0) | (compress_even_bits(w1) << 32)) & mask;
+  hi = (compress_even_bits(w0 >> 1) | (compress_even_bits(w1 >> 1) << 32)) & mask;
+}
+
+//! Transposes 64x64 bit matrix: bit c of word r is moved to bit r of word c
+inline void transpose_bits64(uint64_t* a) {
+  uint64_t m = 0x00000000FFFFFFFFULL;
+  for (size_t j = 32; j != 0; j >>= 1, m ^= m << j) {
+    for (size_t k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+      uint64_t t = ((a[k] >> j) ^ a[k | j]) & m;
+      a[k] ^= t << j;
+      a[k | j] ^= t;
+    }
+  }
+}
+
+/**
+ * Packs count rows of length elements into panels of Tile rows.
+ * Rows beyond count are zero
+ */
+template <size_t Tile>
+static void pack_rows(std::vector<uint64_t>& packed, const int8_t* src, size_t stride,
+                      size_t count, size_t length) {
+  size_t n_words = (length + 63) / 64;
+  size_t count_pad = round_up(count, Tile);
+  packed.assign(2 * count_pad * n_words, 0);
+  for (size_t i = 0; i < count; ++i) {
+    const int8_t* row = src + i * stride;
+    size_t panel = i / Tile;
+    size_t r = i % Tile;
+    uint64_t* out = packed.data() + 2 * panel * n_words * Tile + r;
+    for (size_t w = 0; w < n_words; ++w) {
+      uint64_t* out_w = out + 2 * Tile * w;
+      load_planes(row, length, w, out_w[0], out_w[Tile]);
+    }
+  }
+}
+
+/**
+ * Packs count columns of length rows into panels of Tile columns,
+ * the same layout as pack_rows() gives for the transposed matrix.
+ * Rows are converted to bit planes by blocks of 64 rows,
+ * every block is transposed to get the planes of columns.
+ * Columns beyond count are zero
+ */
+template <size_t Tile>
+static void pack_columns(std::vector<uint64_t>& packed, const int8_t* src, size_t stride,
+                         size_t length, size_t count) {
+  size_t n_words = (length + 63) / 64;
+  size_t col_words = (count + 63) / 64;
+  size_t count_pad = round_up(count, Tile);
+  packed.assign(2 * count_pad * n_words, 0);
+  uint64_t lo[64];
+  uint64_t hi[64];
+  for (size_t kb = 0; kb < n_words; ++kb) {
+    for (size_t jb = 0; jb < col_words; ++jb) {
+      for (size_t r = 0; r < 64; ++r) {
+        size_t row = 64 * kb + r;
+        if (row < length) {
+          load_planes(src + row * stride, count, jb, lo[r], hi[r]);
+        } else {
+          lo[r] = 0;
+          hi[r] = 0;
+        }
+      }
+      transpose_bits64(lo);
+      transpose_bits64(hi);
+      size_t cols = std::min<size_t>(64, count - 64 * jb);
+      for (size_t c = 0; c < cols; ++c) {
+        size_t j = 64 * jb + c;
+        size_t panel = j / Tile;
+        size_t pos = j % Tile;
+        uint64_t* out = packed.data() + 2 * (panel * n_words + kb) * Tile + pos;
+        out[0] = lo[c];
+        out[Tile] = hi[c];
+      }
+    }
+  }
+}
+
+void packed_gemm(int8_t* c, size_t c_stride,
+                 const int8_t* a, size_t a_stride,
+                 const int8_t* b, size_t b_stride,
+                 size_t m, size_t k, size_t n) {
+  PackedGemmWorkspace workspace;
+  packed_gemm(c, c_stride, a, a_stride, b, b_stride, m, k, n, workspace);
+}
+
+void packed_gemm(int8_t* c, size_t c_stride,
+                 const int8_t* a, size_t a_stride,
+                 const int8_t* b, size_t b_stride,
+                 size_t m, size_t k, size_t n, PackedGemmWorkspace& workspace) {
+  packed_gemm(c, c_stride, a, a_stride, false, b, b_stride, false, m, k, n, PackedStore::Assign, workspace);
+}
+
+void packed_gemm(int8_t* c, size_t c_stride,
+                 const int8_t* a, size_t a_stride, bool transpose_a,
+                 const int8_t* b, size_t b_stride, bool transpose_b,
+                 size_t m, size_t k, size_t n, PackedStore store, PackedGemmWorkspace& workspace) {
+  if (m == 0 || n == 0)
+    return;
+  size_t n_words = (k + 63) / 64;
+  size_t m_pad = round_up(m, PLANES_TILE_ROWS);
+  size_t n_pad = round_up(n, PLANES_TILE_COLS);
+  std::vector<uint64_t>& a_packed = workspace.a_packed;
+  std::vector<uint64_t>& b_packed = workspace.b_packed;
+  // Rows of lhs and columns of rhs are packed, transposed operands are read the other way
+  if (transpose_a)
+    pack_columns<PLANES_TILE_ROWS>(a_packed, a, a_stride, k, m);
+  else
+    pack_rows<PLANES_TILE_ROWS>(a_packed, a, a_stride, m, k);
+  if (transpose_b)
+    pack_rows<PLANES_TILE_COLS>(b_packed, b, b_stride, n, k);
+  else
+    pack_columns<PLANES_TILE_COLS>(b_packed, b, b_stride, k, n);
+  /*
+   * Every [GEMM_MC x GEMM_NC] block of c is accumulated over all panels of k as bytes
+   * (wrapping modulo 256 keeps them correct modulo 4) and flushed before the next block,
+   * so the accumulator does not grow with the product
+   */
+  std::vector<uint8_t>& acc = workspace.acc;
+  acc.resize(std::min<size_t>(GEMM_MC, m_pad) * std::min<size_t>(GEMM_NC, n_pad));
+  void (*tile)(const uint64_t*, const uint64_t*, size_t, uint8_t*, size_t) = packed_kernels().planes_tile;
+  for (size_t jc = 0; jc < n_pad; jc += GEMM_NC) {
+    size_t j_end = std::min(jc + GEMM_NC, n_pad);
+    size_t nc = j_end - jc;
+    for (size_t ic = 0; ic < m_pad; ic += GEMM_MC) {
+      size_t i_end = std::min(ic + GEMM_MC, m_pad);
+      std::fill(acc.begin(), acc.begin() + (i_end - ic) * nc, 0);
+      for (size_t kc = 0; kc < n_words; kc += GEMM_KC) {
+        size_t kw = std::min<size_t>(GEMM_KC, n_words - kc);
+        for (size_t jr = jc; jr < j_end; jr += PLANES_TILE_COLS) {
+          const uint64_t* b_panel = b_packed.data() + 2 * PLANES_TILE_COLS * (jr / PLANES_TILE_COLS * n_words + kc);
+          for (size_t ir = ic; ir < i_end; ir += PLANES_TILE_ROWS) {
+            const uint64_t* a_panel = a_packed.data() + 2 * PLANES_TILE_ROWS * (ir / PLANES_TILE_ROWS * n_words + kc);
+            tile(a_panel, b_panel, kw, acc.data() + (ir - ic) * nc + (jr - jc), nc);
+          }
+        }
+      }
+      // Columns of the block start at a word boundary of c rows
+      size_t cols = std::min(j_end, n) - jc;
+      size_t rows = std::min(i_end, m) - ic;
+      size_t n_bytes = (cols + 3) / 4;
+      for (size_t i = 0; i < rows; ++i) {
+        const uint8_t* acc_row = acc.data() + i * nc;
+        int8_t* c_row = c + (ic + i) * c_stride + jc / 4;
+        for (size_t w = 0; w < n_bytes; w += 8) {
+          uint64_t packed = 0;
+          size_t first = 4 * w;
+          size_t last = std::min(cols, first + 32);
+          for (size_t j = first; j < last; ++j) {
+            packed |= static_cast<uint64_t>(acc_row[j] & 0x03) << ((j - first) * 2);
+          }
+          store_packed_word(c_row + w, packed, std::min<size_t>(8, n_bytes - w), store);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef PACKED_GEMM_H
+#define PACKED_GEMM_H
+
+#include <cstddef>
+#include <vector>
+
+#include <stdint.h>
+
+#include "packed_kernels.h"
+
+/*
+ * Block sizes of the multiplication.
+ * GEMM_KC words of one lhs and one rhs panel should fit into L1 cache,
+ * GEMM_MC rows of lhs block should fit into L2 cache together with rhs panel
+ */
+#ifndef GEMM_KC
+#define GEMM_KC 128
+#endif
+
+#ifndef GEMM_MC
+#define GEMM_MC 128
+#endif
+
+#ifndef GEMM_NC
+#define GEMM_NC 512
+#endif
+
+/**
+ * Packing buffers and the byte accumulator of one [GEMM_MC x GEMM_NC] block of packed_gemm.
+ * Workspace may be passed to consecutive calls to reuse the memory
+ */
+struct PackedGemmWorkspace {
+  PackedGemmWorkspace() :a_packed(), b_packed(), acc() {}
+  std::vector<uint64_t> a_packed;
+  std::vector<uint64_t> b_packed;
+  std::vector<uint8_t> acc;
+};
+
+/**
+ * c = a * b for packed matrices of sizes [m x k] * [k x n].
+ * Every matrix is given by pointer to the first byte of the first row
+ * and distance between rows in bytes. Only packed_bytes(n) bytes of every
+ * row of c are written; elements of a and b beyond their column numbers are ignored.
+ *
+ * Both operands are packed into bit-sliced panels (rhs column-wise, with
+ * 64x64 bit transposes instead of the element by element transposition),
+ * the product is computed by the planes_tile register kernel and
+ * the loops are blocked for L1 and L2 caches
+ */
+void packed_gemm(int8_t* c, size_t c_stride,
+                 const int8_t* a, size_t a_stride,
+                 const int8_t* b, size_t b_stride,
+                 size_t m, size_t k, size_t n);
+
+//! The same as above with buffers taken from workspace
+void packed_gemm(int8_t* c, size_t c_stride,
+                 const int8_t* a, size_t a_stride,
+                 const int8_t* b, size_t b_stride,
+                 size_t m, size_t k, size_t n, PackedGemmWorkspace& workspace);
+
+/**
+ * General form: c = op(a) * op(b), c += op(a) * op(b) or c -= op(a) * op(b) depending on store,
+ * where op(x) is x or x transposed. Sizes are the ones of the product: op(a) is [m x k],
+ * so a is stored as [k x m] matrix if transpose_a is true; the same for b.
+ * Transposed operands cost nothing: they only change the way of packing.
+ * When c is updated, lanes of the last byte of c rows beyond n are kept
+ */
+void packed_gemm(int8_t* c, size_t c_stride,
+                 const int8_t* a, size_t a_stride, bool transpose_a,
+                 const int8_t* b, size_t b_stride, bool transpose_b,
+                 size_t m, size_t k, size_t n, PackedStore store, PackedGemmWorkspace& workspace);
+
+#endif // PACKED_GEMM_H
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "packed_gemv.h"
+#include "packed_kernels.h"
+#include "thread_pool.h"
+
+//! Matrices with less elements are multiplied in the calling thread
+#ifndef GEMV_PARALLEL_MIN
+#define GEMV_PARALLEL_MIN (1 << 22)
+#endif
+
+//! Bytes of the matrix processed by one task
+#ifndef GEMV_TASK_BYTES
+#define GEMV_TASK_BYTES (256 * 1024)
+#endif
+
+//! Width of the column block of packed_gevm in bytes
+#ifndef GEVM_BLOCK_BYTES
+#define GEVM_BLOCK_BYTES 4096
+#endif
+
+void packed_gemv(int8_t* c, size_t c_stride,
+                 const int8_t* a, size_t a_stride,
+                 const int8_t* x, size_t x_stride,
+                 size_t m, size_t k, ThreadPool* pool) {
+  if (m == 0)
+    return;
+  size_t k_bytes = (k + 3) / 4;
+  // Lanes beyond k stay zero, so lanes of a beyond its columns are ignored by the dot products
+  std::vector<int8_t> row(k_bytes + 1, 0);
+  for (size_t i = 0; i < k; ++i) {
+    row[i / 4] |= (x[i * x_stride] & 0x03) << ((i % 4) * 2);
+  }
+  int8_t (*dot)(const int8_t*, const int8_t*, size_t) = packed_kernels().dot;
+  auto rows = [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+      c[i * c_stride] = dot(a + i * a_stride, row.data(), k_bytes);
+    }
+  };
+  if (!pool || (m * k < GEMV_PARALLEL_MIN)) {
+    rows(0, m);
+    return;
+  }
+  size_t task_rows = std::max<size_t>(1, GEMV_TASK_BYTES / std::max<size_t>(1, k_bytes));
+  TaskGroup group(pool);
+  for (size_t first = 0; first < m; first += task_rows) {
+    size_t last = std::min(m, first + task_rows);
+    group.run([&rows, first, last] { rows(first, last); });
+  }
+  group.wait();
+}
+
+void packed_gevm(int8_t* c, const int8_t* x,
+                 const int8_t* b, size_t b_stride,
+                 size_t k, size_t n, ThreadPool* pool) {
+  if (n == 0)
+    return;
+  size_t n_bytes = (n + 3) / 4;
+  void (*multiply_add)(int8_t*, const int8_t*, int8_t, size_t) = packed_kernels().multiply_add;
+  auto block = [&](size_t first, size_t count) {
+    memset(c + first, 0, count);
+    for (size_t j = 0; j < k; ++j) {
+      int8_t factor = (x[j / 4] >> ((j % 4) * 2)) & 0x03;
+      if (factor)
+        multiply_add(c + first, b + j * b_stride + first, factor, count);
+    }
+  };
+  if (!pool || (n * k < GEMV_PARALLEL_MIN)) {
+    for (size_t first = 0; first < n_bytes; first += GEVM_BLOCK_BYTES) {
+      block(first, std::min<size_t>(GEVM_BLOCK_BYTES, n_bytes - first));
+    }
+  } else {
+    TaskGroup group(pool);
+    for (size_t first = 0; first < n_bytes; first += GEVM_BLOCK_BYTES) {
+      size_t count = std::min<size_t>(GEVM_BLOCK_BYTES, n_bytes - first);
+      group.run([&block, first, count] { block(first, count); });
+    }
+    group.wait();
+  }
+  // Lanes of b beyond n have been added to the last byte
+  if (n % 4)
+    c[n_bytes - 1] &= 0xFF >> (8 - 2 * (n % 4));
+}
@@ -0,0 +1,37 @@
+#ifndef PACKED_GEMV_H
+#define PACKED_GEMV_H
+
+#include <cstddef>
+
+#include <stdint.h>
+
+class ThreadPool;
+
+/**
+ * c = a * x for packed matrix a of size [m x k] and column x of size [k x 1].
+ * Element i of x is the lowest lane of x[i * x_stride], element i of c
+ * is written as the whole byte c[i * c_stride] (other lanes are zero),
+ * so columns are laid out as rows of [k x 1] and [m x 1] matrices.
+ *
+ * x is gathered into one packed row, then every element of c is a dot product
+ * of two packed rows computed with the kernels of the current instruction set.
+ * Rows of a are split between tasks of pool (if any) for large matrices
+ */
+void packed_gemv(int8_t* c, size_t c_stride,
+                 const int8_t* a, size_t a_stride,
+                 const int8_t* x, size_t x_stride,
+                 size_t m, size_t k, ThreadPool* pool);
+
+/**
+ * c = x * b for packed row x of size [1 x k] and packed matrix b of size [k x n].
+ * Only packed_bytes(n) bytes of c are written, elements beyond their column numbers are ignored.
+ *
+ * Every non-zero element of x adds its multiple of the row of b to c.
+ * Columns are processed by blocks which stay in L1 cache, blocks are split
+ * between tasks of pool (if any) for large matrices
+ */
+void packed_gevm(int8_t* c, const int8_t* x,
+                 const int8_t* b, size_t b_stride,
+                 size_t k, size_t n, ThreadPool* pool);
+
+#endif // PACKED_GEMV_H
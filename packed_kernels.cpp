@@ -0,0 +1,752 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PACKED_KERNELS_X86
+#endif
+
+#include "packed_kernels.h"
+
+/*
+ * Scalar kernels: 32 elements per 64-bit word operation
+ */
+template <uint64_t (*Op)(uint64_t, uint64_t)>
+static void scalar_binary(int8_t* dst, const int8_t* a, const int8_t* b, size_t n_bytes) {
+  size_t i = 0;
+  for (; i + 8 <= n_bytes; i += 8) {
+    store_word(dst + i, Op(load_word(a + i), load_word(b + i)));
+  }
+  if (i < n_bytes) {
+    size_t tail = n_bytes - i;
+    store_partial_word(dst + i, Op(load_partial_word(a + i, tail), load_partial_word(b + i, tail)), tail);
+  }
+}
+
+static void scalar_multiply_add(int8_t* dst, const int8_t* src, int8_t factor, size_t n_bytes) {
+  factor &= 0x03;
+  if (factor == 0)
+    return;
+  uint64_t f = word_splat(factor);
+  size_t i = 0;
+  for (; i + 8 <= n_bytes; i += 8) {
+    store_word(dst + i, word_sum(load_word(dst + i), word_multiply(load_word(src + i), f)));
+  }
+  if (i < n_bytes) {
+    size_t tail = n_bytes - i;
+    uint64_t d = load_partial_word(dst + i, tail);
+    uint64_t s = load_partial_word(src + i, tail);
+    store_partial_word(dst + i, word_sum(d, word_multiply(s, f)), tail);
+  }
+}
+
+//! Accumulates bytes [first, n_bytes) of the rows
+static void scalar_accumulate_from(int8_t* dst, const int8_t* const* src, size_t count,
+                                   size_t first, size_t n_bytes) {
+  size_t i = first;
+  for (; i + 8 <= n_bytes; i += 8) {
+    uint64_t d = load_word(dst + i);
+    for (size_t s = 0; s < count; ++s) {
+      d = word_sum(d, load_word(src[s] + i));
+    }
+    store_word(dst + i, d);
+  }
+  if (i < n_bytes) {
+    size_t tail = n_bytes - i;
+    uint64_t d = load_partial_word(dst + i, tail);
+    for (size_t s = 0; s < count; ++s) {
+      d = word_sum(d, load_partial_word(src[s] + i, tail));
+    }
+    store_partial_word(dst + i, d, tail);
+  }
+}
+
+static void scalar_accumulate(int8_t* dst, const int8_t* const* src, size_t count, size_t n_bytes) {
+  scalar_accumulate_from(dst, src, count, 0, n_bytes);
+}
+
+/**
+ * sum(a*b) = popcount(a0 & b0) + 2*popcount(a0 & b1 ^ a1 & b0) mod 4
+ * Only parity of the second popcount matters, so the terms are XOR-ed
+ * together and counted once at the end
+ */
+static int8_t scalar_planes_dot(const uint64_t* a, const uint64_t* b, size_t n_words) {
+  size_t lo_count = 0;
+  uint64_t hi_parity = 0;
+  for (size_t k = 0; k < n_words; ++k) {
+    uint64_t a0 = a[2*k];
+    uint64_t a1 = a[2*k + 1];
+    uint64_t b0 = b[2*k];
+    uint64_t b1 = b[2*k + 1];
+    lo_count += __builtin_popcountll(a0 & b0);
+    hi_parity ^= (a0 & b1) ^ (a1 & b0);
+  }
+  return (lo_count + 2 * __builtin_popcountll(hi_parity)) & 0x03;
+}
+
+/**
+ * Dot product of packed rows: element products a*b mod 4 are computed by word_multiply,
+ * their low bits are counted and only parity of their high bits is kept
+ */
+static int8_t scalar_dot(const int8_t* a, const int8_t* b, size_t n_bytes) {
+  size_t lo_count = 0;
+  uint64_t hi_parity = 0;
+  size_t i = 0;
+  for (; i + 8 <= n_bytes; i += 8) {
+    uint64_t p = word_multiply(load_word(a + i), load_word(b + i));
+    lo_count += __builtin_popcountll(p & PACKED_LO_BITS);
+    hi_parity ^= p;
+  }
+  if (i < n_bytes) {
+    size_t tail = n_bytes - i;
+    uint64_t p = word_multiply(load_partial_word(a + i, tail), load_partial_word(b + i, tail));
+    lo_count += __builtin_popcountll(p & PACKED_LO_BITS);
+    hi_parity ^= p;
+  }
+  return (lo_count + 2 * __builtin_popcountll(hi_parity & PACKED_HI_BITS)) & 0x03;
+}
+
+//! Elements [0, j) of every group of 2j elements of a word
+static inline uint64_t transpose_mask(size_t j) {
+  switch (j) {
+  case 16:
+    return 0x00000000FFFFFFFFULL;
+  case 8:
+    return 0x0000FFFF0000FFFFULL;
+  case 4:
+    return 0x00FF00FF00FF00FFULL;
+  case 2:
+    return 0x0F0F0F0F0F0F0F0FULL;
+  default:
+    return 0x3333333333333333ULL;
+  }
+}
+
+/**
+ * Steps j, j / 2, ..., 1 of the block transposition: in every 2j x 2j sub-block
+ * the upper right and lower left j x j quarters are exchanged, words k and k + j
+ * swap the high half of the groups of the first one with the low half of the second one
+ */
+static void scalar_transpose32_steps(uint64_t* a, size_t j) {
+  for (; j != 0; j >>= 1) {
+    uint64_t m = transpose_mask(j);
+    for (size_t k = 0; k < 32; k = ((k | j) + 1) & ~j) {
+      uint64_t t = ((a[k] >> (2 * j)) ^ a[k | j]) & m;
+      a[k] ^= t << (2 * j);
+      a[k | j] ^= t;
+    }
+  }
+}
+
+static void scalar_transpose32(uint64_t* a) {
+  scalar_transpose32_steps(a, 16);
+}
+
+/*
+ * Packing of bytes: low 2 bits of 8 bytes of a word are gathered into its low 16 bits
+ * by three steps merging adjacent groups (bits of the merged groups never overlap,
+ * so the vector kernels merge them with XOR); unpacking reverses the steps
+ */
+static inline uint64_t pack_bytes8(uint64_t x) {
+  x &= 0x0303030303030303ULL;
+  x = (x ^ (x >> 6)) & 0x000F000F000F000FULL;
+  x = (x ^ (x >> 12)) & 0x000000FF000000FFULL;
+  return (x ^ (x >> 24)) & 0x000000000000FFFFULL;
+}
+
+static inline uint64_t unpack_bytes8(uint64_t x) {
+  x &= 0x000000000000FFFFULL;
+  x = (x ^ (x << 24)) & 0x000000FF000000FFULL;
+  x = (x ^ (x << 12)) & 0x000F000F000F000FULL;
+  return (x ^ (x << 6)) & 0x0303030303030303ULL;
+}
+
+//! Packs elements [first, n) (first is a multiple of 32)
+static void scalar_pack_from(int8_t* dst, const uint8_t* src, size_t first, size_t n) {
+  const int8_t* s = reinterpret_cast<const int8_t*>(src);
+  size_t i = first;
+  for (; i + 32 <= n; i += 32) {
+    uint64_t w = 0;
+    for (size_t k = 0; k < 4; ++k) {
+      w |= pack_bytes8(load_word(s + i + 8 * k)) << (16 * k);
+    }
+    store_word(dst + i / 4, w);
+  }
+  if (i < n) {
+    uint64_t w = 0;
+    for (size_t k = 0; i + 8 * k < n; ++k) {
+      w |= pack_bytes8(load_partial_word(s + i + 8 * k, std::min<size_t>(8, n - i - 8 * k))) << (16 * k);
+    }
+    store_partial_word(dst + i / 4, w, (n - i + 3) / 4);
+  }
+}
+
+static void scalar_pack(int8_t* dst, const uint8_t* src, size_t n) {
+  scalar_pack_from(dst, src, 0, n);
+}
+
+//! Unpacks elements [first, n) (first is a multiple of 32)
+static void scalar_unpack_from(uint8_t* dst, const int8_t* src, size_t first, size_t n) {
+  int8_t* d = reinterpret_cast<int8_t*>(dst);
+  size_t i = first;
+  for (; i + 32 <= n; i += 32) {
+    uint64_t w = load_word(src + i / 4);
+    for (size_t k = 0; k < 4; ++k) {
+      store_word(d + i + 8 * k, unpack_bytes8(w >> (16 * k)));
+    }
+  }
+  if (i < n) {
+    uint64_t w = load_partial_word(src + i / 4, (n - i + 3) / 4);
+    for (size_t k = 0; i + 8 * k < n; ++k) {
+      store_partial_word(d + i + 8 * k, unpack_bytes8(w >> (16 * k)), std::min<size_t>(8, n - i - 8 * k));
+    }
+  }
+}
+
+static void scalar_unpack(uint8_t* dst, const int8_t* src, size_t n) {
+  scalar_unpack_from(dst, src, 0, n);
+}
+
+/*
+ * Register tile of planes_dot.
+ * Instead of counting bits at every step, each pair of rows keeps two words
+ * of bit-sliced 2-bit counters (c0 + 2*c1 for every bit position):
+ * adding t = a0 & b0 carries c0 & t into c1, the doubled term a0 & b1 ^ a1 & b0
+ * goes to c1 directly. Bits are counted only once at the end:
+ * sum = popcount(c0) + 2*popcount(c1) mod 4
+ */
+static void scalar_planes_tile(const uint64_t* a, const uint64_t* b, size_t n_words,
+                               uint8_t* acc, size_t acc_stride) {
+  for (size_t r = 0; r < PLANES_TILE_ROWS; ++r) {
+    for (size_t c = 0; c < PLANES_TILE_COLS; ++c) {
+      uint64_t c0 = 0;
+      uint64_t c1 = 0;
+      for (size_t k = 0; k < n_words; ++k) {
+        uint64_t a0 = a[2 * PLANES_TILE_ROWS * k + r];
+        uint64_t a1 = a[2 * PLANES_TILE_ROWS * k + PLANES_TILE_ROWS + r];
+        uint64_t b0 = b[2 * PLANES_TILE_COLS * k + c];
+        uint64_t b1 = b[2 * PLANES_TILE_COLS * k + PLANES_TILE_COLS + c];
+        uint64_t t = a0 & b0;
+        c1 ^= (c0 & t) ^ (a0 & b1) ^ (a1 & b0);
+        c0 ^= t;
+      }
+      acc[r * acc_stride + c] += __builtin_popcountll(c0) + 2 * __builtin_popcountll(c1);
+    }
+  }
+}
+
+
+static const PackedKernels scalar_kernels = {
+  Matrix::SimdLevel::Scalar,
+  scalar_binary<word_sum>,
+  scalar_binary<word_diff>,
+  scalar_binary<word_multiply>,
+  scalar_multiply_add,
+  scalar_accumulate,
+  scalar_planes_dot,
+  scalar_planes_tile,
+  scalar_dot,
+  scalar_transpose32,
+  scalar_pack,
+  scalar_unpack
+};
+
+#ifdef PACKED_KERNELS_X86
+
+//! The same dot product with hardware popcount instruction
+__attribute__((target("popcnt")))
+static int8_t popcnt_planes_dot(const uint64_t* a, const uint64_t* b, size_t n_words) {
+  size_t lo_count = 0;
+  uint64_t hi_parity = 0;
+  for (size_t k = 0; k < n_words; ++k) {
+    uint64_t a0 = a[2*k];
+    uint64_t a1 = a[2*k + 1];
+    uint64_t b0 = b[2*k];
+    uint64_t b1 = b[2*k + 1];
+    lo_count += __builtin_popcountll(a0 & b0);
+    hi_parity ^= (a0 & b1) ^ (a1 & b0);
+  }
+  return (lo_count + 2 * __builtin_popcountll(hi_parity)) & 0x03;
+}
+
+
+/*
+ * Vector kernels. Every instruction set provides the same set of element
+ * operations (sum, diff, multiply) on its vector type; the loops are
+ * generated by DEFINE_VECTOR_KERNELS and the remaining bytes are handled
+ * by the scalar kernels
+ */
+#define DEFINE_VECTOR_KERNELS(prefix, target, vec, width, load, store, splat, vand, vxor, popcount) \
+  target static void prefix##_sum(int8_t* dst, const int8_t* a, const int8_t* b, size_t n) {   \
+    size_t i = 0;                                                                              \
+    for (; i + width <= n; i += width)                                                         \
+      store(dst + i, prefix##_vec_sum(load(a + i), load(b + i)));                              \
+    scalar_binary<word_sum>(dst + i, a + i, b + i, n - i);                                     \
+  }                                                                                            \
+  target static void prefix##_diff(int8_t* dst, const int8_t* a, const int8_t* b, size_t n) {  \
+    size_t i = 0;                                                                              \
+    for (; i + width <= n; i += width)                                                         \
+      store(dst + i, prefix##_vec_diff(load(a + i), load(b + i)));                             \
+    scalar_binary<word_diff>(dst + i, a + i, b + i, n - i);                                    \
+  }                                                                                            \
+  target static void prefix##_multiply(int8_t* dst, const int8_t* a, const int8_t* b, size_t n) { \
+    size_t i = 0;                                                                              \
+    for (; i + width <= n; i += width)                                                         \
+      store(dst + i, prefix##_vec_multiply(load(a + i), load(b + i)));                         \
+    scalar_binary<word_multiply>(dst + i, a + i, b + i, n - i);                                \
+  }                                                                                            \
+  target static void prefix##_multiply_add(int8_t* dst, const int8_t* src, int8_t factor, size_t n) { \
+    factor &= 0x03;                                                                            \
+    if (factor == 0)                                                                           \
+      return;                                                                                  \
+    vec f = splat(word_splat(factor));                                                         \
+    size_t i = 0;                                                                              \
+    for (; i + width <= n; i += width)                                                         \
+      store(dst + i, prefix##_vec_sum(load(dst + i), prefix##_vec_multiply(load(src + i), f))); \
+    scalar_multiply_add(dst + i, src + i, factor, n - i);                                      \
+  }                                                                                            \
+  target static void prefix##_accumulate(int8_t* dst, const int8_t* const* src, size_t count, size_t n) { \
+    size_t i = 0;                                                                              \
+    for (; i + width <= n; i += width) {                                                       \
+      vec d = load(dst + i);                                                                   \
+      for (size_t s = 0; s < count; ++s)                                                       \
+        d = prefix##_vec_sum(d, load(src[s] + i));                                             \
+      store(dst + i, d);                                                                       \
+    }                                                                                          \
+    scalar_accumulate_from(dst, src, count, i, n);                                             \
+  }                                                                                            \
+  /* Every vector holds counters of width / 8 adjacent columns of the tile */                  \
+  target static void prefix##_planes_tile(const uint64_t* a, const uint64_t* b, size_t n_words, \
+                                          uint8_t* acc, size_t acc_stride) {                   \
+    const size_t lanes = width / 8;                                                            \
+    for (size_t c = 0; c < PLANES_TILE_COLS; c += lanes) {                                     \
+      vec c0[PLANES_TILE_ROWS];                                                                \
+      vec c1[PLANES_TILE_ROWS];                                                                \
+      for (size_t r = 0; r < PLANES_TILE_ROWS; ++r) {                                          \
+        c0[r] = splat(0);                                                                      \
+        c1[r] = splat(0);                                                                      \
+      }                                                                                        \
+      for (size_t k = 0; k < n_words; ++k) {                                                   \
+        const uint64_t* b_k = b + 2 * PLANES_TILE_COLS * k + c;                                \
+        vec b0 = load(reinterpret_cast<const int8_t*>(b_k));                                   \
+        vec b1 = load(reinterpret_cast<const int8_t*>(b_k + PLANES_TILE_COLS));                \
+        const uint64_t* a_k = a + 2 * PLANES_TILE_ROWS * k;                                    \
+        for (size_t r = 0; r < PLANES_TILE_ROWS; ++r) {                                        \
+          vec a0 = splat(a_k[r]);                                                              \
+          vec a1 = splat(a_k[PLANES_TILE_ROWS + r]);                                           \
+          vec t = vand(a0, b0);                                                                \
+          c1[r] = vxor(c1[r], vxor(vand(c0[r], t), vxor(vand(a0, b1), vand(a1, b0))));         \
+          c0[r] = vxor(c0[r], t);                                                              \
+        }                                                                                      \
+      }                                                                                        \
+      for (size_t r = 0; r < PLANES_TILE_ROWS; ++r) {                                          \
+        uint64_t w0[lanes];                                                                    \
+        uint64_t w1[lanes];                                                                    \
+        store(reinterpret_cast<int8_t*>(w0), c0[r]);                                           \
+        store(reinterpret_cast<int8_t*>(w1), c1[r]);                                           \
+        for (size_t l = 0; l < lanes; ++l) {                                                   \
+          acc[r * acc_stride + c + l] += popcount(w0[l]) + 2 * popcount(w1[l]);                \
+        }                                                                                      \
+      }                                                                                        \
+    }                                                                                          \
+  }                                                                                            \
+  /*                                                                                           \
+   * Low bits of element products are added to bit-sliced counters c0 + 2*c1                   \
+   * (carries c0 & t go to c1 at even bits), high bits only flip parity at odd bits             \
+   */                                                                                          \
+  target static int8_t prefix##_dot(const int8_t* a, const int8_t* b, size_t n) {              \
+    const size_t lanes = width / 8;                                                            \
+    const vec lo = splat(PACKED_LO_BITS);                                                      \
+    const vec hi = splat(PACKED_HI_BITS);                                                      \
+    vec c0 = splat(0);                                                                         \
+    vec c1 = splat(0);                                                                         \
+    size_t i = 0;                                                                              \
+    for (; i + width <= n; i += width) {                                                       \
+      vec p = prefix##_vec_multiply(load(a + i), load(b + i));                                 \
+      vec t = vand(p, lo);                                                                     \
+      c1 = vxor(c1, vxor(vand(c0, t), vand(p, hi)));                                           \
+      c0 = vxor(c0, t);                                                                        \
+    }                                                                                          \
+    uint64_t w0[lanes];                                                                        \
+    uint64_t w1[lanes];                                                                        \
+    store(reinterpret_cast<int8_t*>(w0), c0);                                                  \
+    store(reinterpret_cast<int8_t*>(w1), c1);                                                  \
+    size_t sum = scalar_dot(a + i, b + i, n - i);                                              \
+    for (size_t l = 0; l < lanes; ++l) {                                                       \
+      sum += popcount(w0[l]) + 2 * popcount(w1[l]);                                            \
+    }                                                                                          \
+    return sum & 0x03;                                                                         \
+  }                                                                                            \
+  /* Steps exchanging at least width / 8 adjacent words work on whole vectors */               \
+  target static void prefix##_transpose32(uint64_t* a) {                                       \
+    const size_t lanes = width / 8;                                                            \
+    size_t j = 16;                                                                             \
+    for (; j >= lanes; j >>= 1) {                                                              \
+      vec m = splat(transpose_mask(j));                                                        \
+      for (size_t k = 0; k < 32; k += lanes) {                                                 \
+        if (k & j)                                                                             \
+          continue;                                                                            \
+        int8_t* p = reinterpret_cast<int8_t*>(a + k);                                          \
+        int8_t* q = reinterpret_cast<int8_t*>(a + (k | j));                                    \
+        vec x = load(p);                                                                       \
+        vec y = load(q);                                                                       \
+        vec t = vand(vxor(prefix##_vec_shr(x, 2 * j), y), m);                                  \
+        store(p, vxor(x, prefix##_vec_shl(t, 2 * j)));                                         \
+        store(q, vxor(y, t));                                                                  \
+      }                                                                                        \
+    }                                                                                          \
+    scalar_transpose32_steps(a, j);                                                            \
+  }                                                                                            \
+  /*                                                                                           \
+   * Four vectors of bytes are packed into one vector: every word is packed in its lane,       \
+   * the 16-bit results are gathered through the stack                                        \
+   */                                                                                          \
+  target static void prefix##_pack(int8_t* dst, const uint8_t* src, size_t n) {               \
+    const size_t lanes = width / 8;                                                            \
+    const vec m0 = splat(0x0303030303030303ULL);                                               \
+    const vec m1 = splat(0x000F000F000F000FULL);                                               \
+    const vec m2 = splat(0x000000FF000000FFULL);                                               \
+    const vec m3 = splat(0x000000000000FFFFULL);                                               \
+    const int8_t* s = reinterpret_cast<const int8_t*>(src);                                    \
+    uint64_t chunks[4 * lanes];                                                                \
+    size_t i = 0;                                                                              \
+    for (; i + 4 * width <= n; i += 4 * width) {                                               \
+      for (size_t k = 0; k < 4; ++k) {                                                         \
+        vec x = vand(load(s + i + k * width), m0);                                             \
+        x = vand(vxor(x, prefix##_vec_shr(x, 6)), m1);                                         \
+        x = vand(vxor(x, prefix##_vec_shr(x, 12)), m2);                                        \
+        x = vand(vxor(x, prefix##_vec_shr(x, 24)), m3);                                        \
+        store(reinterpret_cast<int8_t*>(chunks + k * lanes), x);                               \
+      }                                                                                        \
+      for (size_t o = 0; o < lanes; ++o) {                                                     \
+        const uint64_t* c = chunks + 4 * o;                                                    \
+        store_word(dst + i / 4 + 8 * o, c[0] | (c[1] << 16) | (c[2] << 32) | (c[3] << 48));    \
+      }                                                                                        \
+    }                                                                                          \
+    scalar_pack_from(dst, src, i, n);                                                          \
+  }                                                                                            \
+  target static void prefix##_unpack(uint8_t* dst, const int8_t* src, size_t n) {             \
+    const size_t lanes = width / 8;                                                            \
+    const vec m1 = splat(0x000000FF000000FFULL);                                               \
+    const vec m2 = splat(0x000F000F000F000FULL);                                               \
+    const vec m3 = splat(0x0303030303030303ULL);                                               \
+    int8_t* d = reinterpret_cast<int8_t*>(dst);                                                \
+    uint64_t chunks[4 * lanes];                                                                \
+    size_t i = 0;                                                                              \
+    for (; i + 4 * width <= n; i += 4 * width) {                                               \
+      for (size_t o = 0; o < lanes; ++o) {                                                     \
+        uint64_t w = load_word(src + i / 4 + 8 * o);                                           \
+        for (size_t k = 0; k < 4; ++k) {                                                       \
+          chunks[4 * o + k] = (w >> (16 * k)) & 0xFFFF;                                        \
+        }                                                                                      \
+      }                                                                                        \
+      for (size_t k = 0; k < 4; ++k) {                                                         \
+        vec x = load(reinterpret_cast<const int8_t*>(chunks + k * lanes));                     \
+        x = vand(vxor(x, prefix##_vec_shl(x, 24)), m1);                                        \
+        x = vand(vxor(x, prefix##_vec_shl(x, 12)), m2);                                        \
+        x = vand(vxor(x, prefix##_vec_shl(x, 6)), m3);                                         \
+        store(d + i + k * width, x);                                                           \
+      }                                                                                        \
+    }                                                                                          \
+    scalar_unpack_from(dst, src, i, n);                                                        \
+  }
+
+#define NO_TARGET
+
+__attribute__((target("popcnt")))
+static inline int popcnt64(uint64_t w) {
+  return __builtin_popcountll(w);
+}
+
+static inline int soft_popcount64(uint64_t w) {
+  return __builtin_popcountll(w);
+}
+
+/*
+ * SSE2
+ */
+static inline __m128i sse2_load(const int8_t* p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+static inline void sse2_store(int8_t* p, __m128i v) {
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+}
+
+static inline __m128i sse2_splat(uint64_t w) {
+  return _mm_set1_epi64x(w);
+}
+
+static inline __m128i sse2_vec_sum(__m128i a, __m128i b) {
+  const __m128i lo = sse2_splat(PACKED_LO_BITS);
+  const __m128i hi = sse2_splat(PACKED_HI_BITS);
+  __m128i s = _mm_add_epi64(_mm_and_si128(a, lo), _mm_and_si128(b, lo));
+  return _mm_xor_si128(s, _mm_and_si128(_mm_xor_si128(a, b), hi));
+}
+
+static inline __m128i sse2_vec_diff(__m128i a, __m128i b) {
+  const __m128i lo = sse2_splat(PACKED_LO_BITS);
+  const __m128i hi = sse2_splat(PACKED_HI_BITS);
+  __m128i d = _mm_sub_epi64(_mm_or_si128(a, hi), _mm_and_si128(b, lo));
+  return _mm_xor_si128(d, _mm_andnot_si128(_mm_xor_si128(a, b), hi));
+}
+
+static inline __m128i sse2_vec_multiply(__m128i a, __m128i b) {
+  const __m128i lo = sse2_splat(PACKED_LO_BITS);
+  __m128i p_lo = _mm_and_si128(_mm_and_si128(a, b), lo);
+  __m128i p_hi = _mm_xor_si128(_mm_and_si128(_mm_srli_epi64(a, 1), b), _mm_and_si128(a, _mm_srli_epi64(b, 1)));
+  return _mm_or_si128(p_lo, _mm_slli_epi64(_mm_and_si128(p_hi, lo), 1));
+}
+
+static inline __m128i sse2_vec_shr(__m128i a, int n) {
+  return _mm_srl_epi64(a, _mm_cvtsi32_si128(n));
+}
+
+static inline __m128i sse2_vec_shl(__m128i a, int n) {
+  return _mm_sll_epi64(a, _mm_cvtsi32_si128(n));
+}
+
+DEFINE_VECTOR_KERNELS(sse2, NO_TARGET, __m128i, 16, sse2_load, sse2_store, sse2_splat,
+                      _mm_and_si128, _mm_xor_si128, soft_popcount64)
+
+static const PackedKernels sse2_kernels = {
+  Matrix::SimdLevel::SSE2,
+  sse2_sum,
+  sse2_diff,
+  sse2_multiply,
+  sse2_multiply_add,
+  sse2_accumulate,
+  scalar_planes_dot,
+  sse2_planes_tile,
+  sse2_dot,
+  sse2_transpose32,
+  sse2_pack,
+  sse2_unpack
+};
+
+/*
+ * AVX2
+ */
+#define AVX2_TARGET __attribute__((target("avx2,popcnt")))
+
+AVX2_TARGET static inline __m256i avx2_load(const int8_t* p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+AVX2_TARGET static inline void avx2_store(int8_t* p, __m256i v) {
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+}
+
+AVX2_TARGET static inline __m256i avx2_splat(uint64_t w) {
+  return _mm256_set1_epi64x(w);
+}
+
+AVX2_TARGET static inline __m256i avx2_vec_sum(__m256i a, __m256i b) {
+  const __m256i lo = avx2_splat(PACKED_LO_BITS);
+  const __m256i hi = avx2_splat(PACKED_HI_BITS);
+  __m256i s = _mm256_add_epi64(_mm256_and_si256(a, lo), _mm256_and_si256(b, lo));
+  return _mm256_xor_si256(s, _mm256_and_si256(_mm256_xor_si256(a, b), hi));
+}
+
+AVX2_TARGET static inline __m256i avx2_vec_diff(__m256i a, __m256i b) {
+  const __m256i lo = avx2_splat(PACKED_LO_BITS);
+  const __m256i hi = avx2_splat(PACKED_HI_BITS);
+  __m256i d = _mm256_sub_epi64(_mm256_or_si256(a, hi), _mm256_and_si256(b, lo));
+  return _mm256_xor_si256(d, _mm256_andnot_si256(_mm256_xor_si256(a, b), hi));
+}
+
+AVX2_TARGET static inline __m256i avx2_vec_multiply(__m256i a, __m256i b) {
+  const __m256i lo = avx2_splat(PACKED_LO_BITS);
+  __m256i p_lo = _mm256_and_si256(_mm256_and_si256(a, b), lo);
+  __m256i p_hi = _mm256_xor_si256(_mm256_and_si256(_mm256_srli_epi64(a, 1), b),
+                                  _mm256_and_si256(a, _mm256_srli_epi64(b, 1)));
+  return _mm256_or_si256(p_lo, _mm256_slli_epi64(_mm256_and_si256(p_hi, lo), 1));
+}
+
+AVX2_TARGET static inline __m256i avx2_vec_shr(__m256i a, int n) {
+  return _mm256_srl_epi64(a, _mm_cvtsi32_si128(n));
+}
+
+AVX2_TARGET static inline __m256i avx2_vec_shl(__m256i a, int n) {
+  return _mm256_sll_epi64(a, _mm_cvtsi32_si128(n));
+}
+
+DEFINE_VECTOR_KERNELS(avx2, AVX2_TARGET, __m256i, 32, avx2_load, avx2_store, avx2_splat,
+                      _mm256_and_si256, _mm256_xor_si256, popcnt64)
+
+static const PackedKernels avx2_kernels = {
+  Matrix::SimdLevel::AVX2,
+  avx2_sum,
+  avx2_diff,
+  avx2_multiply,
+  avx2_multiply_add,
+  avx2_accumulate,
+  popcnt_planes_dot,
+  avx2_planes_tile,
+  avx2_dot,
+  avx2_transpose32,
+  avx2_pack,
+  avx2_unpack
+};
+
+/*
+ * AVX-512
+ * GCC reports _mm512_undefined_* used inside of the intrinsics as uninitialized
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+
+#define AVX512_TARGET __attribute__((target("avx512f,popcnt")))
+
+AVX512_TARGET static inline __m512i avx512_load(const int8_t* p) {
+  return _mm512_loadu_si512(p);
+}
+
+AVX512_TARGET static inline void avx512_store(int8_t* p, __m512i v) {
+  _mm512_storeu_si512(p, v);
+}
+
+AVX512_TARGET static inline __m512i avx512_splat(uint64_t w) {
+  return _mm512_set1_epi64(w);
+}
+
+AVX512_TARGET static inline __m512i avx512_vec_sum(__m512i a, __m512i b) {
+  const __m512i lo = avx512_splat(PACKED_LO_BITS);
+  const __m512i hi = avx512_splat(PACKED_HI_BITS);
+  __m512i s = _mm512_add_epi64(_mm512_and_si512(a, lo), _mm512_and_si512(b, lo));
+  return _mm512_xor_si512(s, _mm512_and_si512(_mm512_xor_si512(a, b), hi));
+}
+
+AVX512_TARGET static inline __m512i avx512_vec_diff(__m512i a, __m512i b) {
+  const __m512i lo = avx512_splat(PACKED_LO_BITS);
+  const __m512i hi = avx512_splat(PACKED_HI_BITS);
+  __m512i d = _mm512_sub_epi64(_mm512_or_si512(a, hi), _mm512_and_si512(b, lo));
+  return _mm512_xor_si512(d, _mm512_andnot_si512(_mm512_xor_si512(a, b), hi));
+}
+
+AVX512_TARGET static inline __m512i avx512_vec_multiply(__m512i a, __m512i b) {
+  const __m512i lo = avx512_splat(PACKED_LO_BITS);
+  __m512i p_lo = _mm512_and_si512(_mm512_and_si512(a, b), lo);
+  __m512i p_hi = _mm512_xor_si512(_mm512_and_si512(_mm512_srli_epi64(a, 1), b),
+                                  _mm512_and_si512(a, _mm512_srli_epi64(b, 1)));
+  return _mm512_or_si512(p_lo, _mm512_slli_epi64(_mm512_and_si512(p_hi, lo), 1));
+}
+
+AVX512_TARGET static inline __m512i avx512_vec_shr(__m512i a, int n) {
+  return _mm512_srl_epi64(a, _mm_cvtsi32_si128(n));
+}
+
+AVX512_TARGET static inline __m512i avx512_vec_shl(__m512i a, int n) {
+  return _mm512_sll_epi64(a, _mm_cvtsi32_si128(n));
+}
+
+DEFINE_VECTOR_KERNELS(avx512, AVX512_TARGET, __m512i, 64, avx512_load, avx512_store, avx512_splat,
+                      _mm512_and_si512, _mm512_xor_si512, popcnt64)
+
+static const PackedKernels avx512_kernels = {
+  Matrix::SimdLevel::AVX512,
+  avx512_sum,
+  avx512_diff,
+  avx512_multiply,
+  avx512_multiply_add,
+  avx512_accumulate,
+  popcnt_planes_dot,
+  avx512_planes_tile,
+  avx512_dot,
+  avx512_transpose32,
+  avx512_pack,
+  avx512_unpack
+};
+
+#pragma GCC diagnostic pop
+
+#endif // PACKED_KERNELS_X86
+
+const PackedKernels* packed_kernels(Matrix::SimdLevel level) {
+  switch (level) {
+  case Matrix::SimdLevel::Scalar:
+    return &scalar_kernels;
+#ifdef PACKED_KERNELS_X86
+  case Matrix::SimdLevel::SSE2:
+    return __builtin_cpu_supports("sse2") ? &sse2_kernels : nullptr;
+  case Matrix::SimdLevel::AVX2:
+    return (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) ? &avx2_kernels : nullptr;
+  case Matrix::SimdLevel::AVX512:
+    return (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("popcnt")) ? &avx512_kernels : nullptr;
+#endif
+  default:
+    return nullptr;
+  }
+}
+
+/**
+ * Best kernels supported by CPU.
+ * Environment variable QMATRIX_SIMD (scalar, sse2, avx2, avx512) overrides the choice,
+ * unsupported values are ignored
+ */
+static const PackedKernels* detect_kernels() {
+  const Matrix::SimdLevel levels[] = {Matrix::SimdLevel::AVX512, Matrix::SimdLevel::AVX2,
+                                      Matrix::SimdLevel::SSE2, Matrix::SimdLevel::Scalar};
+  const char* forced = getenv("QMATRIX_SIMD");
+  if (forced) {
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i) {
+      const PackedKernels* k = packed_kernels(levels[i]);
+      if (k && strcmp(forced, Matrix::simd_level_name(levels[i])) == 0)
+        return k;
+    }
+  }
+  for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i) {
+    const PackedKernels* k = packed_kernels(levels[i]);
+    if (k)
+      return k;
+  }
+  return &scalar_kernels;
+}
+
+static std::atomic<const PackedKernels*> current_kernels(nullptr);
+
+const PackedKernels& packed_kernels() {
+  const PackedKernels* k = current_kernels.load(std::memory_order_relaxed);
+  if (!k) {
+    k = detect_kernels();
+    current_kernels.store(k, std::memory_order_relaxed);
+  }
+  return *k;
+}
+
+Matrix::SimdLevel Matrix::simd_level() {
+  return packed_kernels().level;
+}
+
+void Matrix::set_simd_level(SimdLevel level) {
+  const PackedKernels* k = packed_kernels(level);
+  if (!k) {
+    std::stringstream msg;
+    msg << "Matrix::set_simd_level: " << simd_level_name(level) << " is not supported by CPU";
+    throw std::invalid_argument(msg.str());
+  }
+  current_kernels.store(k, std::memory_order_relaxed);
+}
+
+bool Matrix::simd_supported(SimdLevel level) {
+  return packed_kernels(level) != nullptr;
+}
+
+const char* Matrix::simd_level_name(SimdLevel level) {
+  switch (level) {
+  case SimdLevel::Scalar:
+    return "scalar";
+  case SimdLevel::SSE2:
+    return "sse2";
+  case SimdLevel::AVX2:
+    return "avx2";
+  case SimdLevel::AVX512:
+    return "avx512";
+  }
+  return "unknown";
+}
@@ -0,0 +1,134 @@
+#ifndef PACKED_KERNELS_H
+#define PACKED_KERNELS_H
+
+#include <cstddef>
+#include <cstring>
+
+#include <stdint.h>
+
+#include "matrix_strassen.h"
+
+//! Low bits of all 32 elements packed into 64-bit word
+#define PACKED_LO_BITS 0x5555555555555555ULL
+//! High bits of all 32 elements packed into 64-bit word
+#define PACKED_HI_BITS 0xAAAAAAAAAAAAAAAAULL
+
+/*
+ * Packed arithmetic on 32 elements of a 64-bit word:
+ * 2-bit kernels of PackedWord (see basic_matrix.h)
+ */
+inline uint64_t word_sum(uint64_t a, uint64_t b) {
+  return PackedWord<2>::sum(a, b);
+}
+
+inline uint64_t word_diff(uint64_t a, uint64_t b) {
+  return PackedWord<2>::diff(a, b);
+}
+
+inline uint64_t word_multiply(uint64_t a, uint64_t b) {
+  return PackedWord<2>::multiply(a, b);
+}
+
+//! Word with all 32 elements equal to value
+inline uint64_t word_splat(int8_t value) {
+  return PackedWord<2>::splat(value);
+}
+
+inline uint64_t load_word(const int8_t* p) {
+  uint64_t w;
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+inline void store_word(int8_t* p, uint64_t w) {
+  memcpy(p, &w, sizeof(w));
+}
+
+//! Loads n < 8 bytes, missing bytes are zero
+inline uint64_t load_partial_word(const int8_t* p, size_t n) {
+  uint64_t w = 0;
+  memcpy(&w, p, n);
+  return w;
+}
+
+inline void store_partial_word(int8_t* p, uint64_t w, size_t n) {
+  memcpy(p, &w, n);
+}
+
+//! How products are written into the destination: c = a * b, c += a * b or c -= a * b
+enum class PackedStore {
+  Assign,
+  Add,
+  Subtract
+};
+
+//! Stores n <= 8 bytes of w into p according to store
+inline void store_packed_word(int8_t* p, uint64_t w, size_t n, PackedStore store) {
+  if (store != PackedStore::Assign) {
+    uint64_t old = load_partial_word(p, n);
+    w = (store == PackedStore::Add) ? word_sum(old, w) : word_diff(old, w);
+  }
+  store_partial_word(p, w, n);
+}
+
+//! Rows of lhs processed by one call of planes_tile
+#define PLANES_TILE_ROWS 4
+//! Columns of rhs processed by one call of planes_tile
+#define PLANES_TILE_COLS 8
+
+/**
+ * Set of row kernels for one instruction set.
+ * All kernels take sizes in bytes of packed data, size need not be
+ * a multiple of the vector width; dst may be equal to one of sources
+ */
+struct PackedKernels {
+  Matrix::SimdLevel level;
+  //! dst = a + b
+  void (*sum)(int8_t* dst, const int8_t* a, const int8_t* b, size_t n_bytes);
+  //! dst = a - b
+  void (*diff)(int8_t* dst, const int8_t* a, const int8_t* b, size_t n_bytes);
+  //! dst = a * b element-wise
+  void (*multiply)(int8_t* dst, const int8_t* a, const int8_t* b, size_t n_bytes);
+  //! dst += factor * src
+  void (*multiply_add)(int8_t* dst, const int8_t* src, int8_t factor, size_t n_bytes);
+  //! dst += src[0] + ... + src[count - 1] in one pass over dst
+  void (*accumulate)(int8_t* dst, const int8_t* const* src, size_t count, size_t n_bytes);
+  /**
+   * Dot product modulo 4 of two bit-sliced rows of n_words pairs of words
+   * (low bits word followed by high bits word)
+   */
+  int8_t (*planes_dot)(const uint64_t* a, const uint64_t* b, size_t n_words);
+  /**
+   * Register-tiled block of dot products: PLANES_TILE_ROWS bit-sliced rows of a
+   * times PLANES_TILE_COLS bit-sliced rows of b over n_words words.
+   * Panels are interleaved by words: for every word index low words of all rows
+   * of the panel are followed by their high words.
+   * Results are added to acc[r * acc_stride + c]; only their value modulo 4 is meaningful
+   */
+  void (*planes_tile)(const uint64_t* a, const uint64_t* b, size_t n_words, uint8_t* acc, size_t acc_stride);
+  //! Dot product modulo 4 of two packed rows (lanes beyond the elements should be zero in one of them)
+  int8_t (*dot)(const int8_t* a, const int8_t* b, size_t n_bytes);
+  /**
+   * Transposes block of 32x32 elements packed into 32 words in place:
+   * element c of word r is moved to element r of word c
+   */
+  void (*transpose32)(uint64_t* block);
+  /**
+   * Packs n elements given by bytes of src (taken modulo 4) into (n + 3) / 4 bytes of dst,
+   * bits beyond n elements in the last byte are zero
+   */
+  void (*pack)(int8_t* dst, const uint8_t* src, size_t n);
+  //! Unpacks n elements of packed src into bytes of dst
+  void (*unpack)(uint8_t* dst, const int8_t* src, size_t n);
+};
+
+/**
+ * Kernels in use. Chosen at the first call from CPUID,
+ * may be changed with Matrix::set_simd_level()
+ */
+const PackedKernels& packed_kernels();
+
+//! Kernels for given instruction set or nullptr if CPU does not support it
+const PackedKernels* packed_kernels(Matrix::SimdLevel level);
+
+#endif // PACKED_KERNELS_H
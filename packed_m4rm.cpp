@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "packed_m4rm.h"
+#include "packed_kernels.h"
+
+/*
+ * M4RM_TABLES tables (groups of 4 rows of rhs) are built at once for a block
+ * of M4RM_BLOCK_COLS columns. The tables should fit into L2 cache together
+ * with the block of the result, which is updated once per M4RM_TABLES groups
+ */
+#ifndef M4RM_TABLES
+#define M4RM_TABLES 8
+#endif
+
+//! Width of the column block in elements, should be a multiple of 4
+#ifndef M4RM_BLOCK_COLS
+#define M4RM_BLOCK_COLS 2048
+#endif
+
+//! Number of entries of one table: all values of a packed byte
+#define M4RM_TABLE_SIZE 256
+
+/**
+ * Builds table of all combinations of up to 4 rows of rhs:
+ * entry idx = sum(lane_l(idx) * rows[l])
+ * rows[l] is nullptr for rows beyond the matrix, they are treated as zero.
+ * Multiples v * rows[l] (or -v * rows[l] if negate is true) are computed first,
+ * then every entry is the sum of an already built entry and one of the multiples.
+ * Lanes of the last byte beyond tail_mask are cleared in the multiples
+ */
+static void build_table(int8_t* table, size_t table_stride, int8_t* multiples,
+                        const int8_t* const* rows, size_t n_bytes, bool negate, int8_t tail_mask,
+                        const PackedKernels& kernels) {
+  for (size_t l = 0; l < 4; ++l) {
+    for (size_t v = 1; v < 4; ++v) {
+      int8_t* dst = multiples + (3 * l + v - 1) * table_stride;
+      memset(dst, 0, n_bytes);
+      if (rows[l])
+        kernels.multiply_add(dst, rows[l], negate ? 4 - v : v, n_bytes);
+      dst[n_bytes - 1] &= tail_mask;
+    }
+  }
+  memset(table, 0, n_bytes);
+  for (size_t idx = 1; idx < M4RM_TABLE_SIZE; ++idx) {
+    // The lowest non-zero lane of idx is added to the entry without it
+    size_t l = 0;
+    while (((idx >> (2 * l)) & 0x03) == 0)
+      ++l;
+    size_t v = (idx >> (2 * l)) & 0x03;
+    size_t prev = idx - (v << (2 * l));
+    kernels.sum(table + idx * table_stride, table + prev * table_stride,
+                multiples + (3 * l + v - 1) * table_stride, n_bytes);
+  }
+}
+
+void packed_m4rm(int8_t* c, size_t c_stride,
+                 const int8_t* a, size_t a_stride,
+                 const int8_t* b, size_t b_stride,
+                 size_t m, size_t k, size_t n, PackedStore store) {
+  if (m == 0 || n == 0)
+    return;
+  const PackedKernels& kernels = packed_kernels();
+  size_t c_bytes = (n + 3) / 4;
+  if (store == PackedStore::Assign) {
+    for (size_t i = 0; i < m; ++i) {
+      memset(c + i * c_stride, 0, c_bytes);
+    }
+  }
+  size_t k_bytes = (k + 3) / 4;
+  // Lanes of the last byte of lhs rows beyond k are ignored
+  uint8_t last_mask = (k % 4) ? (0xFF >> (8 - 2 * (k % 4))) : 0xFF;
+  size_t block_bytes = M4RM_BLOCK_COLS / 4;
+  size_t table_stride = std::min(block_bytes, c_bytes);
+  std::vector<int8_t> tables(M4RM_TABLES * M4RM_TABLE_SIZE * table_stride);
+  std::vector<int8_t> multiples(12 * table_stride);
+  // Lanes of rhs beyond n are cleared in the tables, so they never get into c
+  int8_t last_tail_mask = (n % 4) ? (0xFF >> (8 - 2 * (n % 4))) : 0xFF;
+  for (size_t jb = 0; jb < c_bytes; jb += block_bytes) {
+    size_t n_bytes = std::min(block_bytes, c_bytes - jb);
+    int8_t tail_mask = (jb + n_bytes == c_bytes) ? last_tail_mask : 0xFF;
+    for (size_t g0 = 0; g0 < k_bytes; g0 += M4RM_TABLES) {
+      size_t n_tables = std::min<size_t>(M4RM_TABLES, k_bytes - g0);
+      for (size_t t = 0; t < n_tables; ++t) {
+        const int8_t* rows[4];
+        for (size_t l = 0; l < 4; ++l) {
+          size_t row = 4 * (g0 + t) + l;
+          rows[l] = (row < k) ? b + row * b_stride + jb : nullptr;
+        }
+        build_table(tables.data() + t * M4RM_TABLE_SIZE * table_stride, table_stride,
+                    multiples.data(), rows, n_bytes, store == PackedStore::Subtract, tail_mask, kernels);
+      }
+      for (size_t i = 0; i < m; ++i) {
+        const uint8_t* a_row = reinterpret_cast<const uint8_t*>(a + i * a_stride);
+        const int8_t* entries[M4RM_TABLES];
+        size_t n_entries = 0;
+        for (size_t t = 0; t < n_tables; ++t) {
+          size_t g = g0 + t;
+          uint8_t idx = (g == k_bytes - 1) ? (a_row[g] & last_mask) : a_row[g];
+          if (idx != 0)
+            entries[n_entries++] = tables.data() + (t * M4RM_TABLE_SIZE + idx) * table_stride;
+        }
+        if (n_entries)
+          kernels.accumulate(c + i * c_stride + jb, entries, n_entries, n_bytes);
+      }
+    }
+  }
+}
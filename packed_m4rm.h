@@ -0,0 +1,31 @@
+#ifndef PACKED_M4RM_H
+#define PACKED_M4RM_H
+
+#include <cstddef>
+
+#include <stdint.h>
+
+#include "packed_kernels.h"
+
+/**
+ * c = a * b for packed matrices of sizes [m x k] * [k x n]
+ * with the Method of Four Russians.
+ * Arguments have the same meaning as for packed_gemm().
+ *
+ * Every packed byte of a row of lhs holds 4 elements, so for each group
+ * of 4 rows of rhs all 256 linear combinations are precomputed once,
+ * and the byte of lhs is used as an index into this table: every row of c
+ * gets one packed row addition per 4 elements of the lhs row.
+ * Tables for several groups are built at once for a block of columns,
+ * so that they stay in L2 cache while all rows of c are updated.
+ *
+ * With PackedStore::Add and PackedStore::Subtract the product is accumulated
+ * into c (tables of negated combinations are used for subtraction),
+ * lanes of the last byte of c rows beyond n are kept then
+ */
+void packed_m4rm(int8_t* c, size_t c_stride,
+                 const int8_t* a, size_t a_stride,
+                 const int8_t* b, size_t b_stride,
+                 size_t m, size_t k, size_t n, PackedStore store = PackedStore::Assign);
+
+#endif // PACKED_M4RM_H
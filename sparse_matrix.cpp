@@ -0,0 +1,149 @@
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+
+#include "packed_kernels.h"
+#include "sparse_matrix.h"
+
+SparseMatrix::SparseMatrix(size_t row, size_t col)
+             :row_(row), col_(col), row_begin_(row + 1, 0), columns_(), values_() {
+}
+
+SparseMatrix::SparseMatrix(size_t row, size_t col, size_t nonzeros)
+             :row_(row), col_(col), row_begin_(1, 0), columns_(), values_() {
+  row_begin_.reserve(row + 1);
+  columns_.reserve(nonzeros);
+  values_.reserve(nonzeros);
+}
+
+SparseMatrix::SparseMatrix(ConstMatrixView m)
+             :row_(m.row()), col_(m.col()), row_begin_(1, 0), columns_(), values_() {
+  row_begin_.reserve(row_ + 1);
+  size_t n_bytes = (col_ + 3) / 4;
+  for (size_t i = 0; i < row_; ++i) {
+    const int8_t* data = m.row_data(i);
+    for (size_t b = 0; b < n_bytes; b += 8) {
+      size_t n = std::min<size_t>(8, n_bytes - b);
+      uint64_t w = (n == 8) ? load_word(data + b) : load_partial_word(data + b, n);
+      // The last byte of a block may hold elements of the next columns
+      size_t lanes = col_ - b * 4;
+      if (lanes < 32)
+        w &= (1ULL << (2 * lanes)) - 1;
+      uint64_t nonzero = (w | (w >> 1)) & PACKED_LO_BITS;
+      while (nonzero) {
+        size_t shift = __builtin_ctzll(nonzero);
+        columns_.push_back(b * 4 + shift / 2);
+        values_.push_back((w >> shift) & 0x03);
+        nonzero &= nonzero - 1;
+      }
+    }
+    row_begin_.push_back(values_.size());
+  }
+}
+
+Matrix SparseMatrix::to_matrix() const {
+  Matrix m(row_, col_);
+  MatrixView v(m);
+  for (size_t i = 0; i < row_; ++i) {
+    for (size_t k = row_begin_[i]; k < row_begin_[i + 1]; ++k) {
+      v.set(i, columns_[k], values_[k]);
+    }
+  }
+  return m;
+}
+
+bool operator==(const SparseMatrix& lhs, const SparseMatrix& rhs) {
+  return (lhs.row_ == rhs.row_) && (lhs.col_ == rhs.col_) && (lhs.row_begin_ == rhs.row_begin_) &&
+         (lhs.columns_ == rhs.columns_) && (lhs.values_ == rhs.values_);
+}
+
+void SparseMatrix::check_product(const char* func, const SparseMatrix& lhs, size_t rhs_row) {
+  if (lhs.col_ != rhs_row) {
+    std::stringstream msg;
+    msg << func << ": Column number of first matrix should be equal to row number of the second matrix ("
+        << lhs.col_ << " and " << rhs_row << " provided)";
+    throw std::length_error(msg.str());
+  }
+}
+
+Matrix SparseMatrix::operator*(const Matrix& rhs) const {
+  check_product("SparseMatrix::operator*", *this, rhs.row());
+  Matrix m(row_, rhs.col());
+  MatrixView c(m);
+  ConstMatrixView b(rhs);
+  size_t n_bytes = (rhs.col() + 3) / 4;
+  const PackedKernels& kernels = packed_kernels();
+  for (size_t i = 0; i < row_; ++i) {
+    int8_t* dst = c.row_data(i);
+    for (size_t k = row_begin_[i]; k < row_begin_[i + 1]; ++k) {
+      kernels.multiply_add(dst, b.row_data(columns_[k]), values_[k], n_bytes);
+    }
+  }
+  return m;
+}
+
+SparseMatrix SparseMatrix::operator*(const SparseMatrix& rhs) const {
+  check_product("SparseMatrix::operator*", *this, rhs.row_);
+  SparseMatrix m(row_, rhs.col_, values_.size());
+  // Unsigned sums wrap modulo 256, which keeps them right modulo 4
+  std::vector<uint8_t> acc(rhs.col_, 0);
+  // Columns touched by i-th row are marked by i + 1
+  std::vector<size_t> mark(rhs.col_, 0);
+  std::vector<size_t> touched;
+  for (size_t i = 0; i < row_; ++i) {
+    touched.clear();
+    for (size_t k = row_begin_[i]; k < row_begin_[i + 1]; ++k) {
+      size_t r = columns_[k];
+      uint8_t f = values_[k];
+      for (size_t t = rhs.row_begin_[r]; t < rhs.row_begin_[r + 1]; ++t) {
+        size_t j = rhs.columns_[t];
+        if (mark[j] != i + 1) {
+          mark[j] = i + 1;
+          touched.push_back(j);
+        }
+        acc[j] = static_cast<uint8_t>(acc[j] + f * rhs.values_[t]);
+      }
+    }
+    std::sort(touched.begin(), touched.end());
+    for (size_t j : touched) {
+      if (acc[j] & 0x03) {
+        m.columns_.push_back(j);
+        m.values_.push_back(static_cast<int8_t>(acc[j] & 0x03));
+      }
+      acc[j] = 0;
+    }
+    m.row_begin_.push_back(m.values_.size());
+  }
+  return m;
+}
+
+int8_t SparseMatrix::get(size_t i, size_t j) const {
+  std::vector<size_t>::const_iterator begin = columns_.begin() + row_begin_[i];
+  std::vector<size_t>::const_iterator end = columns_.begin() + row_begin_[i + 1];
+  std::vector<size_t>::const_iterator it = std::lower_bound(begin, end, j);
+  return ((it != end) && (*it == j)) ? values_[it - columns_.begin()] : 0;
+}
+
+double SparseMatrix::density() const {
+  if (!row_ || !col_)
+    return 0;
+  return static_cast<double>(values_.size()) / row_ / col_;
+}
+
+size_t SparseMatrix::count_nonzeros(ConstMatrixView m, size_t limit) {
+  size_t count = 0;
+  size_t n_bytes = (m.col() + 3) / 4;
+  for (size_t i = 0; (i < m.row()) && (count <= limit); ++i) {
+    const int8_t* data = m.row_data(i);
+    for (size_t b = 0; b < n_bytes; b += 8) {
+      size_t n = std::min<size_t>(8, n_bytes - b);
+      uint64_t w = (n == 8) ? load_word(data + b) : load_partial_word(data + b, n);
+      size_t lanes = m.col() - b * 4;
+      if (lanes < 32)
+        w &= (1ULL << (2 * lanes)) - 1;
+      count += __builtin_popcountll((w | (w >> 1)) & PACKED_LO_BITS);
+    }
+  }
+  return count;
+}
@@ -0,0 +1,79 @@
+#ifndef SPARSE_MATRIX_H
+#define SPARSE_MATRIX_H
+
+#include <cstddef>
+#include <vector>
+
+#include <stdint.h>
+
+#include "matrix_strassen.h"
+
+/**
+ * [row x col] matrix over Z/4 in compressed sparse row format:
+ * nonzero elements of i-th row are values()[k] in columns columns()[k]
+ * for k in [row_begin()[i], row_begin()[i + 1]), columns of a row are increasing.
+ * Memory and multiplication cost are proportional to the number of nonzero elements,
+ * so it is intended for matrices like adjacency ones with a few nonzeros per row
+ */
+class SparseMatrix {
+public:
+  //! Zero matrix
+  SparseMatrix(size_t row, size_t col);
+  //! Nonzero elements of the viewed block
+  explicit SparseMatrix(ConstMatrixView m);
+  Matrix to_matrix() const;
+  friend bool operator==(const SparseMatrix& lhs, const SparseMatrix& rhs);
+  /**
+   * Sparse x dense product: every nonzero a(i, k) adds its multiple of k-th row of rhs
+   * to i-th row of the result with the packed row kernels.
+   * Throws std::length_error if column number of this matrix
+   * is not equal to row number of the rhs
+   */
+  Matrix operator*(const Matrix& rhs) const;
+  /**
+   * Sparse x sparse product: rows of the result are accumulated in a dense row buffer
+   * over the nonzeros of the rows of rhs (Gustavson algorithm), zero sums are dropped.
+   * Throws std::length_error as operator*(const Matrix&)
+   */
+  SparseMatrix operator*(const SparseMatrix& rhs) const;
+  //! Binary search of the element in its row
+  int8_t get(size_t i, size_t j) const;
+  inline size_t row() const {
+    return row_;
+  }
+  inline size_t col() const {
+    return col_;
+  }
+  inline size_t nonzeros() const {
+    return values_.size();
+  }
+  //! Share of the nonzero elements
+  double density() const;
+  //! row() + 1 offsets of the rows in columns() and values()
+  inline const std::vector<size_t>& row_begin() const {
+    return row_begin_;
+  }
+  inline const std::vector<size_t>& columns() const {
+    return columns_;
+  }
+  //! Nonzero values 1, 2 or 3
+  inline const std::vector<int8_t>& values() const {
+    return values_;
+  }
+  /**
+   * Number of the nonzero elements of the viewed block counted by words of packed rows,
+   * counting stops as soon as it exceeds limit
+   */
+  static size_t count_nonzeros(ConstMatrixView m, size_t limit = SIZE_MAX);
+private:
+  //! row x col matrix with no rows yet, they are appended to row_begin_
+  SparseMatrix(size_t row, size_t col, size_t nonzeros);
+  static void check_product(const char* func, const SparseMatrix& lhs, size_t rhs_row);
+  size_t row_;
+  size_t col_;
+  std::vector<size_t> row_begin_;
+  std::vector<size_t> columns_;
+  std::vector<int8_t> values_;
+};
+
+#endif // SPARSE_MATRIX_H
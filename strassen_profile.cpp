@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+
+#include "matrix_strassen.h"
+#include "strassen_profile.h"
+
+#define STRASSEN_PROFILE_COUNTERS 7
+#define STRASSEN_PROFILE_PHASES 5
+
+/*
+ * Relaxed atomics: counters are only summed, snapshots taken while
+ * multiplications are running may mix values of different moments
+ */
+static std::atomic<uint64_t> profile_counters[STRASSEN_PROFILE_LEVELS][STRASSEN_PROFILE_COUNTERS];
+static std::atomic<uint64_t> profile_times[STRASSEN_PROFILE_LEVELS][STRASSEN_PROFILE_PHASES];
+static std::atomic<uint64_t> profile_bytes[STRASSEN_PROFILE_LEVELS];
+static std::atomic<uint64_t> live_bytes(0);
+static std::atomic<uint64_t> peak_live_bytes(0);
+
+static size_t profile_level(size_t depth) {
+  return std::min<size_t>(depth, STRASSEN_PROFILE_LEVELS - 1);
+}
+
+void strassen_profile_count(size_t depth, StrassenCounter counter, uint64_t n) {
+  profile_counters[profile_level(depth)][static_cast<size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+}
+
+void strassen_profile_time(size_t depth, StrassenPhase phase, uint64_t ns) {
+  profile_times[profile_level(depth)][static_cast<size_t>(phase)].fetch_add(ns, std::memory_order_relaxed);
+}
+
+void strassen_profile_allocate(size_t depth, uint64_t bytes) {
+  profile_bytes[profile_level(depth)].fetch_add(bytes, std::memory_order_relaxed);
+  uint64_t live = live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  uint64_t peak = peak_live_bytes.load(std::memory_order_relaxed);
+  while ((live > peak) && !peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+  }
+}
+
+void strassen_profile_release(uint64_t bytes) {
+  live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+#ifdef STRASSEN_PROFILE
+static uint64_t counter(size_t level, StrassenCounter c) {
+  return profile_counters[level][static_cast<size_t>(c)].load(std::memory_order_relaxed);
+}
+
+static uint64_t phase_time(size_t level, StrassenPhase p) {
+  return profile_times[level][static_cast<size_t>(p)].load(std::memory_order_relaxed);
+}
+#endif
+
+StrassenProfile strassen_profile() {
+  StrassenProfile profile;
+#ifdef STRASSEN_PROFILE
+  profile.enabled = true;
+  profile.threads = Matrix::thread_count();
+  profile.peak_live_bytes = peak_live_bytes.load(std::memory_order_relaxed);
+  size_t depth = 0;
+  for (size_t level = 0; level < STRASSEN_PROFILE_LEVELS; ++level) {
+    if (counter(level, StrassenCounter::Calls))
+      depth = level + 1;
+  }
+  for (size_t level = 0; level < depth; ++level) {
+    StrassenLevelProfile l;
+    l.calls = counter(level, StrassenCounter::Calls);
+    l.strassen_steps = counter(level, StrassenCounter::StrassenSteps);
+    l.split_calls = counter(level, StrassenCounter::SplitCalls);
+    l.base_calls = counter(level, StrassenCounter::BaseCalls);
+    l.tasks = counter(level, StrassenCounter::Tasks);
+    l.bytes_allocated = profile_bytes[level].load(std::memory_order_relaxed);
+    l.element_ops = counter(level, StrassenCounter::ElementOps);
+    l.peeled_ops = counter(level, StrassenCounter::PeeledOps);
+    l.split_ns = phase_time(level, StrassenPhase::Split);
+    l.operands_ns = phase_time(level, StrassenPhase::Operands);
+    l.combine_ns = phase_time(level, StrassenPhase::Combine);
+    l.base_ns = phase_time(level, StrassenPhase::Base);
+    l.peeling_ns = phase_time(level, StrassenPhase::Peeling);
+    profile.levels.push_back(l);
+  }
+#endif
+  return profile;
+}
+
+void reset_strassen_profile() {
+  for (size_t level = 0; level < STRASSEN_PROFILE_LEVELS; ++level) {
+    for (size_t c = 0; c < STRASSEN_PROFILE_COUNTERS; ++c) {
+      profile_counters[level][c].store(0, std::memory_order_relaxed);
+    }
+    for (size_t p = 0; p < STRASSEN_PROFILE_PHASES; ++p) {
+      profile_times[level][p].store(0, std::memory_order_relaxed);
+    }
+    profile_bytes[level].store(0, std::memory_order_relaxed);
+  }
+  peak_live_bytes.store(live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+std::string StrassenProfile::to_json() const {
+  std::stringstream out;
+  out << "{\n  \"enabled\": " << (enabled ? "true" : "false") << ",\n"
+      << "  \"threads\": " << threads << ",\n"
+      << "  \"peak_live_bytes\": " << peak_live_bytes << ",\n"
+      << "  \"levels\": [";
+  for (size_t i = 0; i < levels.size(); ++i) {
+    const StrassenLevelProfile& l = levels[i];
+    out << (i ? "," : "") << "\n    {\"depth\": " << i << ", \"calls\": " << l.calls
+        << ", \"strassen_steps\": " << l.strassen_steps << ", \"split_calls\": " << l.split_calls
+        << ", \"base_calls\": " << l.base_calls << ", \"tasks\": " << l.tasks
+        << ", \"bytes_allocated\": " << l.bytes_allocated << ", \"element_ops\": " << l.element_ops
+        << ", \"peeled_ops\": " << l.peeled_ops << ", \"split_ns\": " << l.split_ns
+        << ", \"operands_ns\": " << l.operands_ns << ", \"combine_ns\": " << l.combine_ns
+        << ", \"base_ns\": " << l.base_ns << ", \"peeling_ns\": " << l.peeling_ns << "}";
+  }
+  out << "\n  ]\n}\n";
+  return out.str();
+}
@@ -0,0 +1,145 @@
+#ifndef STRASSEN_PROFILE_H
+#define STRASSEN_PROFILE_H
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+//! Recursion levels profiled separately, deeper levels are added to the last one
+#define STRASSEN_PROFILE_LEVELS 32
+
+/**
+ * Counters and timers of one level of Strassen recursion (Matrix::strassen() calls
+ * with the same depth: 0 for the whole product, 1 for its sub-products and so on).
+ * Times are summed over all threads, so with parallel recursion they may exceed the wall time
+ */
+struct StrassenLevelProfile {
+  //! Calls of the recursion on this level
+  uint64_t calls;
+  //! Calls split into quadrants with 7 sub-products
+  uint64_t strassen_steps;
+  //! Long and thin blocks halved into 2 products, and large base case blocks split for parallelism
+  uint64_t split_calls;
+  //! Base case products, including the ones of the peeled rows and columns
+  uint64_t base_calls;
+  //! Tasks submitted to the thread pool
+  uint64_t tasks;
+  //! Bytes of temporary matrices: products, operand sums and split accumulators
+  uint64_t bytes_allocated;
+  //! Sum of m * k * n of the calls
+  uint64_t element_ops;
+  //! Sum of m * k * n of the products of peeled rows and columns (overhead of odd sizes)
+  uint64_t peeled_ops;
+  //! Allocation of the quadrant products
+  uint64_t split_ns;
+  //! Sums of the operands of the sub-products
+  uint64_t operands_ns;
+  //! Combination of the sub-products into the quadrants
+  uint64_t combine_ns;
+  //! Base case products of the blocks not larger than the crossover
+  uint64_t base_ns;
+  //! Base case products of the peeled rows and columns
+  uint64_t peeling_ns;
+};
+
+/**
+ * Snapshot of the counters collected since the start or the last reset_strassen_profile().
+ * Collected only if the library is compiled with STRASSEN_PROFILE defined,
+ * otherwise the hooks compile to nothing and the snapshot is empty
+ */
+struct StrassenProfile {
+  StrassenProfile() :enabled(false), threads(0), peak_live_bytes(0), levels() {}
+  bool enabled;
+  //! Matrix::thread_count() at the time of the snapshot
+  size_t threads;
+  //! Maximum of the bytes of temporaries alive at once
+  uint64_t peak_live_bytes;
+  //! Levels from 0 to the deepest one reached
+  std::vector<StrassenLevelProfile> levels;
+  std::string to_json() const;
+};
+
+StrassenProfile strassen_profile();
+void reset_strassen_profile();
+
+enum class StrassenCounter {
+  Calls,
+  StrassenSteps,
+  SplitCalls,
+  BaseCalls,
+  Tasks,
+  ElementOps,
+  PeeledOps
+};
+
+enum class StrassenPhase {
+  Split,
+  Operands,
+  Combine,
+  Base,
+  Peeling
+};
+
+void strassen_profile_count(size_t depth, StrassenCounter counter, uint64_t n);
+void strassen_profile_time(size_t depth, StrassenPhase phase, uint64_t ns);
+void strassen_profile_allocate(size_t depth, uint64_t bytes);
+void strassen_profile_release(uint64_t bytes);
+
+//! Adds time from construction to stop() (or destruction) to the phase
+class StrassenProfileTimer {
+public:
+  StrassenProfileTimer(size_t depth, StrassenPhase phase)
+                      :depth_(depth), phase_(phase), start_(std::chrono::steady_clock::now()), stopped_(false) {}
+  ~StrassenProfileTimer() {
+    stop();
+  }
+  void stop() {
+    if (stopped_)
+      return;
+    stopped_ = true;
+    std::chrono::steady_clock::duration d = std::chrono::steady_clock::now() - start_;
+    strassen_profile_time(depth_, phase_, std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+  }
+private:
+  size_t depth_;
+  StrassenPhase phase_;
+  std::chrono::steady_clock::time_point start_;
+  bool stopped_;
+};
+
+//! Temporaries of the given size are alive while this object is alive
+class StrassenProfileMemory {
+public:
+  StrassenProfileMemory(size_t depth, uint64_t bytes) :bytes_(bytes) {
+    strassen_profile_allocate(depth, bytes);
+  }
+  ~StrassenProfileMemory() {
+    strassen_profile_release(bytes_);
+  }
+  StrassenProfileMemory(const StrassenProfileMemory&) = delete;
+  StrassenProfileMemory& operator=(const StrassenProfileMemory&) = delete;
+private:
+  uint64_t bytes_;
+};
+
+/*
+ * Hooks of Matrix::strassen(): without STRASSEN_PROFILE they expand to nothing.
+ * STRASSEN_PROFILE_START starts timer of the phase which runs until STRASSEN_PROFILE_STOP
+ * or the end of the scope, STRASSEN_PROFILE_MEMORY accounts temporaries until the end of the scope
+ */
+#ifdef STRASSEN_PROFILE
+#define STRASSEN_PROFILE_COUNT(depth, counter, n) strassen_profile_count(depth, StrassenCounter::counter, n)
+#define STRASSEN_PROFILE_START(depth, phase) StrassenProfileTimer strassen_profile_##phase(depth, StrassenPhase::phase)
+#define STRASSEN_PROFILE_STOP(phase) strassen_profile_##phase.stop()
+#define STRASSEN_PROFILE_MEMORY(depth, bytes) StrassenProfileMemory strassen_profile_memory(depth, bytes)
+#else
+#define STRASSEN_PROFILE_COUNT(depth, counter, n) do {} while (0)
+#define STRASSEN_PROFILE_START(depth, phase) do {} while (0)
+#define STRASSEN_PROFILE_STOP(phase) do {} while (0)
+#define STRASSEN_PROFILE_MEMORY(depth, bytes) do {} while (0)
+#endif
+
+#endif // STRASSEN_PROFILE_H
@@ -0,0 +1,205 @@
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+
+#include <gtest/gtest.h>
+
+#include "matrix_strassen.h"
+
+static_assert(std::is_same<Matrix, BasicMatrix<2> >::value, "Matrix should be BasicMatrix<2>");
+
+//! Word kernels are compared lane by lane with the scalar arithmetic modulo 2^Bits
+template <unsigned Bits>
+static void check_kernels() {
+  typedef PackedWord<Bits> Word;
+  std::mt19937_64 gen(Bits);
+  for (size_t attempt = 0; attempt < 1000; ++attempt) {
+    uint64_t a = gen();
+    uint64_t b = gen();
+    uint64_t sum = Word::sum(a, b);
+    uint64_t diff = Word::diff(a, b);
+    uint64_t product = Word::multiply(a, b);
+    unsigned factor = b & Word::mask;
+    uint64_t scaled = Word::scale(a, factor);
+    unsigned dot = 0;
+    for (size_t lane = 0; lane < Word::lanes; ++lane) {
+      size_t shift = lane * Bits;
+      uint64_t x = (a >> shift) & Word::mask;
+      uint64_t y = (b >> shift) & Word::mask;
+      ASSERT_EQ((sum >> shift) & Word::mask, (x + y) & Word::mask);
+      ASSERT_EQ((diff >> shift) & Word::mask, (x - y) & Word::mask);
+      ASSERT_EQ((product >> shift) & Word::mask, (x * y) & Word::mask);
+      ASSERT_EQ((scaled >> shift) & Word::mask, (x * factor) & Word::mask);
+      dot += x * y;
+    }
+    ASSERT_EQ(Word::dot(a, b) & Word::mask, dot & Word::mask);
+  }
+  ASSERT_EQ(Word::splat(1), Word::lo_bits);
+  ASSERT_EQ(Word::splat(Word::mask), ~0ULL);
+}
+
+TEST(BasicMatrixTest, KernelsTest) {
+  check_kernels<1>();
+  check_kernels<2>();
+  check_kernels<4>();
+  check_kernels<8>();
+}
+
+//! Operations are compared with element by element computations modulo 2^Bits
+template <unsigned Bits>
+static void check_arithmetic() {
+  typedef BasicMatrix<Bits> M;
+  unsigned modulo = 1u << Bits;
+  size_t sizes[][3] = {{1, 1, 1}, {37, 70, 5}, {70, 129, 66}, {0, 3, 2}, {130, 64, 1}};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    M a(sizes[s][0], sizes[s][1]);
+    M b(sizes[s][0], sizes[s][1]);
+    M c(sizes[s][1], sizes[s][2]);
+    for (size_t i = 0; i < a.row(); ++i) {
+      for (size_t j = 0; j < a.col(); ++j) {
+        a.set(i, j, rand());
+        b.set(i, j, rand());
+      }
+    }
+    for (size_t i = 0; i < c.row(); ++i) {
+      for (size_t j = 0; j < c.col(); ++j) {
+        c.set(i, j, rand());
+      }
+    }
+    M sum(a + b);
+    M diff(a - b);
+    M transposed(a.transposed());
+    M product(a * c);
+    for (size_t i = 0; i < a.row(); ++i) {
+      for (size_t j = 0; j < a.col(); ++j) {
+        ASSERT_EQ(sum.get(i, j), (a.get(i, j) + b.get(i, j)) % modulo);
+        ASSERT_EQ(diff.get(i, j), (a.get(i, j) + modulo - b.get(i, j)) % modulo);
+        ASSERT_EQ(transposed.get(j, i), a.get(i, j));
+      }
+      for (size_t j = 0; j < c.col(); ++j) {
+        unsigned expected = 0;
+        for (size_t k = 0; k < a.col(); ++k) {
+          expected += a.get(i, k) * c.get(k, j);
+        }
+        ASSERT_EQ(product.get(i, j), expected % modulo);
+      }
+    }
+    ASSERT_EQ(sum - b, a);
+  }
+  ASSERT_THROW(M(2, 3) * M(2, 3), std::length_error);
+  ASSERT_THROW(M(2, 3) + M(3, 2), std::length_error);
+  ASSERT_THROW(M(2, 3) - M(2, 2), std::length_error);
+  M m({{1, 2, 3}, {4, 5, -1}});
+  ASSERT_EQ(m.get(1, 2), modulo - 1);
+  ASSERT_EQ(m.get(1, 0), 4 % modulo);
+  m.clear();
+  ASSERT_EQ(m, M(2, 3));
+  ASSERT_THROW(M({{1, 2}, {3}}), std::length_error);
+}
+
+TEST(BasicMatrixTest, ArithmeticTest) {
+  check_arithmetic<1>();
+  check_arithmetic<4>();
+  check_arithmetic<8>();
+}
+
+//! All multiplication algorithms are compared with BasicMatrix::multiply_trivial()
+template <unsigned Bits>
+static void check_multiplication() {
+  typedef BasicMatrix<Bits> M;
+  std::mt19937 gen(Bits);
+  // Strassen recursion is reached by small matrices
+  size_t crossover = M::strassen_crossover();
+  M::set_strassen_crossover(64);
+  size_t sizes[][3] = {{1, 1, 1}, {9, 17, 3}, {65, 130, 70}, {64 + 3, 64 + 70, 64 + 1},
+                       {2 * 64 + 5, 3 * 64, 2 * 64 + 9}};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    M a(sizes[s][0], sizes[s][1]);
+    M b(sizes[s][1], sizes[s][2]);
+    for (size_t i = 0; i < a.row(); ++i) {
+      for (size_t j = 0; j < a.col(); ++j) {
+        a.set(i, j, gen());
+      }
+    }
+    for (size_t i = 0; i < b.row(); ++i) {
+      for (size_t j = 0; j < b.col(); ++j) {
+        b.set(i, j, gen());
+      }
+    }
+    M expected(M::multiply_trivial(a, b));
+    ASSERT_EQ(M::multiply_m4rm(a, b), expected);
+    ASSERT_EQ(M::multiply_strassen(a, b), expected);
+  }
+  M::set_strassen_crossover(crossover);
+  ASSERT_EQ(M::strassen_crossover(), crossover);
+  ASSERT_THROW(M::set_strassen_crossover(M::Word::lanes - 1), std::invalid_argument);
+  ASSERT_THROW(M::multiply_trivial(M(2, 3), M(2, 3)), std::length_error);
+  ASSERT_THROW(M::multiply_m4rm(M(2, 3), M(2, 3)), std::length_error);
+  ASSERT_THROW(M::multiply_strassen(M(2, 3), M(2, 3)), std::length_error);
+}
+
+TEST(BasicMatrixTest, MultiplicationTest) {
+  check_multiplication<1>();
+  check_multiplication<8>();
+}
+
+//! Constructors, element accessors and rows are used the same way for every width, Matrix included
+template <unsigned Bits>
+static void check_interface() {
+  typedef BasicMatrix<Bits> M;
+  typedef typename M::Word Word;
+  M m({{1, -1, 3}, {-2, 0, 5}});
+  ASSERT_EQ(m.get(0, 1), Word::mask);
+  ASSERT_EQ(m.get(1, 0), (Word::mask - 1) & Word::mask);
+  m.set(1, 1, -1);
+  m.set(1, 2, Word::mask + 2);
+  ASSERT_EQ(m.get(1, 1), Word::mask);
+  ASSERT_EQ(m.get(1, 2), 1);
+  static_assert(std::is_same<decltype(m.get(0, 0)), uint8_t>::value, "Elements should be read as uint8_t");
+  M big(3, 2 * Word::lanes + 1);
+  big.set(2, 2 * Word::lanes, 1);
+  big.set(1, Word::lanes - 1, Word::mask);
+  for (size_t i = 0; i < big.row(); ++i) {
+    const uint64_t* words = big.row_words(i);
+    for (size_t j = 0; j < big.col(); ++j) {
+      ASSERT_EQ((words[j / Word::lanes] >> (j % Word::lanes * Bits)) & Word::mask, big.get(i, j));
+    }
+    // Padding lanes of the last word are zero
+    ASSERT_EQ(words[2] >> Bits, 0u);
+  }
+  M copy(big);
+  copy.row_words(0)[0] = Word::splat(1);
+  ASSERT_EQ(copy.get(0, Word::lanes - 1), 1);
+  ASSERT_EQ(big.get(0, Word::lanes - 1), 0);
+  ASSERT_THROW(M({{1, 2}, {3}}), std::length_error);
+}
+
+TEST(BasicMatrixTest, InterfaceTest) {
+  check_interface<1>();
+  check_interface<2>();
+  check_interface<4>();
+  check_interface<8>();
+}
+
+TEST(BasicMatrixTest, BitMatrixConversionTest) {
+  size_t sizes[][2] = {{1, 1}, {3, 31}, {5, 64}, {7, 100}, {2, 257}, {0, 5}};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    Matrix m(sizes[s][0], sizes[s][1]);
+    for (size_t i = 0; i < m.row(); ++i) {
+      for (size_t j = 0; j < m.col(); ++j) {
+        m.set(i, j, rand() % 4);
+      }
+    }
+    BitMatrix bits(m.mod2());
+    Matrix lifted(bits);
+    ASSERT_EQ(bits.row(), m.row());
+    ASSERT_EQ(bits.col(), m.col());
+    for (size_t i = 0; i < m.row(); ++i) {
+      for (size_t j = 0; j < m.col(); ++j) {
+        ASSERT_EQ(bits.get(i, j), m.get(i, j) % 2);
+        ASSERT_EQ(lifted.get(i, j), m.get(i, j) % 2);
+      }
+    }
+    ASSERT_EQ(lifted.mod2(), bits);
+  }
+}
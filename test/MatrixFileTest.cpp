@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#include <malloc.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "matrix_file.h"
+#include "matrix_test_utils.h"
+
+TEST(MatrixFileTest, SaveLoadTest) {
+  const char* path = "qmatrix_test.bin";
+  size_t sizes[][2] = {{0, 0}, {0, 5}, {3, 0}, {1, 1}, {7, 13}, {64, 64}, {130, 257}};
+  for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+    Matrix a(sizes[n][0], sizes[n][1]);
+    fill_random(a);
+    a.save(path);
+    Matrix b(Matrix::load(path));
+    ASSERT_EQ(b, a);
+    MappedMatrix mapped(path);
+    ASSERT_EQ(mapped.row(), a.row());
+    ASSERT_EQ(mapped.col(), a.col());
+    ASSERT_EQ(Matrix(mapped.view()), a);
+  }
+  remove(path);
+}
+
+//! Mapped operands are used in place by the functions taking views
+TEST(MatrixFileTest, MappedMultiplicationTest) {
+  const char* path_a = "qmatrix_test_a.bin";
+  const char* path_b = "qmatrix_test_b.bin";
+  Matrix a(150, 70);
+  Matrix b(70, 90);
+  fill_random(a);
+  fill_random(b);
+  a.save(path_a);
+  b.save(path_b);
+  {
+    MappedMatrix mapped_a(path_a);
+    MappedMatrix moved(path_b, false);
+    MappedMatrix mapped_b(std::move(moved));
+    ASSERT_EQ(moved.row(), 0u);
+    Matrix c(150, 90);
+    Matrix::gemm(c, mapped_a.view(), mapped_b.view());
+    ASSERT_EQ(c, Matrix::multiply_trivial(a, b));
+  }
+  remove(path_a);
+  remove(path_b);
+}
+
+TEST(MatrixFileTest, MalformedFileTest) {
+  const char* path = "qmatrix_test.bin";
+  ASSERT_THROW(Matrix::load("qmatrix_test_missing.bin"), std::runtime_error);
+  ASSERT_THROW(MappedMatrix("qmatrix_test_missing.bin"), std::runtime_error);
+  Matrix a(20, 30);
+  fill_random(a);
+  a.save(path);
+  std::string content;
+  {
+    std::ifstream in(path, std::ios::binary);
+    content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  // Corrupted data, truncated data, bad magic and bad version
+  std::string corrupted(content);
+  corrupted[corrupted.size() - 9] ^= 0x01;
+  std::string bad[] = {corrupted, content.substr(0, content.size() - 1), "X" + content.substr(1),
+                       content.substr(0, 8) + '\x02' + content.substr(9), content.substr(0, 10)};
+  for (size_t n = 0; n < sizeof(bad) / sizeof(bad[0]); ++n) {
+    {
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      out << bad[n];
+    }
+    ASSERT_THROW(Matrix::load(path), std::runtime_error);
+    ASSERT_THROW(MappedMatrix mapped(path), std::runtime_error);
+  }
+  // Checksum is not checked when verification is disabled
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << corrupted;
+  }
+  MappedMatrix mapped(path, false);
+  ASSERT_EQ(mapped.row(), 20u);
+  remove(path);
+}
+
+//! Headers with sizes which overflow when rows are measured or multiplied by the stride
+TEST(MatrixFileTest, CraftedHeaderTest) {
+  const char* path = "qmatrix_test.bin";
+  uint64_t fields[][3] = {{1, UINT64_MAX - 1, 64}, {1, UINT64_MAX, 64}, {UINT64_MAX / 64 + 2, 1, 64},
+                          {1ULL << 58, 256, 64}, {1, 4, 1ULL << 62}, {0, UINT64_MAX, 1ULL << 63}};
+  for (size_t n = 0; n < sizeof(fields) / sizeof(fields[0]); ++n) {
+    MatrixFileHeader header = matrix_file_header(1, 4, 64);
+    header.row = fields[n][0];
+    header.col = fields[n][1];
+    header.stride = fields[n][2];
+    std::string content(header.data_offset + 64, '\0');
+    memcpy(&content[0], &header, sizeof(header));
+    {
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      out << content;
+    }
+    ASSERT_THROW(Matrix::load(path), std::runtime_error);
+    ASSERT_THROW(MappedMatrix mapped(path, false), std::runtime_error);
+  }
+  remove(path);
+}
+
+/**
+ * Small budget makes the operands split into many tiles with partial tiles at the edges,
+ * the largest budget keeps them in one tile
+ */
+TEST(MatrixFileTest, OutOfCoreMultiplicationTest) {
+  const char* path_a = "qmatrix_test_a.bin";
+  const char* path_b = "qmatrix_test_b.bin";
+  const char* path_c = "qmatrix_test_c.bin";
+  size_t sizes[][3] = {{1, 1, 1}, {300, 260, 270}, {70, 0, 50}, {64, 500, 3}};
+  size_t budgets[] = {80 * 1024, 144 * 1024, 1 << 26};
+  for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+    Matrix a(sizes[n][0], sizes[n][1]);
+    Matrix b(sizes[n][1], sizes[n][2]);
+    fill_random(a);
+    fill_random(b);
+    a.save(path_a);
+    b.save(path_b);
+    Matrix expected(Matrix::multiply_trivial(a, b));
+    for (size_t i = 0; i < sizeof(budgets) / sizeof(budgets[0]); ++i) {
+      Matrix::multiply_out_of_core(path_a, path_b, path_c, budgets[i]);
+      ASSERT_EQ(Matrix::load(path_c), expected);
+    }
+  }
+  ASSERT_THROW(Matrix::multiply_out_of_core(path_a, path_b, path_c, 1000), std::invalid_argument);
+  ASSERT_THROW(Matrix::multiply_out_of_core(path_a, path_a, path_c, 1 << 20), std::length_error);
+  ASSERT_THROW(Matrix::multiply_out_of_core(path_a, "qmatrix_test_missing.bin", path_c, 1 << 20), std::runtime_error);
+  // Output file is not truncated if it is one of the operands
+  ASSERT_THROW(Matrix::multiply_out_of_core(path_a, path_b, path_a, 1 << 20), std::invalid_argument);
+  ASSERT_THROW(Matrix::multiply_out_of_core(path_a, path_b, "./qmatrix_test_b.bin", 1 << 20), std::invalid_argument);
+  ASSERT_EQ(link(path_b, "qmatrix_test_link.bin"), 0);
+  ASSERT_THROW(Matrix::multiply_out_of_core(path_a, path_b, "qmatrix_test_link.bin", 1 << 20), std::invalid_argument);
+  remove("qmatrix_test_link.bin");
+  Matrix::load(path_a);
+  Matrix::load(path_b);
+  // Corrupt operand is rejected unless verification is skipped
+  {
+    std::fstream file(path_a, std::ios::in | std::ios::out | std::ios::binary | std::ios::ate);
+    file.seekp(-1, std::ios::end);
+    file.put(0x55);
+  }
+  ASSERT_THROW(Matrix::multiply_out_of_core(path_a, path_b, path_c, 1 << 20), std::runtime_error);
+  Matrix::multiply_out_of_core(path_a, path_b, path_c, 1 << 20, false);
+  remove(path_a);
+  remove(path_b);
+  remove(path_c);
+}
+
+//! Bytes allocated by malloc in all arenas and not freed yet
+static size_t allocated_bytes() {
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+}
+
+/**
+ * Allocated memory is sampled by another thread while the product is computed.
+ * Operands are larger than the budget, so the cache is full and tiles are evicted,
+ * and tiles are larger than the Strassen crossover
+ */
+TEST(MatrixFileTest, OutOfCoreMemoryBudgetTest) {
+  const char* path_a = "qmatrix_test_a.bin";
+  const char* path_b = "qmatrix_test_b.bin";
+  const char* path_c = "qmatrix_test_c.bin";
+  const size_t size = 2048;
+  const size_t budget = 2 << 20;
+  // Futures, shared states and nodes of the cache
+  const size_t slack = 16 * 1024;
+  Matrix a(size, size);
+  Matrix b(size, size);
+  fill_random(a);
+  fill_random(b);
+  a.save(path_a);
+  b.save(path_b);
+  Matrix expected(a * b);
+  a = Matrix(0, 0);
+  b = Matrix(0, 0);
+  size_t before = allocated_bytes();
+  size_t peak = before;
+  std::atomic<bool> done(false);
+  std::thread sampler([&]() {
+    while (!done.load()) {
+      peak = std::max(peak, allocated_bytes());
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  });
+  Matrix::multiply_out_of_core(path_a, path_b, path_c, budget);
+  done.store(true);
+  sampler.join();
+  ASSERT_LE(peak - before, budget + slack);
+  ASSERT_EQ(Matrix::load(path_c), expected);
+  remove(path_a);
+  remove(path_b);
+  remove(path_c);
+}
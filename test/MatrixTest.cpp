@@ -1,9 +1,13 @@
+#include <algorithm>
 #include <stdexcept>
+#include <type_traits>
 #include <random>
+#include <vector>
 
 #include <gtest/gtest.h>
 
 #include "matrix_strassen.h"
+#include "matrix_test_utils.h"
 
 class MatrixTest : public ::testing::Test
 {
@@ -18,6 +22,23 @@ protected:
   }
 };
 
+/**
+ * Element by element multiplication used as a reference for the fast algorithms
+ */
+static Matrix multiply_reference(const Matrix& lhs, const Matrix& rhs) {
+  Matrix m(lhs.row(), rhs.col());
+  for (size_t i = 0; i < lhs.row(); ++i) {
+    for (size_t j = 0; j < rhs.col(); ++j) {
+      int sum = 0;
+      for (size_t k = 0; k < lhs.col(); ++k) {
+        sum += lhs.get(i, k) * rhs.get(k, j);
+      }
+      m.set(i, j, sum);
+    }
+  }
+  return m;
+}
+
 TEST(MatrixTest, MatrixEqualityTest) {
   Matrix a({{1, 2, 3}, {4, 5, 6}});
   Matrix b(2, 3);
@@ -34,10 +55,127 @@ TEST(MatrixTest, MatrixEqualityTest) {
   ASSERT_EQ(c, d);
 }
 
+TEST(MatrixTest, MatrixAssignmentTest) {
+  Matrix a({{1, 2, 3}, {4, 5, 6}});
+  Matrix b({{1, 2}, {3, 0}, {2, 1}, {0, 3}});
+  b = a;
+  ASSERT_EQ(a, b);
+  ASSERT_EQ(b.row(), 2);
+  ASSERT_EQ(b.col(), 3);
+  Matrix c(70, 130);
+  c.set(69, 129, 3);
+  c = b;
+  ASSERT_EQ(a, c);
+}
+
+TEST(MatrixTest, MatrixMoveTest) {
+  Matrix a({{1, 2, 3}, {4, 5, 6}});
+  Matrix b(a);
+  Matrix c(std::move(a));
+  ASSERT_EQ(c, b);
+  ASSERT_EQ(a.row(), 0);
+  ASSERT_EQ(a.col(), 0);
+  a = std::move(c);
+  ASSERT_EQ(a, b);
+  ASSERT_EQ(c, Matrix(0, 0));
+}
+
 TEST(MatrixTest, MatrixTranspositionTest) {
   Matrix a({{1, 2, 3}, {4, 5, 6}});
   Matrix b({{1, 4}, {2, 5}, {3, 6}});
   ASSERT_EQ(a.transposed(), b);
+  ASSERT_EQ(a.transpose(), b);
+  ASSERT_EQ(a, b);
+}
+
+//! Blocks of 32x32 elements at the edges and tiles of blocks are compared element by element
+TEST(MatrixTest, BlockTranspositionTest) {
+  size_t sizes[][2] = {{0, 0}, {0, 7}, {1, 1}, {5, 33}, {32, 32}, {63, 64}, {100, 37}, {300, 270}};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    Matrix a(sizes[s][0], sizes[s][1]);
+    for (size_t i = 0; i < a.row(); ++i) {
+      for (size_t j = 0; j < a.col(); ++j) {
+        a.set(i, j, rand());
+      }
+    }
+    Matrix t(a.transposed());
+    ASSERT_EQ(t.row(), a.col());
+    ASSERT_EQ(t.col(), a.row());
+    for (size_t i = 0; i < a.row(); ++i) {
+      for (size_t j = 0; j < a.col(); ++j) {
+        ASSERT_EQ(t.get(j, i), a.get(i, j));
+      }
+    }
+    ASSERT_EQ(t.transposed(), a);
+    // In place for square matrices, replaced for the others
+    Matrix b(a);
+    ASSERT_EQ(b.transpose(), t);
+    Matrix c(a.row(), a.row());
+    for (size_t i = 0; i < c.row(); ++i) {
+      for (size_t j = 0; j < c.col(); ++j) {
+        c.set(i, j, rand());
+      }
+    }
+    Matrix c_t(c.transposed());
+    ASSERT_EQ(c.transpose(), c_t);
+    ASSERT_EQ(c.transpose().transposed(), c_t);
+  }
+}
+
+TEST(MatrixTest, BulkElementsTest) {
+  size_t sizes[][2] = {{0, 0}, {3, 0}, {1, 1}, {5, 33}, {64, 130}, {7, 257}};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    size_t row = sizes[s][0];
+    size_t col = sizes[s][1];
+    // Rows of the buffers are separated by ld - col bytes which should not be touched
+    size_t ld = col + 5;
+    std::vector<int8_t> elements(row * ld + 1, 7);
+    for (size_t i = 0; i < row; ++i) {
+      for (size_t j = 0; j < col; ++j) {
+        elements[i * ld + j] = rand();
+      }
+    }
+    Matrix a(row, col);
+    a.set_elements(elements.data(), ld);
+    for (size_t i = 0; i < row; ++i) {
+      for (size_t j = 0; j < col; ++j) {
+        ASSERT_EQ(a.get(i, j), elements[i * ld + j] & 0x03);
+      }
+    }
+    std::vector<uint8_t> exported(row * ld + 1, 7);
+    a.get_elements(exported.data(), ld);
+    for (size_t i = 0; i < row * ld + 1; ++i) {
+      ASSERT_EQ(exported[i], ((i % ld < col) && (i < row * ld)) ? (elements[i] & 0x03) : 7);
+    }
+    std::vector<int8_t> contiguous(row * col);
+    a.get_elements(contiguous.data());
+    Matrix b(row, col);
+    b.set_elements(contiguous.data());
+    ASSERT_EQ(b, a);
+    // Rows one by one in both layouts
+    Matrix c(row, col);
+    Matrix d(row, col);
+    std::vector<uint8_t> row_elements(col);
+    std::vector<int8_t> packed((col + 3) / 4);
+    for (size_t i = 0; i < row; ++i) {
+      a.get_row(i, row_elements.data());
+      c.set_row(i, row_elements.data());
+      a.get_packed_row(i, packed.data());
+      if (col % 4)
+        packed.back() |= 0xFF << (2 * (col % 4));
+      d.set_packed_row(i, packed.data());
+    }
+    ASSERT_EQ(c, a);
+    ASSERT_EQ(d, a);
+  }
+  Matrix a(2, 3);
+  int8_t buffer[8];
+  ASSERT_THROW(a.set_elements(buffer, 2), std::invalid_argument);
+  ASSERT_THROW(a.get_elements(buffer, 2), std::invalid_argument);
+  ASSERT_THROW(a.set_row(2, buffer), std::out_of_range);
+  ASSERT_THROW(a.get_row(2, buffer), std::out_of_range);
+  ASSERT_THROW(a.set_packed_row(2, buffer), std::out_of_range);
+  ASSERT_THROW(a.get_packed_row(2, buffer), std::out_of_range);
 }
 
 TEST(MatrixTest, MatrixClearTest) {
@@ -57,6 +195,11 @@ TEST(MatrixTest, MatrixResizeTest) {
   b.resize(3, 3);
   Matrix c({{1, 2, 0}, {4, 5, 0}, {0, 0, 0}});
   ASSERT_EQ(b, c);
+  Matrix d({{1, 2, 3, 1, 2}, {3, 2, 1, 3, 2}});
+  d.resize(2, 1);
+  d.resize(2, 5);
+  Matrix e({{1, 0, 0, 0, 0}, {3, 0, 0, 0, 0}});
+  ASSERT_EQ(d, e);
 }
 
 TEST(MatrixTest, MatrixErrorTest) {
@@ -232,6 +375,23 @@ TEST(MatrixTest, PackedMultiplyTest) {
   ASSERT_EQ(b1, Matrix::packed_multiply(b3, b3));
 }
 
+TEST(MatrixTest, PackedWordTest) {
+  for (size_t attempt = 0; attempt < 10000; ++attempt) {
+    uint64_t a = (static_cast<uint64_t>(rand()) << 40) ^ (static_cast<uint64_t>(rand()) << 20) ^ rand();
+    uint64_t b = (static_cast<uint64_t>(rand()) << 40) ^ (static_cast<uint64_t>(rand()) << 20) ^ rand();
+    uint64_t sum = Matrix::packed_sum_word(a, b);
+    uint64_t diff = Matrix::packed_diff_word(a, b);
+    uint64_t prod = Matrix::packed_multiply_word(a, b);
+    for (size_t i = 0; i < 8; ++i) {
+      int8_t a_byte = a >> (i * 8);
+      int8_t b_byte = b >> (i * 8);
+      ASSERT_EQ(Matrix::packed_sum(a_byte, b_byte), static_cast<int8_t>(sum >> (i * 8)));
+      ASSERT_EQ(Matrix::packed_diff(a_byte, b_byte), static_cast<int8_t>(diff >> (i * 8)));
+      ASSERT_EQ(Matrix::packed_multiply(a_byte, b_byte), static_cast<int8_t>(prod >> (i * 8)));
+    }
+  }
+}
+
 TEST(MatrixTest, MatrixAdditionTest) {
   Matrix a({{1, 2, 3}, {4, 5, 6}});
   Matrix b({{3, 2, 1}, {6, 5, 4}});
@@ -246,6 +406,523 @@ TEST(MatrixTest, MatrixSubtractionTest) {
   ASSERT_EQ(c - b, a);
 }
 
+TEST(MatrixTest, MatrixExpressionTest) {
+  Matrix a(37, 2100);
+  Matrix b(37, 2100);
+  Matrix c(37, 2100);
+  Matrix d(37, 2100);
+  fill_random(a);
+  fill_random(b);
+  fill_random(c);
+  fill_random(d);
+  Matrix expected(37, 2100);
+  for (size_t i = 0; i < a.row(); ++i) {
+    for (size_t j = 0; j < a.col(); ++j) {
+      expected.set(i, j, a.get(i, j) - (b.get(i, j) - c.get(i, j)) + d.get(i, j));
+    }
+  }
+  Matrix e = a - (b - c) + d;
+  ASSERT_EQ(e, expected);
+  // Destination is one of the operands
+  e = b;
+  e = a - (e - c) + d;
+  ASSERT_EQ(e, expected);
+  e = Matrix(1, 1);
+  e = a - (b - c) + d;
+  ASSERT_EQ(e, expected);
+  // Views as operands and destination, with lanes beyond the block kept
+  Matrix f(40, 30);
+  fill_random(f);
+  Matrix g(f);
+  MatrixView block = f.view().block(2, 4, 35, 21);
+  Matrix::assign(block, a.view().block(0, 8, 35, 21) + block - b.view().block(0, 0, 35, 21).block(0, 0, 35, 21));
+  ASSERT_THROW(Matrix::assign(block, a.view() + b), std::length_error);
+  for (size_t i = 0; i < 35; ++i) {
+    for (size_t j = 0; j < 21; ++j) {
+      g.set(i + 2, j + 4, a.get(i, j + 8) + g.get(i + 2, j + 4) - b.get(i, j));
+    }
+  }
+  ASSERT_EQ(f, g);
+  ASSERT_THROW(a + b - Matrix(37, 2099), std::length_error);
+  ASSERT_THROW(a.view() + b - c.view().block(0, 0, 37, 2099), std::length_error);
+}
+
+TEST(MatrixTest, MatrixSumValueTest) {
+  Matrix a(45, 45);
+  Matrix b(45, 45);
+  Matrix c(45, 45);
+  fill_random(a);
+  fill_random(b);
+  fill_random(c);
+  Matrix sum(45, 45);
+  Matrix difference(45, 45);
+  for (size_t i = 0; i < a.row(); ++i) {
+    for (size_t j = 0; j < a.col(); ++j) {
+      sum.set(i, j, a.get(i, j) + b.get(i, j));
+      difference.set(i, j, a.get(i, j) - b.get(i, j));
+    }
+  }
+  // Sums of matrices are matrices
+  Matrix d = (a + b) * c;
+  ASSERT_EQ(d, Matrix::multiply_trivial(sum, c));
+  ASSERT_EQ((a + b).transposed(), sum.transposed());
+  ASSERT_EQ((a - b).get(0, 0), difference.get(0, 0));
+  // Temporaries are evaluated, not referenced
+  auto s = Matrix(45, 45) + b;
+  static_assert(std::is_same<decltype(s), Matrix>::value, "sum of matrices should be a matrix");
+  ASSERT_EQ(s, b);
+  auto t = a - Matrix(45, 45);
+  static_assert(std::is_same<decltype(t), Matrix>::value, "difference of matrices should be a matrix");
+  ASSERT_EQ(t, a);
+}
+
+TEST(MatrixTest, TrivialMultiplicationTest) {
+  size_t sizes[][3] = {{1, 1, 1}, {3, 5, 2}, {31, 64, 33}, {70, 130, 65}, {2, 200, 3}};
+  for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+    Matrix a(sizes[n][0], sizes[n][1]);
+    Matrix b(sizes[n][1], sizes[n][2]);
+    fill_random(a);
+    fill_random(b);
+    ASSERT_EQ(Matrix::multiply_trivial(a, b), multiply_reference(a, b));
+  }
+}
+
+TEST(MatrixTest, M4rmMultiplicationTest) {
+  size_t sizes[][3] = {{1, 1, 1}, {3, 5, 2}, {31, 64, 33}, {70, 130, 65}, {300, 17, 1030}};
+  for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+    Matrix a(sizes[n][0], sizes[n][1]);
+    Matrix b(sizes[n][1], sizes[n][2]);
+    fill_random(a);
+    fill_random(b);
+    ASSERT_EQ(Matrix::multiply_m4rm(a, b), multiply_reference(a, b));
+  }
+}
+
+TEST(MatrixTest, VectorMultiplicationTest) {
+  size_t sizes[][3] = {{1, 1, 1}, {1, 70, 1}, {130, 257, 1}, {1, 300, 90}, {1, 0, 5}};
+  for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+    Matrix a(sizes[n][0], sizes[n][1]);
+    Matrix b(sizes[n][1], sizes[n][2]);
+    fill_random(a);
+    fill_random(b);
+    Matrix expected(multiply_reference(a, b));
+    ASSERT_EQ(Matrix::multiply_vector(a, b), expected);
+    ASSERT_EQ(a * b, expected);
+  }
+  ASSERT_THROW(Matrix::multiply_vector(Matrix(2, 3), Matrix(3, 2)), std::invalid_argument);
+  ASSERT_THROW(Matrix::multiply_vector(Matrix(1, 3), Matrix(2, 1)), std::length_error);
+}
+
+TEST(MatrixTest, BatchMultiplicationTest) {
+  Matrix::Algorithm base_algorithm = Matrix::base_algorithm();
+  size_t thread_count = Matrix::thread_count();
+  size_t sizes[][3] = {{1, 1, 1}, {16, 16, 16}, {3, 0, 5}, {33, 65, 17}, {128, 128, 128}, {100, 130, 90}};
+  size_t count = 3 * sizeof(sizes) / sizeof(sizes[0]);
+  std::vector<Matrix> lhs;
+  std::vector<Matrix> rhs;
+  std::vector<Matrix> expected;
+  for (size_t i = 0; i < count; ++i) {
+    size_t* size = sizes[i % (sizeof(sizes) / sizeof(sizes[0]))];
+    lhs.push_back(Matrix(size[0], size[1]));
+    rhs.push_back(Matrix(size[1], size[2]));
+    fill_random(lhs.back());
+    fill_random(rhs.back());
+    expected.push_back(multiply_reference(lhs.back(), rhs.back()));
+  }
+  size_t counts[] = {1, 3};
+  for (size_t t = 0; t < sizeof(counts) / sizeof(counts[0]); ++t) {
+    Matrix::set_thread_count(counts[t]);
+    for (size_t j = 0; j < 2; ++j) {
+      Matrix::set_base_algorithm(j ? Matrix::Algorithm::M4RM : Matrix::Algorithm::Trivial);
+      // Outputs of wrong size are reallocated, outputs of right size are overwritten
+      std::vector<Matrix> out(count, Matrix(2, 2));
+      Matrix::multiply_batch(lhs.data(), rhs.data(), out.data(), count);
+      ASSERT_EQ(out, expected);
+      // Products above the crossover are written into the buffers of the outputs as well
+      std::vector<const int8_t*> buffers;
+      for (size_t i = 0; i < count; ++i) {
+        fill_random(out[i]);
+        buffers.push_back(out[i].view().row_data(0));
+      }
+      ASSERT_GT(std::max(lhs[4].row(), lhs[4].col()), Matrix::strassen_crossover());
+      Matrix::multiply_batch(lhs.data(), rhs.data(), out.data(), count);
+      ASSERT_EQ(out, expected);
+      for (size_t i = 0; i < count; ++i) {
+        ASSERT_EQ(out[i].view().row_data(0), buffers[i]);
+      }
+    }
+  }
+  Matrix::multiply_batch(nullptr, nullptr, nullptr, 0);
+  std::vector<Matrix> out(count, Matrix(1, 1));
+  ASSERT_THROW(Matrix::multiply_batch(lhs.data(), lhs.data(), out.data(), count), std::length_error);
+  ASSERT_EQ(out[0], Matrix(1, 1));
+  Matrix::set_thread_count(thread_count);
+  Matrix::set_base_algorithm(base_algorithm);
+}
+
+TEST(MatrixTest, MatrixViewTest) {
+  Matrix a(6, 13);
+  fill_random(a);
+  ConstMatrixView v = a.view().block(1, 4, 5, 9);
+  ASSERT_EQ(v.row(), 5u);
+  ASSERT_EQ(v.col(), 9u);
+  for (size_t i = 0; i < v.row(); ++i) {
+    for (size_t j = 0; j < v.col(); ++j) {
+      ASSERT_EQ(v.get(i, j), a.get(i + 1, j + 4));
+    }
+  }
+  MatrixView w = a.view().block(2, 8, 2, 4);
+  w.set(1, 3, 3);
+  ASSERT_EQ(a.get(3, 11), 3);
+  ASSERT_THROW(a.view().block(0, 2, 1, 1), std::invalid_argument);
+  ASSERT_THROW(a.view().block(0, 12, 1, 2), std::out_of_range);
+  ASSERT_THROW(a.view().block(5, 0, 2, 1), std::out_of_range);
+}
+
+TEST(MatrixTest, MatrixBlockTest) {
+  Matrix a(9, 150);
+  fill_random(a);
+  size_t offsets[] = {0, 1, 2, 3, 5, 33, 70};
+  for (size_t n = 0; n < sizeof(offsets) / sizeof(offsets[0]); ++n) {
+    size_t col = offsets[n];
+    for (size_t cols = 0; cols <= 150 - col; cols += 7) {
+      Matrix b(a.block(2, col, 6, cols));
+      Matrix expected(6, cols);
+      for (size_t i = 0; i < 6; ++i) {
+        for (size_t j = 0; j < cols; ++j) {
+          expected.set(i, j, a.get(i + 2, j + col));
+        }
+      }
+      ASSERT_EQ(b, expected);
+    }
+  }
+  Matrix c(a.view().block(1, 32, 3, 7));
+  ASSERT_EQ(c, a.block(1, 32, 3, 7));
+  ASSERT_THROW(a.block(0, 140, 1, 11), std::out_of_range);
+}
+
+TEST(MatrixTest, MatrixViewArithmeticTest) {
+  Matrix a(5, 23);
+  Matrix b(5, 23);
+  fill_random(a);
+  fill_random(b);
+  // Lanes of dst outside of the block should not be changed
+  Matrix c(7, 30);
+  fill_random(c);
+  Matrix expected(c);
+  MatrixView dst = c.view().block(1, 4, 5, 23);
+  Matrix::add(dst, a, b);
+  for (size_t i = 0; i < 5; ++i) {
+    for (size_t j = 0; j < 23; ++j) {
+      expected.set(i + 1, j + 4, a.get(i, j) + b.get(i, j));
+    }
+  }
+  ASSERT_EQ(c, expected);
+  Matrix::subtract(dst, dst, b);
+  Matrix::copy(expected.view().block(1, 4, 5, 23), a);
+  ASSERT_EQ(c, expected);
+  Matrix::copy(dst, b);
+  ASSERT_EQ(Matrix(ConstMatrixView(dst)), b);
+  ASSERT_THROW(Matrix::add(dst, a, Matrix(5, 22)), std::length_error);
+  ASSERT_THROW(Matrix::copy(dst, Matrix(4, 23)), std::length_error);
+}
+
+TEST(MatrixTest, StrassenMultiplicationTest) {
+  Matrix::Algorithm base_algorithm = Matrix::base_algorithm();
+  // Odd sizes are peeled, long and thin shapes are split along the longest dimension
+  size_t sizes[][3] = {{1, 1, 1}, {3, 5, 2}, {128, 128, 128}, {70, 130, 65}, {256, 200, 256},
+                       {131, 157, 149}, {67, 301, 71}, {400, 20, 390}, {329, 101, 90}, {77, 83, 300}};
+  for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+    Matrix a(sizes[n][0], sizes[n][1]);
+    Matrix b(sizes[n][1], sizes[n][2]);
+    fill_random(a);
+    fill_random(b);
+    Matrix expected(multiply_reference(a, b));
+    Matrix::set_base_algorithm(Matrix::Algorithm::Trivial);
+    ASSERT_EQ(Matrix::multiply_strassen(a, b), expected);
+    Matrix::set_base_algorithm(Matrix::Algorithm::M4RM);
+    ASSERT_EQ(Matrix::multiply_strassen(a, b), expected);
+  }
+  ASSERT_THROW(Matrix::multiply_strassen(Matrix(2, 3), Matrix(2, 3)), std::length_error);
+  Matrix::set_base_algorithm(base_algorithm);
+}
+
+TEST(MatrixTest, WinogradMultiplicationTest) {
+  Matrix::Algorithm base_algorithm = Matrix::base_algorithm();
+  size_t sizes[][3] = {{1, 1, 1}, {3, 5, 2}, {128, 128, 128}, {70, 130, 65}, {256, 200, 256}, {600, 520, 513}};
+  for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+    Matrix a(sizes[n][0], sizes[n][1]);
+    Matrix b(sizes[n][1], sizes[n][2]);
+    fill_random(a);
+    fill_random(b);
+    Matrix expected(Matrix::multiply_trivial(a, b));
+    Matrix::set_base_algorithm(Matrix::Algorithm::Trivial);
+    ASSERT_EQ(Matrix::multiply_winograd(a, b), expected);
+    Matrix::set_base_algorithm(Matrix::Algorithm::M4RM);
+    ASSERT_EQ(Matrix::multiply_winograd(a, b), expected);
+  }
+  ASSERT_THROW(Matrix::multiply_winograd(Matrix(2, 3), Matrix(2, 3)), std::length_error);
+  Matrix::set_base_algorithm(base_algorithm);
+}
+
+TEST(MatrixTest, AlgorithmSelectionTest) {
+  Matrix::Algorithm algorithm = Matrix::algorithm();
+  Matrix::Algorithm base_algorithm = Matrix::base_algorithm();
+  Matrix a(130, 100);
+  Matrix b(100, 90);
+  fill_random(a);
+  fill_random(b);
+  Matrix expected(multiply_reference(a, b));
+  Matrix::Algorithm algorithms[] = {Matrix::Algorithm::Trivial, Matrix::Algorithm::M4RM,
+                                    Matrix::Algorithm::Strassen, Matrix::Algorithm::Winograd};
+  for (size_t i = 0; i < 4; ++i) {
+    Matrix::set_algorithm(algorithms[i]);
+    ASSERT_EQ(Matrix::algorithm(), algorithms[i]);
+    for (size_t j = 0; j < 2; ++j) {
+      Matrix::set_base_algorithm(algorithms[j]);
+      ASSERT_EQ(a * b, expected);
+    }
+  }
+  ASSERT_THROW(Matrix::set_base_algorithm(Matrix::Algorithm::Strassen), std::invalid_argument);
+  ASSERT_THROW(Matrix::set_base_algorithm(Matrix::Algorithm::Winograd), std::invalid_argument);
+  Matrix::set_algorithm(algorithm);
+  Matrix::set_base_algorithm(base_algorithm);
+}
+
+/**
+ * c += sign * op(a) * op(b) is accumulated into a block of a larger matrix:
+ * elements outside of the block should not be changed.
+ * Small crossover makes the recursion run on small sizes
+ */
+TEST(MatrixTest, GemmTest) {
+  Matrix::Algorithm algorithm = Matrix::algorithm();
+  Matrix::Algorithm base_algorithm = Matrix::base_algorithm();
+  size_t crossover = Matrix::strassen_crossover();
+  Matrix::set_strassen_crossover(32);
+  size_t sizes[][3] = {{1, 1, 1}, {3, 5, 2}, {70, 130, 65}, {131, 157, 149}, {200, 40, 90}};
+  Matrix::Algorithm algorithms[] = {Matrix::Algorithm::Trivial, Matrix::Algorithm::M4RM, Matrix::Algorithm::Strassen};
+  for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+    size_t rows = sizes[n][0];
+    size_t inner = sizes[n][1];
+    size_t cols = sizes[n][2];
+    Matrix a(rows, inner);
+    Matrix b(inner, cols);
+    fill_random(a);
+    fill_random(b);
+    Matrix a_t(a.transposed());
+    Matrix b_t(b.transposed());
+    Matrix product(multiply_reference(a, b));
+    for (size_t alg = 0; alg < 3; ++alg) {
+      Matrix::set_algorithm(algorithms[alg]);
+      Matrix::set_base_algorithm(algorithms[alg % 2]);
+      for (size_t t = 0; t < 4; ++t) {
+        bool transpose_a = t & 1;
+        bool transpose_b = t & 2;
+        for (int sign = -1; sign <= 1; sign += 2) {
+          Matrix c(rows + 2, cols + 9);
+          fill_random(c);
+          Matrix expected(c);
+          for (size_t i = 0; i < rows; ++i) {
+            for (size_t j = 0; j < cols; ++j) {
+              expected.set(i + 1, j + 4, c.get(i + 1, j + 4) + sign * product.get(i, j));
+            }
+          }
+          Matrix::gemm(c.view().block(1, 4, rows, cols), transpose_a ? a_t : a, transpose_b ? b_t : b,
+                       sign, transpose_a, transpose_b);
+          ASSERT_EQ(c, expected);
+        }
+      }
+    }
+  }
+  Matrix c(3, 4);
+  ASSERT_THROW(Matrix::gemm(c, Matrix(3, 5), Matrix(5, 4), 2), std::invalid_argument);
+  ASSERT_THROW(Matrix::gemm(c, Matrix(3, 5), Matrix(4, 4)), std::length_error);
+  ASSERT_THROW(Matrix::gemm(c, Matrix(3, 5), Matrix(5, 4), 1, true), std::length_error);
+  ASSERT_THROW(Matrix::gemm(c, Matrix(3, 5), Matrix(5, 3)), std::length_error);
+  Matrix::set_algorithm(algorithm);
+  Matrix::set_base_algorithm(base_algorithm);
+  Matrix::set_strassen_crossover(crossover);
+}
+
+/**
+ * Powers are compared with repeated multiplication. Exponents of small matrices
+ * go beyond the period common to all matrices of their size, so the reduction is checked too
+ */
+TEST(MatrixTest, PowerTest) {
+  for (size_t n = 1; n <= 4; ++n) {
+    for (size_t attempt = 0; attempt < 10; ++attempt) {
+      Matrix a(n, n);
+      for (size_t i = 0; i < n; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+          a.set(i, j, rand());
+        }
+      }
+      Matrix expected(Matrix::identity(n));
+      for (uint64_t k = 0; k <= 1000; ++k) {
+        ASSERT_EQ(a.pow(k), expected);
+        expected = Matrix::multiply_trivial(expected, a);
+      }
+    }
+  }
+  size_t crossover = Matrix::strassen_crossover();
+  Matrix::set_strassen_crossover(16);
+  Matrix a(70, 70);
+  for (size_t i = 0; i < a.row(); ++i) {
+    for (size_t j = 0; j < a.col(); ++j) {
+      a.set(i, j, rand());
+    }
+  }
+  Matrix expected(Matrix::identity(70));
+  for (uint64_t k = 0; k <= 40; ++k) {
+    ASSERT_EQ(a.pow(k), expected);
+    expected = Matrix::multiply_trivial(expected, a);
+  }
+  Matrix::set_strassen_crossover(crossover);
+  // Nilpotent shift and idempotent projection end squaring early
+  Matrix shift(70, 70);
+  Matrix projection(70, 70);
+  for (size_t i = 0; i + 1 < 70; ++i) {
+    shift.set(i, i + 1, 1);
+    projection.set(i, i, 1);
+  }
+  Matrix last(70, 70);
+  last.set(0, 69, 1);
+  ASSERT_EQ(shift.pow(69), last);
+  ASSERT_EQ(shift.pow(70), Matrix(70, 70));
+  ASSERT_EQ(shift.pow(UINT64_MAX), Matrix(70, 70));
+  ASSERT_EQ(projection.pow(UINT64_MAX), projection);
+  ASSERT_EQ(Matrix(0, 0).pow(5), Matrix(0, 0));
+  ASSERT_THROW(Matrix(3, 4).pow(2), std::length_error);
+}
+
+//! Product of random unit triangular matrices with permuted rows scaled by units
+static Matrix random_invertible(size_t n) {
+  Matrix l(Matrix::identity(n));
+  Matrix u(Matrix::identity(n));
+  Matrix p(n, n);
+  std::vector<size_t> order(n);
+  for (size_t i = 0; i < n; ++i) {
+    order[i] = i;
+    for (size_t j = 0; j < i; ++j) {
+      l.set(i, j, rand());
+      u.set(j, i, rand());
+    }
+  }
+  std::random_shuffle(order.begin(), order.end());
+  for (size_t i = 0; i < n; ++i) {
+    p.set(i, order[i], (rand() % 2) ? 1 : 3);
+  }
+  return p * (l * u);
+}
+
+TEST(MatrixTest, InverseTest) {
+  size_t sizes[] = {1, 2, 7, 64, 255, 300, 600};
+  for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+    Matrix a(random_invertible(sizes[n]));
+    Matrix inverse(a.inverse());
+    ASSERT_EQ(a * inverse, Matrix::identity(sizes[n]));
+    ASSERT_EQ(inverse * a, Matrix::identity(sizes[n]));
+  }
+  Matrix singular(random_invertible(300));
+  for (size_t j = 0; j < singular.col(); ++j) {
+    singular.set(150, j, 2 * singular.get(100, j));
+  }
+  ASSERT_THROW(singular.inverse(), std::runtime_error);
+  ASSERT_THROW(Matrix({{2}}).inverse(), std::runtime_error);
+  ASSERT_THROW(Matrix(3, 4).inverse(), std::length_error);
+}
+
+/**
+ * a = p * d * q with invertible p and q and d having r1 ones and r2 twos on the diagonal,
+ * so the rank is r1 + r2. Right-hand sides are taken from the image of a
+ * and then moved out of it in the rows of d with twos and zeroes
+ */
+TEST(MatrixTest, SolveTest) {
+  size_t shapes[][4] = {{1, 1, 0, 1}, {7, 9, 3, 2}, {9, 7, 0, 7}, {300, 280, 100, 50}, {600, 520, 300, 150}};
+  for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); ++s) {
+    size_t m = shapes[s][0];
+    size_t n = shapes[s][1];
+    size_t r1 = shapes[s][2];
+    size_t r2 = shapes[s][3];
+    Matrix d(m, n);
+    for (size_t i = 0; i < r1 + r2; ++i) {
+      d.set(i, i, (i < r1) ? 1 : 2);
+    }
+    Matrix p(random_invertible(m));
+    Matrix a(p * d * random_invertible(n));
+    ASSERT_EQ(a.rank(), r1 + r2);
+    Matrix x0(n, 5);
+    fill_random(x0);
+    Matrix b(a * x0);
+    ASSERT_EQ(a * a.solve(b), b);
+    Matrix e(m, 5);
+    for (size_t i = r1; i < m; i += std::max<size_t>(1, (m - r1) / 4)) {
+      e.set(i, i % 5, 1);
+      Matrix shifted(b + p * e);
+      ASSERT_THROW(a.solve(shifted), std::runtime_error);
+      e.set(i, i % 5, 0);
+    }
+  }
+  ASSERT_THROW(Matrix(3, 4).solve(Matrix(4, 1)), std::length_error);
+}
+
+/**
+ * Small systems are compared with exhaustive search of solutions. Row module M
+ * of the matrix has 4^r1 * 2^r2 elements and 2M has 2^r1 elements
+ */
+TEST(MatrixTest, SmallSolveTest) {
+  for (size_t attempt = 0; attempt < 300; ++attempt) {
+    size_t m = 1 + rand() % 3;
+    size_t n = 1 + rand() % 3;
+    Matrix a(m, n);
+    Matrix b(m, 1);
+    fill_random(a);
+    fill_random(b);
+    // Some of the matrices are even to get pivots equal to 2
+    if (attempt % 3 == 0)
+      a = a + a;
+    bool solvable = false;
+    for (size_t code = 0; code < (1u << (2 * n)); ++code) {
+      Matrix x(n, 1);
+      for (size_t j = 0; j < n; ++j) {
+        x.set(j, 0, code >> (2 * j));
+      }
+      solvable = solvable || (a * x == b);
+    }
+    if (solvable) {
+      ASSERT_EQ(a * a.solve(b), b);
+    } else {
+      ASSERT_THROW(a.solve(b), std::runtime_error);
+    }
+    std::vector<bool> module(1u << (2 * n));
+    std::vector<bool> doubled(1u << (2 * n));
+    for (size_t code = 0; code < (1u << (2 * m)); ++code) {
+      Matrix c(1, m);
+      for (size_t i = 0; i < m; ++i) {
+        c.set(0, i, code >> (2 * i));
+      }
+      Matrix row(c * a);
+      size_t element = 0;
+      size_t element2 = 0;
+      for (size_t j = 0; j < n; ++j) {
+        element |= static_cast<size_t>(row.get(0, j)) << (2 * j);
+        element2 |= static_cast<size_t>((2 * row.get(0, j)) & 0x03) << (2 * j);
+      }
+      module[element] = true;
+      doubled[element2] = true;
+    }
+    size_t log_size = 0;
+    size_t log_doubled = 0;
+    for (size_t count = std::count(module.begin(), module.end(), true); count > 1; count /= 2) {
+      ++log_size;
+    }
+    for (size_t count = std::count(doubled.begin(), doubled.end(), true); count > 1; count /= 2) {
+      ++log_doubled;
+    }
+    ASSERT_EQ(a.rank(), log_size - log_doubled);
+  }
+}
+
 /**
  * This test compares results of multiplications of 2 random matrices of given size
  * First multiplication is made with trivial algorithm
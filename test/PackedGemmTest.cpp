@@ -0,0 +1,58 @@
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "packed_gemm.h"
+#include "packed_test_utils.h"
+
+/**
+ * Transposed operands are read in place, products are accumulated into c:
+ * lanes of c beyond n and bytes beyond its rows should be kept.
+ * Operands which are not transposed are tested with the other kernels in PackedProductTest
+ */
+TEST(PackedGemmTest, TransposedAccumulateTest) {
+  size_t sizes[][3] = {{1, 1, 1}, {5, 3, 7}, {67, 129, 65}, {130, 70, 3}, {133, 20, 530}};
+  PackedGemmWorkspace workspace;
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    size_t m = sizes[s][0];
+    size_t k = sizes[s][1];
+    size_t n = sizes[s][2];
+    for (size_t t = 1; t < 4; ++t) {
+      bool transpose_a = t & 1;
+      bool transpose_b = t & 2;
+      // Stored sizes of the operands
+      size_t a_rows = transpose_a ? k : m;
+      size_t a_cols = transpose_a ? m : k;
+      size_t b_rows = transpose_b ? n : k;
+      size_t b_cols = transpose_b ? k : n;
+      size_t a_stride = a_cols / 4 + 5;
+      size_t b_stride = b_cols / 4 + 3;
+      size_t c_stride = n / 4 + 9;
+      std::vector<int8_t> a = random_bytes(a_rows * a_stride);
+      std::vector<int8_t> b = random_bytes(b_rows * b_stride);
+      PackedStore stores[] = {PackedStore::Add, PackedStore::Subtract};
+      for (size_t st = 0; st < 2; ++st) {
+        std::vector<int8_t> c = random_bytes(m * c_stride);
+        std::vector<int8_t> old(c);
+        packed_gemm(c.data(), c_stride, a.data(), a_stride, transpose_a, b.data(), b_stride, transpose_b,
+                    m, k, n, stores[st], workspace);
+        for (size_t i = 0; i < m; ++i) {
+          for (size_t j = 0; j < n; ++j) {
+            int sum = 0;
+            for (size_t l = 0; l < k; ++l) {
+              int8_t x = transpose_a ? get_element(a, a_stride, l, i) : get_element(a, a_stride, i, l);
+              int8_t y = transpose_b ? get_element(b, b_stride, j, l) : get_element(b, b_stride, l, j);
+              sum += x * y;
+            }
+            int expected = get_element(old, c_stride, i, j) + (st ? -sum : sum);
+            ASSERT_EQ(expected & 0x03, get_element(c, c_stride, i, j));
+          }
+          for (size_t j = n; j < 4 * c_stride; ++j) {
+            ASSERT_EQ(get_element(old, c_stride, i, j), get_element(c, c_stride, i, j));
+          }
+        }
+      }
+    }
+  }
+}
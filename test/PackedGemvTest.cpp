@@ -0,0 +1,69 @@
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "packed_gemv.h"
+#include "packed_test_utils.h"
+#include "thread_pool.h"
+
+/**
+ * Operands are filled with random bytes including lanes beyond their column numbers,
+ * these elements should not affect the result. Large sizes are computed in parallel
+ */
+TEST(PackedGemvTest, MatrixVectorTest) {
+  ThreadPool pool(3);
+  size_t sizes[][2] = {{1, 1}, {5, 3}, {64, 257}, {67, 1000}, {2100, 2100}};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    size_t m = sizes[s][0];
+    size_t k = sizes[s][1];
+    size_t a_stride = k / 4 + 5;
+    size_t x_stride = 3;
+    size_t c_stride = 2;
+    std::vector<int8_t> a = random_bytes(m * a_stride);
+    std::vector<int8_t> x = random_bytes(k * x_stride);
+    for (size_t p = 0; p < 2; ++p) {
+      std::vector<int8_t> c(m * c_stride, 0x55);
+      packed_gemv(c.data(), c_stride, a.data(), a_stride, x.data(), x_stride, m, k, p ? &pool : nullptr);
+      for (size_t i = 0; i < m; ++i) {
+        int sum = 0;
+        for (size_t l = 0; l < k; ++l) {
+          sum += get_element(a, a_stride, i, l) * (x[l * x_stride] & 0x03);
+        }
+        ASSERT_EQ(sum & 0x03, c[i * c_stride]);
+        ASSERT_EQ(0x55, c[i * c_stride + 1]);
+      }
+    }
+  }
+}
+
+TEST(PackedGemvTest, VectorMatrixTest) {
+  ThreadPool pool(3);
+  size_t sizes[][2] = {{1, 1}, {3, 5}, {257, 64}, {1000, 67}, {300, 20000}};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    size_t k = sizes[s][0];
+    size_t n = sizes[s][1];
+    size_t b_stride = n / 4 + 3;
+    size_t n_bytes = (n + 3) / 4;
+    std::vector<int8_t> b = random_bytes(k * b_stride);
+    std::vector<int8_t> x = random_bytes((k + 3) / 4);
+    // Lanes of x beyond k are zero as in matrix rows
+    if (k % 4)
+      x.back() &= 0xFF >> (8 - 2 * (k % 4));
+    for (size_t p = 0; p < 2; ++p) {
+      std::vector<int8_t> c(n_bytes + 1, 0x55);
+      packed_gevm(c.data(), x.data(), b.data(), b_stride, k, n, p ? &pool : nullptr);
+      for (size_t j = 0; j < n; ++j) {
+        int sum = 0;
+        for (size_t l = 0; l < k; ++l) {
+          sum += get_element(x, 0, 0, l) * get_element(b, b_stride, l, j);
+        }
+        ASSERT_EQ(sum & 0x03, get_element(c, 0, 0, j));
+      }
+      for (size_t j = n; j < 4 * n_bytes; ++j) {
+        ASSERT_EQ(0, get_element(c, 0, 0, j));
+      }
+      ASSERT_EQ(0x55, c[n_bytes]);
+    }
+  }
+}
@@ -0,0 +1,191 @@
+#include <stdexcept>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "matrix_strassen.h"
+#include "packed_kernels.h"
+#include "packed_test_utils.h"
+
+static const Matrix::SimdLevel all_levels[] = {
+  Matrix::SimdLevel::Scalar,
+  Matrix::SimdLevel::SSE2,
+  Matrix::SimdLevel::AVX2,
+  Matrix::SimdLevel::AVX512
+};
+
+/**
+ * Every kernel supported by CPU should give the same results as the scalar one
+ * for sizes which are not multiples of the vector width
+ */
+TEST(PackedKernelsTest, KernelsEqualityTest) {
+  const PackedKernels* scalar = packed_kernels(Matrix::SimdLevel::Scalar);
+  ASSERT_NE(scalar, nullptr);
+  size_t sizes[] = {1, 7, 8, 15, 16, 33, 64, 100, 257};
+  for (size_t l = 0; l < sizeof(all_levels) / sizeof(all_levels[0]); ++l) {
+    const PackedKernels* k = packed_kernels(all_levels[l]);
+    if (!k)
+      continue;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+      size_t n = sizes[s];
+      std::vector<int8_t> a = random_bytes(n);
+      std::vector<int8_t> b = random_bytes(n);
+      std::vector<int8_t> expected(n);
+      std::vector<int8_t> actual(n);
+      scalar->sum(expected.data(), a.data(), b.data(), n);
+      k->sum(actual.data(), a.data(), b.data(), n);
+      ASSERT_EQ(expected, actual);
+      scalar->diff(expected.data(), a.data(), b.data(), n);
+      k->diff(actual.data(), a.data(), b.data(), n);
+      ASSERT_EQ(expected, actual);
+      scalar->multiply(expected.data(), a.data(), b.data(), n);
+      k->multiply(actual.data(), a.data(), b.data(), n);
+      ASSERT_EQ(expected, actual);
+      for (int8_t factor = 0; factor < 4; ++factor) {
+        expected = a;
+        actual = a;
+        scalar->multiply_add(expected.data(), b.data(), factor, n);
+        k->multiply_add(actual.data(), b.data(), factor, n);
+        ASSERT_EQ(expected, actual);
+      }
+      std::vector<int8_t> c = random_bytes(n);
+      const int8_t* sources[] = {a.data(), b.data(), c.data()};
+      for (size_t count = 1; count <= 3; ++count) {
+        expected = a;
+        actual = a;
+        scalar->accumulate(expected.data(), sources, count, n);
+        k->accumulate(actual.data(), sources, count, n);
+        ASSERT_EQ(expected, actual);
+      }
+      std::vector<uint64_t> planes(2 * n);
+      for (size_t i = 0; i < planes.size(); ++i) {
+        planes[i] = (static_cast<uint64_t>(rand()) << 33) ^ rand();
+      }
+      ASSERT_EQ(scalar->planes_dot(planes.data(), planes.data() + n, n / 2),
+                k->planes_dot(planes.data(), planes.data() + n, n / 2));
+      int dot = 0;
+      for (size_t i = 0; i < 4 * n; ++i) {
+        dot += ((a[i / 4] >> ((i % 4) * 2)) & 0x03) * ((b[i / 4] >> ((i % 4) * 2)) & 0x03);
+      }
+      ASSERT_EQ(dot & 0x03, k->dot(a.data(), b.data(), n));
+      std::vector<uint64_t> a_panel(2 * PLANES_TILE_ROWS * n);
+      std::vector<uint64_t> b_panel(2 * PLANES_TILE_COLS * n);
+      for (size_t i = 0; i < a_panel.size(); ++i) {
+        a_panel[i] = (static_cast<uint64_t>(rand()) << 33) ^ rand();
+      }
+      for (size_t i = 0; i < b_panel.size(); ++i) {
+        b_panel[i] = (static_cast<uint64_t>(rand()) << 33) ^ rand();
+      }
+      std::vector<uint8_t> expected_acc(PLANES_TILE_ROWS * PLANES_TILE_COLS, 1);
+      std::vector<uint8_t> actual_acc(PLANES_TILE_ROWS * PLANES_TILE_COLS, 1);
+      scalar->planes_tile(a_panel.data(), b_panel.data(), n, expected_acc.data(), PLANES_TILE_COLS);
+      k->planes_tile(a_panel.data(), b_panel.data(), n, actual_acc.data(), PLANES_TILE_COLS);
+      for (size_t i = 0; i < expected_acc.size(); ++i) {
+        ASSERT_EQ(expected_acc[i] & 0x03, actual_acc[i] & 0x03);
+      }
+    }
+  }
+}
+
+//! Element c of word r of the block goes to element r of word c
+TEST(PackedKernelsTest, Transpose32Test) {
+  std::mt19937_64 gen(32);
+  for (size_t l = 0; l < sizeof(all_levels) / sizeof(all_levels[0]); ++l) {
+    const PackedKernels* k = packed_kernels(all_levels[l]);
+    if (!k)
+      continue;
+    for (size_t attempt = 0; attempt < 10; ++attempt) {
+      uint64_t block[32];
+      uint64_t expected[32] = {0};
+      for (size_t r = 0; r < 32; ++r) {
+        block[r] = gen();
+      }
+      for (size_t r = 0; r < 32; ++r) {
+        for (size_t c = 0; c < 32; ++c) {
+          expected[c] |= ((block[r] >> (2 * c)) & 0x03) << (2 * r);
+        }
+      }
+      k->transpose32(block);
+      for (size_t r = 0; r < 32; ++r) {
+        ASSERT_EQ(block[r], expected[r]);
+      }
+    }
+  }
+}
+
+//! Packed bytes are compared with the elements set one by one, tails are not written
+TEST(PackedKernelsTest, PackUnpackTest) {
+  size_t sizes[] = {1, 3, 8, 31, 32, 33, 100, 128, 255, 257, 1000};
+  for (size_t l = 0; l < sizeof(all_levels) / sizeof(all_levels[0]); ++l) {
+    const PackedKernels* k = packed_kernels(all_levels[l]);
+    if (!k)
+      continue;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+      size_t n = sizes[s];
+      size_t n_bytes = (n + 3) / 4;
+      std::vector<int8_t> elements = random_bytes(n);
+      std::vector<int8_t> expected(n_bytes + 1, 0x55);
+      expected[n_bytes - 1] = 0;
+      for (size_t j = 0; j < n; ++j) {
+        expected[j / 4] = (expected[j / 4] & ~(0x03 << (2 * (j % 4)))) | ((elements[j] & 0x03) << (2 * (j % 4)));
+      }
+      std::vector<int8_t> packed(n_bytes + 1, 0x55);
+      k->pack(packed.data(), reinterpret_cast<const uint8_t*>(elements.data()), n);
+      ASSERT_EQ(packed, expected);
+      std::vector<uint8_t> unpacked(n + 1, 0xFF);
+      k->unpack(unpacked.data(), packed.data(), n);
+      for (size_t j = 0; j < n; ++j) {
+        ASSERT_EQ(unpacked[j], elements[j] & 0x03);
+      }
+      ASSERT_EQ(unpacked[n], 0xFF);
+    }
+  }
+}
+
+TEST(PackedKernelsTest, MultiplyAddTest) {
+  Matrix a({{1, 2, 3, 0, 1}});
+  Matrix b({{3, 3, 2, 1, 1}});
+  std::vector<int8_t> dst(2);
+  std::vector<int8_t> src(2);
+  for (size_t j = 0; j < 5; ++j) {
+    dst[j / 4] |= a.get(0, j) << ((j % 4) * 2);
+    src[j / 4] |= b.get(0, j) << ((j % 4) * 2);
+  }
+  packed_kernels().multiply_add(dst.data(), src.data(), 3, 2);
+  // a + 3*b = {1+9, 2+9, 3+6, 0+3, 1+3} mod 4
+  int8_t expected[] = {2, 3, 1, 3, 0};
+  for (size_t j = 0; j < 5; ++j) {
+    ASSERT_EQ(expected[j], (dst[j / 4] >> ((j % 4) * 2)) & 0x03);
+  }
+}
+
+TEST(PackedKernelsTest, SimdLevelTest) {
+  Matrix::SimdLevel initial = Matrix::simd_level();
+  ASSERT_TRUE(Matrix::simd_supported(initial));
+  ASSERT_TRUE(Matrix::simd_supported(Matrix::SimdLevel::Scalar));
+  Matrix a(37, 70);
+  Matrix b(70, 41);
+  for (size_t i = 0; i < 70; ++i) {
+    for (size_t j = 0; j < 41; ++j) {
+      a.set(j % 37, i, rand());
+      b.set(i, j, rand());
+    }
+  }
+  Matrix::set_simd_level(Matrix::SimdLevel::Scalar);
+  Matrix expected_prod(a * b);
+  Matrix expected_sum(b + b);
+  Matrix expected_diff(a - a.transposed().transposed());
+  for (size_t l = 0; l < sizeof(all_levels) / sizeof(all_levels[0]); ++l) {
+    if (!Matrix::simd_supported(all_levels[l])) {
+      ASSERT_THROW(Matrix::set_simd_level(all_levels[l]), std::invalid_argument);
+      continue;
+    }
+    Matrix::set_simd_level(all_levels[l]);
+    ASSERT_EQ(Matrix::simd_level(), all_levels[l]);
+    ASSERT_EQ(a * b, expected_prod);
+    ASSERT_EQ(b + b, expected_sum);
+    ASSERT_EQ(a - a, expected_diff);
+  }
+  Matrix::set_simd_level(initial);
+}
@@ -0,0 +1,105 @@
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "packed_gemm.h"
+#include "packed_m4rm.h"
+#include "packed_test_utils.h"
+
+//! c = a * b, c += a * b or c -= a * b of packed rows depending on store
+typedef void (*PackedProduct)(int8_t* c, size_t c_stride, const int8_t* a, size_t a_stride,
+                              const int8_t* b, size_t b_stride, size_t m, size_t k, size_t n, PackedStore store);
+
+static void gemm_product(int8_t* c, size_t c_stride, const int8_t* a, size_t a_stride,
+                         const int8_t* b, size_t b_stride, size_t m, size_t k, size_t n, PackedStore store) {
+  PackedGemmWorkspace workspace;
+  packed_gemm(c, c_stride, a, a_stride, false, b, b_stride, false, m, k, n, store, workspace);
+}
+
+struct PackedProductParam {
+  const char* name;
+  PackedProduct product;
+};
+
+static void PrintTo(const PackedProductParam& param, std::ostream* os) {
+  *os << param.name;
+}
+
+/**
+ * The same tests for every kernel of the product of packed rows.
+ * The last sizes span several output blocks and k panels of packed_gemm
+ */
+class PackedProductTest : public ::testing::TestWithParam<PackedProductParam> {
+};
+
+static const size_t product_sizes[][3] = {{1, 1, 1}, {5, 3, 7}, {64, 64, 64}, {67, 129, 65}, {130, 70, 3},
+                                          {3, 300, 130}, {133, 20, 530}, {20, 33, 1100}, {5, 8300, 37}};
+
+/**
+ * Operands are filled with random bytes including bytes beyond their column numbers,
+ * these elements should not affect the result and bytes of c beyond its rows should not be touched
+ */
+TEST_P(PackedProductTest, StridedOperandsTest) {
+  PackedProduct product = GetParam().product;
+  for (size_t s = 0; s < sizeof(product_sizes) / sizeof(product_sizes[0]); ++s) {
+    size_t m = product_sizes[s][0];
+    size_t k = product_sizes[s][1];
+    size_t n = product_sizes[s][2];
+    size_t a_stride = k / 4 + 5;
+    size_t b_stride = n / 4 + 3;
+    size_t c_stride = n / 4 + 9;
+    std::vector<int8_t> a = random_bytes(m * a_stride);
+    std::vector<int8_t> b = random_bytes(k * b_stride);
+    std::vector<int8_t> c(m * c_stride, 0x55);
+    product(c.data(), c_stride, a.data(), a_stride, b.data(), b_stride, m, k, n, PackedStore::Assign);
+    for (size_t i = 0; i < m; ++i) {
+      for (size_t j = 0; j < n; ++j) {
+        ASSERT_EQ(product_element(a, a_stride, b, b_stride, i, j, k) & 0x03, get_element(c, c_stride, i, j));
+      }
+      for (size_t j = (n + 3) / 4; j < c_stride; ++j) {
+        ASSERT_EQ(0x55, c[i * c_stride + j]);
+      }
+    }
+  }
+}
+
+//! Products are accumulated into c, lanes of c beyond n should be kept
+TEST_P(PackedProductTest, AccumulateTest) {
+  PackedProduct product = GetParam().product;
+  for (size_t s = 0; s < sizeof(product_sizes) / sizeof(product_sizes[0]); ++s) {
+    size_t m = product_sizes[s][0];
+    size_t k = product_sizes[s][1];
+    size_t n = product_sizes[s][2];
+    size_t a_stride = k / 4 + 5;
+    size_t b_stride = n / 4 + 3;
+    size_t c_stride = n / 4 + 9;
+    std::vector<int8_t> a = random_bytes(m * a_stride);
+    std::vector<int8_t> b = random_bytes(k * b_stride);
+    PackedStore stores[] = {PackedStore::Add, PackedStore::Subtract};
+    for (size_t st = 0; st < 2; ++st) {
+      std::vector<int8_t> c = random_bytes(m * c_stride);
+      std::vector<int8_t> old(c);
+      product(c.data(), c_stride, a.data(), a_stride, b.data(), b_stride, m, k, n, stores[st]);
+      for (size_t i = 0; i < m; ++i) {
+        for (size_t j = 0; j < n; ++j) {
+          int sum = product_element(a, a_stride, b, b_stride, i, j, k);
+          int expected = get_element(old, c_stride, i, j) + (st ? -sum : sum);
+          ASSERT_EQ(expected & 0x03, get_element(c, c_stride, i, j));
+        }
+        for (size_t j = n; j < 4 * c_stride; ++j) {
+          ASSERT_EQ(get_element(old, c_stride, i, j), get_element(c, c_stride, i, j));
+        }
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Kernels, PackedProductTest,
+                         ::testing::Values(PackedProductParam{"gemm", gemm_product},
+                                           PackedProductParam{"m4rm", packed_m4rm}),
+                         [](const ::testing::TestParamInfo<PackedProductParam>& info) {
+                           return std::string(info.param.name);
+                         });
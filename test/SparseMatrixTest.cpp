@@ -0,0 +1,90 @@
+#include <limits>
+#include <stdexcept>
+
+#include <gtest/gtest.h>
+
+#include "sparse_matrix.h"
+
+//! Nonzero elements are placed with probability per_mille / 1000
+static void fill_sparse(Matrix& m, size_t per_mille) {
+  for (size_t i = 0; i < m.row(); ++i) {
+    for (size_t j = 0; j < m.col(); ++j) {
+      if (static_cast<size_t>(rand() % 1000) < per_mille)
+        m.set(i, j, rand() % 3 + 1);
+    }
+  }
+}
+
+TEST(SparseMatrixTest, ConversionTest) {
+  size_t sizes[][2] = {{0, 0}, {0, 5}, {3, 0}, {1, 1}, {7, 13}, {64, 64}, {130, 257}};
+  for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+    Matrix a(sizes[n][0], sizes[n][1]);
+    fill_sparse(a, 100);
+    SparseMatrix s(a);
+    ASSERT_EQ(s.row(), a.row());
+    ASSERT_EQ(s.col(), a.col());
+    ASSERT_EQ(s.to_matrix(), a);
+    ASSERT_EQ(s.row_begin().size(), a.row() + 1);
+    size_t count = 0;
+    for (size_t i = 0; i < a.row(); ++i) {
+      for (size_t j = 0; j < a.col(); ++j) {
+        ASSERT_EQ(s.get(i, j), a.get(i, j));
+        count += (a.get(i, j) != 0);
+      }
+    }
+    ASSERT_EQ(s.nonzeros(), count);
+    ASSERT_EQ(SparseMatrix::count_nonzeros(a), count);
+    ASSERT_EQ(SparseMatrix(s.to_matrix()), s);
+  }
+  ASSERT_EQ(SparseMatrix(Matrix(4, 5)), SparseMatrix(4, 5));
+  ASSERT_EQ(SparseMatrix(4, 5).density(), 0);
+  ASSERT_EQ(SparseMatrix(Matrix({{1, 0}, {0, 0}})).density(), 0.25);
+}
+
+//! Elements of the next columns sharing the last byte of the block are not taken
+TEST(SparseMatrixTest, BlockTest) {
+  Matrix a(9, 70);
+  fill_sparse(a, 500);
+  ConstMatrixView block(ConstMatrixView(a).block(2, 4, 5, 61));
+  SparseMatrix s(block);
+  ASSERT_EQ(s.to_matrix(), Matrix(block));
+  ASSERT_EQ(SparseMatrix::count_nonzeros(block), s.nonzeros());
+}
+
+TEST(SparseMatrixTest, MultiplicationTest) {
+  size_t sizes[][3] = {{1, 1, 1}, {7, 13, 5}, {64, 64, 64}, {150, 70, 257}};
+  size_t per_mille[] = {0, 20, 300, 1000};
+  for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+    for (size_t d = 0; d < sizeof(per_mille) / sizeof(per_mille[0]); ++d) {
+      Matrix a(sizes[n][0], sizes[n][1]);
+      Matrix b(sizes[n][1], sizes[n][2]);
+      fill_sparse(a, per_mille[d]);
+      fill_sparse(b, per_mille[d]);
+      Matrix expected(Matrix::multiply_trivial(a, b));
+      SparseMatrix s(a);
+      ASSERT_EQ(s * b, expected);
+      // Sums cancelling modulo 4 are not stored
+      ASSERT_EQ(s * SparseMatrix(b), SparseMatrix(expected));
+    }
+  }
+  ASSERT_THROW(SparseMatrix(2, 3) * Matrix(2, 3), std::length_error);
+  ASSERT_THROW(SparseMatrix(2, 3) * SparseMatrix(2, 3), std::length_error);
+}
+
+TEST(SparseMatrixTest, DensityTest) {
+  double density = Matrix::sparse_density();
+  Matrix a(100, 80);
+  Matrix b(80, 90);
+  fill_sparse(a, 10);
+  fill_sparse(b, 1000);
+  Matrix expected(Matrix::multiply_trivial(a, b));
+  Matrix::set_sparse_density(1);
+  ASSERT_EQ(a * b, expected);
+  Matrix::set_sparse_density(0);
+  ASSERT_EQ(a * b, expected);
+  ASSERT_THROW(Matrix::set_sparse_density(-0.5), std::invalid_argument);
+  ASSERT_THROW(Matrix::set_sparse_density(1.5), std::invalid_argument);
+  ASSERT_THROW(Matrix::set_sparse_density(std::numeric_limits<double>::quiet_NaN()), std::invalid_argument);
+  ASSERT_EQ(Matrix::sparse_density(), 0);
+  Matrix::set_sparse_density(density);
+}
@@ -0,0 +1,77 @@
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "strassen_profile.h"
+#include "matrix_strassen.h"
+#include "matrix_test_utils.h"
+
+//! Test build defines STRASSEN_PROFILE, so the hooks are compiled in
+TEST(StrassenProfileTest, CountersTest) {
+  size_t crossover = Matrix::strassen_crossover();
+  size_t thread_count = Matrix::thread_count();
+  Matrix::set_strassen_crossover(64);
+  Matrix::set_thread_count(1);
+  Matrix a(300, 300);
+  Matrix b(300, 300);
+  fill_random(a);
+  fill_random(b);
+  reset_strassen_profile();
+  ASSERT_EQ(Matrix::multiply_strassen(a, b), Matrix::multiply_trivial(a, b));
+  StrassenProfile profile(strassen_profile());
+  ASSERT_TRUE(profile.enabled);
+  ASSERT_EQ(profile.threads, 1U);
+  ASSERT_GT(profile.levels.size(), 2U);
+  const StrassenLevelProfile& top = profile.levels[0];
+  ASSERT_EQ(top.calls, 1U);
+  ASSERT_EQ(top.strassen_steps, 1U);
+  ASSERT_EQ(top.tasks, 0U);
+  ASSERT_EQ(top.element_ops, 300ULL * 300 * 300);
+  // Quadrants of 150 x 148 x 148 elements: 4 columns of a and b are peeled, rows are not
+  ASSERT_EQ(top.base_calls, 2U);
+  ASSERT_EQ(top.peeled_ops, 300ULL * 300 * 300 - 300ULL * 296 * 296);
+  ASSERT_GT(top.bytes_allocated, 0U);
+  ASSERT_EQ(profile.levels[1].calls, 7U);
+  uint64_t base_calls = 0;
+  uint64_t bytes_allocated = 0;
+  for (size_t level = 0; level < profile.levels.size(); ++level) {
+    base_calls += profile.levels[level].base_calls;
+    bytes_allocated += profile.levels[level].bytes_allocated;
+  }
+  ASSERT_GT(base_calls, 7U);
+  // Sequential sub-products reuse the memory of the previous ones
+  ASSERT_GT(profile.peak_live_bytes, 0U);
+  ASSERT_LT(profile.peak_live_bytes, bytes_allocated);
+  ASSERT_NE(profile.to_json().find("\"levels\""), std::string::npos);
+
+  reset_strassen_profile();
+  profile = strassen_profile();
+  ASSERT_TRUE(profile.levels.empty());
+  ASSERT_EQ(profile.peak_live_bytes, 0U);
+  Matrix::set_strassen_crossover(crossover);
+  Matrix::set_thread_count(thread_count);
+}
+
+//! Sub-products of the top levels are submitted to the thread pool
+TEST(StrassenProfileTest, TasksTest) {
+  size_t crossover = Matrix::strassen_crossover();
+  size_t thread_count = Matrix::thread_count();
+  size_t max_depth = Matrix::parallel_max_depth();
+  size_t min_size = Matrix::parallel_min_size();
+  Matrix::set_strassen_crossover(64);
+  Matrix::set_thread_count(2);
+  Matrix::set_parallel_limits(1, 0);
+  Matrix a(256, 256);
+  Matrix b(256, 256);
+  fill_random(a);
+  fill_random(b);
+  reset_strassen_profile();
+  ASSERT_EQ(Matrix::multiply_strassen(a, b), Matrix::multiply_trivial(a, b));
+  StrassenProfile profile(strassen_profile());
+  ASSERT_EQ(profile.levels[0].tasks, 7U);
+  ASSERT_EQ(profile.levels[1].tasks, 0U);
+  ASSERT_EQ(profile.levels[0].peeled_ops, 0U);
+  Matrix::set_parallel_limits(max_depth, min_size);
+  Matrix::set_strassen_crossover(crossover);
+  Matrix::set_thread_count(thread_count);
+}
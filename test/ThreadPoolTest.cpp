@@ -0,0 +1,91 @@
+#include <atomic>
+#include <stdexcept>
+
+#include <gtest/gtest.h>
+
+#include "matrix_strassen.h"
+#include "thread_pool.h"
+
+//! Sum of [first, last) computed by splitting the range into nested task groups
+static long nested_sum(ThreadPool* pool, long first, long last) {
+  if (last - first <= 4) {
+    long sum = 0;
+    for (long i = first; i < last; ++i) {
+      sum += i;
+    }
+    return sum;
+  }
+  long middle = (first + last) / 2;
+  long lhs = 0;
+  long rhs = 0;
+  TaskGroup group(pool);
+  group.run([&] { lhs = nested_sum(pool, first, middle); });
+  group.run([&] { rhs = nested_sum(pool, middle, last); });
+  group.wait();
+  return lhs + rhs;
+}
+
+TEST(ThreadPoolTest, NestedTasksTest) {
+  size_t sizes[] = {0, 1, 3};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    ThreadPool pool(sizes[s]);
+    ASSERT_EQ(pool.size(), sizes[s]);
+    ASSERT_EQ(nested_sum(&pool, 0, 10000), 10000L * 9999 / 2);
+    std::atomic<size_t> count(0);
+    TaskGroup group(&pool);
+    for (size_t i = 0; i < 1000; ++i) {
+      group.run([&count] { ++count; });
+    }
+    group.wait();
+    ASSERT_EQ(count.load(), 1000u);
+  }
+  ASSERT_EQ(nested_sum(nullptr, 0, 100), 100L * 99 / 2);
+}
+
+TEST(ThreadPoolTest, ExceptionTest) {
+  ThreadPool pool(2);
+  TaskGroup group(&pool);
+  std::atomic<size_t> count(0);
+  for (size_t i = 0; i < 10; ++i) {
+    group.run([&count, i] {
+      ++count;
+      if (i == 5)
+        throw std::runtime_error("task failed");
+    });
+  }
+  ASSERT_THROW(group.wait(), std::runtime_error);
+  ASSERT_EQ(count.load(), 10u);
+}
+
+TEST(ThreadPoolTest, ParallelStrassenTest) {
+  size_t thread_count = Matrix::thread_count();
+  size_t max_depth = Matrix::parallel_max_depth();
+  size_t min_size = Matrix::parallel_min_size();
+  ASSERT_THROW(Matrix::set_thread_count(0), std::invalid_argument);
+  Matrix a(300, 256);
+  Matrix b(256, 260);
+  for (size_t i = 0; i < a.row(); ++i) {
+    for (size_t j = 0; j < a.col(); ++j) {
+      a.set(i, j, rand());
+    }
+  }
+  for (size_t i = 0; i < b.row(); ++i) {
+    for (size_t j = 0; j < b.col(); ++j) {
+      b.set(i, j, rand());
+    }
+  }
+  Matrix expected(Matrix::multiply_trivial(a, b));
+  size_t counts[] = {1, 2, 5};
+  for (size_t t = 0; t < sizeof(counts) / sizeof(counts[0]); ++t) {
+    Matrix::set_thread_count(counts[t]);
+    ASSERT_EQ(Matrix::thread_count(), counts[t]);
+    Matrix::set_parallel_limits(0, 0);
+    ASSERT_EQ(Matrix::multiply_strassen(a, b), expected);
+    Matrix::set_parallel_limits(8, 64);
+    ASSERT_EQ(Matrix::parallel_max_depth(), 8u);
+    ASSERT_EQ(Matrix::parallel_min_size(), 64u);
+    ASSERT_EQ(Matrix::multiply_strassen(a, b), expected);
+  }
+  Matrix::set_thread_count(thread_count);
+  Matrix::set_parallel_limits(max_depth, min_size);
+}
@@ -0,0 +1,92 @@
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "matrix_strassen.h"
+
+TEST(TuningTest, CrossoverTest) {
+  Matrix::Tuning tuning = Matrix::tuning();
+  ASSERT_THROW(Matrix::set_strassen_crossover(7), std::invalid_argument);
+  Matrix a(150, 130);
+  Matrix b(130, 140);
+  for (size_t i = 0; i < a.row(); ++i) {
+    for (size_t j = 0; j < a.col(); ++j) {
+      a.set(i, j, rand());
+    }
+  }
+  for (size_t i = 0; i < b.row(); ++i) {
+    for (size_t j = 0; j < b.col(); ++j) {
+      b.set(i, j, rand());
+    }
+  }
+  Matrix expected(Matrix::multiply_trivial(a, b));
+  size_t crossovers[] = {8, 33, 200};
+  for (size_t n = 0; n < sizeof(crossovers) / sizeof(crossovers[0]); ++n) {
+    Matrix::set_strassen_crossover(crossovers[n]);
+    ASSERT_EQ(Matrix::strassen_crossover(), crossovers[n]);
+    ASSERT_EQ(Matrix::multiply_strassen(a, b), expected);
+    ASSERT_EQ(Matrix::multiply_winograd(a, b), expected);
+  }
+  Matrix::set_tuning(tuning);
+}
+
+TEST(TuningTest, TuningFileTest) {
+  Matrix::Tuning saved = Matrix::tuning();
+  const char* path = "qmatrix_test.tuning";
+  Matrix::Tuning tuning;
+  tuning.crossover = 96;
+  tuning.base_algorithm = Matrix::Algorithm::M4RM;
+  tuning.parallel_max_depth = 2;
+  tuning.parallel_min_size = 512;
+  Matrix::save_tuning(path, tuning);
+  ASSERT_TRUE(Matrix::load_tuning(path));
+  Matrix::Tuning loaded = Matrix::tuning();
+  ASSERT_EQ(loaded.crossover, 96u);
+  ASSERT_EQ(loaded.base_algorithm, Matrix::Algorithm::M4RM);
+  ASSERT_EQ(loaded.parallel_max_depth, 2u);
+  ASSERT_EQ(loaded.parallel_min_size, 512u);
+  Matrix::set_tuning(saved);
+  // Bad files do not change the current tuning
+  const char* bad[] = {"version 1\ncrossover 96\n", "version 2\ncrossover 96\nbase_algorithm m4rm\n"
+                       "parallel_max_depth 2\nparallel_min_size 512\n", "crossover x\n"};
+  for (size_t n = 0; n < sizeof(bad) / sizeof(bad[0]); ++n) {
+    {
+      std::ofstream out(path);
+      out << bad[n];
+    }
+    ASSERT_THROW(Matrix::load_tuning(path), std::runtime_error);
+    ASSERT_EQ(Matrix::tuning().crossover, saved.crossover);
+  }
+  remove(path);
+  ASSERT_FALSE(Matrix::load_tuning(path));
+  ASSERT_THROW(Matrix::set_tuning(Matrix::Tuning{4, Matrix::Algorithm::Trivial, 0, 0}), std::invalid_argument);
+  ASSERT_THROW(Matrix::set_tuning(Matrix::Tuning{64, Matrix::Algorithm::Strassen, 0, 0}), std::invalid_argument);
+}
+
+TEST(TuningTest, CalibrationTest) {
+  Matrix::Tuning saved = Matrix::tuning();
+  // Multiplications of the other threads keep seeing the current tuning during calibration
+  std::atomic<bool> done(false);
+  std::atomic<bool> changed(false);
+  std::thread observer([&] {
+    while (!done) {
+      if (Matrix::tuning().crossover != saved.crossover)
+        changed = true;
+    }
+  });
+  Matrix::Tuning tuning = Matrix::calibrate(128, 1);
+  done = true;
+  observer.join();
+  ASSERT_FALSE(changed);
+  ASSERT_GE(tuning.crossover, 8u);
+  ASSERT_TRUE((tuning.base_algorithm == Matrix::Algorithm::Trivial) ||
+              (tuning.base_algorithm == Matrix::Algorithm::M4RM));
+  Matrix::Tuning current = Matrix::tuning();
+  ASSERT_EQ(current.crossover, saved.crossover);
+  ASSERT_EQ(current.parallel_max_depth, saved.parallel_max_depth);
+  ASSERT_THROW(Matrix::calibrate(8, 1), std::invalid_argument);
+}
@@ -0,0 +1,20 @@
+#ifndef MATRIX_TEST_UTILS_H
+#define MATRIX_TEST_UTILS_H
+
+#include <cstdlib>
+#include <cstddef>
+
+#include "matrix_strassen.h"
+
+//! Helpers of the tests working with Matrix objects
+
+//! Random elements, set() takes the values modulo 4
+inline void fill_random(Matrix& m) {
+  for (size_t i = 0; i < m.row(); ++i) {
+    for (size_t j = 0; j < m.col(); ++j) {
+      m.set(i, j, rand());
+    }
+  }
+}
+
+#endif // MATRIX_TEST_UTILS_H
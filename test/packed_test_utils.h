@@ -0,0 +1,39 @@
+#ifndef PACKED_TEST_UTILS_H
+#define PACKED_TEST_UTILS_H
+
+#include <cstdlib>
+#include <cstddef>
+#include <vector>
+
+#include <stdint.h>
+
+/*
+ * Helpers of the tests of the packed row kernels and products:
+ * operands are raw packed rows with strides, not Matrix objects
+ */
+
+//! j-th element of i-th packed row of data with rows of stride bytes
+inline int8_t get_element(const std::vector<int8_t>& data, size_t stride, size_t i, size_t j) {
+  return (data[i * stride + j / 4] >> ((j % 4) * 2)) & 0x03;
+}
+
+//! Random bytes, all lanes including the ones beyond column numbers are random
+inline std::vector<int8_t> random_bytes(size_t n) {
+  std::vector<int8_t> v(n);
+  for (size_t i = 0; i < n; ++i) {
+    v[i] = rand();
+  }
+  return v;
+}
+
+//! Element (i, j) of the [m x k] * [k x n] product of packed rows, not reduced modulo 4
+inline int product_element(const std::vector<int8_t>& a, size_t a_stride,
+                           const std::vector<int8_t>& b, size_t b_stride, size_t i, size_t j, size_t k) {
+  int sum = 0;
+  for (size_t l = 0; l < k; ++l) {
+    sum += get_element(a, a_stride, i, l) * get_element(b, b_stride, l, j);
+  }
+  return sum;
+}
+
+#endif // PACKED_TEST_UTILS_H
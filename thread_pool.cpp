@@ -0,0 +1,154 @@
+#include <chrono>
+
+#include "thread_pool.h"
+
+//! Pool and index of the worker running in the current thread
+static thread_local ThreadPool* current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+ThreadPool::ThreadPool(size_t n_workers)
+           :workers_(), threads_(), pending_(0), next_(0),
+            sleep_mutex_(), wake_(), stop_(false) {
+  for (size_t i = 0; i < n_workers; ++i) {
+    workers_.emplace_back(new Worker());
+  }
+  for (size_t i = 0; i < n_workers; ++i) {
+    threads_.emplace_back(&ThreadPool::work, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i].join();
+  }
+}
+
+size_t ThreadPool::size() const {
+  return workers_.size();
+}
+
+void ThreadPool::submit(Task task) {
+  if (workers_.empty()) {
+    task();
+    return;
+  }
+  size_t index = (current_pool == this) ? current_worker : next_++ % workers_.size();
+  {
+    std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+    workers_[index]->tasks.push_back(std::move(task));
+  }
+  {
+    // Taking the lock orders the increment with the check of a sleeping worker
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    ++pending_;
+  }
+  wake_.notify_one();
+}
+
+bool ThreadPool::take(size_t index, Task& task) {
+  if (pending_.load() == 0)
+    return false;
+  size_t n = workers_.size();
+  for (size_t k = 0; k < n; ++k) {
+    size_t victim = (index + k) % n;
+    Worker& worker = *workers_[victim];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty())
+      continue;
+    // Own tasks are taken from the back, stolen ones from the front
+    if (k == 0) {
+      task = std::move(worker.tasks.back());
+      worker.tasks.pop_back();
+    } else {
+      task = std::move(worker.tasks.front());
+      worker.tasks.pop_front();
+    }
+    --pending_;
+    return true;
+  }
+  return false;
+}
+
+bool ThreadPool::run_pending() {
+  if (workers_.empty())
+    return false;
+  size_t index = (current_pool == this) ? current_worker : next_.load() % workers_.size();
+  Task task;
+  if (!take(index, task))
+    return false;
+  task();
+  return true;
+}
+
+void ThreadPool::work(size_t index) {
+  current_pool = this;
+  current_worker = index;
+  for (;;) {
+    Task task;
+    if (take(index, task)) {
+      task();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    wake_.wait(lock, [this] { return stop_ || pending_.load() != 0; });
+    if (stop_)
+      return;
+  }
+}
+
+TaskGroup::TaskGroup(ThreadPool* pool)
+          :pool_(pool), remaining_(0), mutex_(), done_(), error_() {
+}
+
+TaskGroup::~TaskGroup() {
+  try {
+    wait();
+  } catch (...) {
+  }
+}
+
+void TaskGroup::run(ThreadPool::Task task) {
+  if (!pool_) {
+    task();
+    return;
+  }
+  ++remaining_;
+  pool_->submit([this, task] {
+    std::exception_ptr error;
+    try {
+      task();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    finish(error);
+  });
+}
+
+void TaskGroup::finish(std::exception_ptr error) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (error && !error_)
+    error_ = error;
+  if (--remaining_ == 0)
+    done_.notify_all();
+}
+
+void TaskGroup::wait() {
+  while (remaining_.load() != 0) {
+    if (pool_->run_pending())
+      continue;
+    // Tasks of the group are running in other threads, new tasks may be submitted by them
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait_for(lock, std::chrono::microseconds(200), [this] { return remaining_.load() == 0; });
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (error_) {
+    std::exception_ptr error = error_;
+    error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+}
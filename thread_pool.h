@@ -0,0 +1,83 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Persistent pool of worker threads with work stealing.
+ * Every worker has its own deque of tasks: tasks submitted from a worker
+ * are pushed to its own deque and taken back in LIFO order, idle workers
+ * steal the oldest tasks of the others. Tasks submitted from other threads
+ * are distributed between the workers round-robin
+ */
+class ThreadPool {
+public:
+  typedef std::function<void()> Task;
+  //! Starts n_workers threads
+  explicit ThreadPool(size_t n_workers);
+  //! Waits for the running tasks and joins workers, pending tasks are dropped
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  size_t size() const;
+  void submit(Task task);
+  /**
+   * Runs one pending task in the calling thread
+   * Returns false if there were no pending tasks
+   */
+  bool run_pending();
+private:
+  struct Worker {
+    Worker() :mutex(), tasks() {}
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+  void work(size_t index);
+  //! Takes a task from own deque of the worker or steals one from the others
+  bool take(size_t index, Task& task);
+  std::vector<std::unique_ptr<Worker> > workers_;
+  std::vector<std::thread> threads_;
+  //! Number of tasks in all deques
+  std::atomic<size_t> pending_;
+  //! Round-robin counter for tasks submitted outside of the pool
+  std::atomic<size_t> next_;
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  bool stop_;
+};
+
+/**
+ * Set of tasks which are waited for together.
+ * Without a pool tasks are run immediately in the calling thread.
+ * wait() runs pending tasks of the pool while the group is not finished,
+ * so waiting inside of a task does not block a worker.
+ * The first exception thrown by a task is rethrown from wait()
+ */
+class TaskGroup {
+public:
+  explicit TaskGroup(ThreadPool* pool);
+  //! Waits for the remaining tasks, exceptions are ignored
+  ~TaskGroup();
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+  void run(ThreadPool::Task task);
+  void wait();
+private:
+  void finish(std::exception_ptr error);
+  ThreadPool* pool_;
+  std::atomic<size_t> remaining_;
+  std::mutex mutex_;
+  std::condition_variable done_;
+  std::exception_ptr error_;
+};
+
+#endif // THREAD_POOL_H